@@ -93,7 +93,7 @@ int main() {
 		printf("Unable to initialize runtime \n");
 		goto cleanup;
 	}
-	channel = create_tcp_client(runtime, "127.0.0.1:502", 100);
+	channel = create_tcp_client(runtime, "127.0.0.1:502", 100, DecodeLevel_Function, (socket_options_t) {.no_delay = true});
 	if (!channel) {
 		printf("Unable to initialize channel \n");
 		goto cleanup;
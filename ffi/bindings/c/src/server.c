@@ -49,24 +49,22 @@ write_result_t on_write_single_register(uint16_t value, uint16_t address, databa
 
 write_result_t on_write_multiple_coils(uint16_t start, bit_iterator_t* it, database_t* db, void* ctx)
 {
-	bit_t* bit = NULL;
-	while (bit = next_bit(it))
-	{
-		if(!database_update_coil(db, bit->index, bit->value)) {
-			return write_result_exception(Exception_IllegalDataAddress);
-		}
+	// a single request holds at most 1968 coils
+	bit_t bits[1968];
+	uint32_t count = bit_iterator_copy(it, bits, 1968);
+	if (!database_update_coil_values(db, bits, count)) {
+		return write_result_exception(Exception_IllegalDataAddress);
 	}
 	return write_result_success();
 }
 
 write_result_t on_write_multiple_registers(uint16_t start, register_iterator_t* it, database_t* db, void* ctx)
 {
-	register_t* reg = NULL;
-	while (reg = next_register(it))
-	{
-		if (!database_update_holding_register(db, reg->index, reg->value)) {
-			return write_result_exception(Exception_IllegalDataAddress);
-		}
+	// a single request holds at most 123 registers
+	register_t registers[123];
+	uint32_t count = register_iterator_copy(it, registers, 123);
+	if (!database_update_holding_register_values(db, registers, count)) {
+		return write_result_exception(Exception_IllegalDataAddress);
 	}
 	return write_result_success();
 }
@@ -132,7 +130,7 @@ int main() {
 
 	device_map_t* map = create_device_map();
 	map_add_endpoint(map, 1, get_write_handler(), (database_callback_t) {.callback = configure_db, .ctx = NULL});
-	server = create_tcp_server(runtime, "127.0.0.1:502", 100, map);
+	server = create_tcp_server(runtime, "127.0.0.1:502", 100, map, DecodeLevel_Function, (socket_options_t) {.no_delay = true});
 	destroy_device_map(map);	
 
 	if (server == NULL) {
@@ -200,8 +200,9 @@ namespace rodbus_tests
                 }
             }));
 
-            var server = Server.CreateTcpServer(runtime, ENDPOINT, 100, map);
-            var client = Channel.CreateTcpClient(runtime, ENDPOINT, 10);
+            var socketOptions = new SocketOptions { NoDelay = true };
+            var server = Server.CreateTcpServer(runtime, ENDPOINT, 100, map, DecodeLevel.Nothing, socketOptions);
+            var client = Channel.CreateTcpClient(runtime, ENDPOINT, 10, DecodeLevel.Nothing, socketOptions);
 
             // set a unique pattern to test reads
             server.Update(UNIT_ID, new DatabaseUpdate(db =>
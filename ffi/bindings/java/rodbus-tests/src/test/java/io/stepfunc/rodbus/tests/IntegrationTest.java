@@ -76,8 +76,15 @@ public class IntegrationTest {
                 }
             });
 
-            Server server = Server.createTcpServer(runtime, ENDPOINT, ushort(100), map);
-            Channel client = Channel.createTcpClient(runtime, ENDPOINT, ushort(10));
+            SocketOptions socketOptions = new SocketOptions();
+            socketOptions.noDelay = true;
+            socketOptions.recvBufferSize = uint(0);
+            socketOptions.sendBufferSize = uint(0);
+            socketOptions.keepAliveMs = uint(0);
+            socketOptions.readBufferSize = uint(0);
+
+            Server server = Server.createTcpServer(runtime, ENDPOINT, ushort(100), map, DecodeLevel.NOTHING, socketOptions);
+            Channel client = Channel.createTcpClient(runtime, ENDPOINT, ushort(10), DecodeLevel.NOTHING, socketOptions);
 
             // Set a unique pattern to test reads
             server.update(UNIT_ID, db -> {
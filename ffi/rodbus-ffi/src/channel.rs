@@ -10,6 +10,8 @@ pub(crate) unsafe fn create_tcp_client(
     runtime: *mut crate::Runtime,
     address: &std::ffi::CStr,
     max_queued_requests: u16,
+    decode_level: crate::ffi::DecodeLevel,
+    socket_options: crate::ffi::SocketOptions,
 ) -> *mut crate::Channel {
     let rt = runtime.as_mut().unwrap();
 
@@ -19,10 +21,17 @@ pub(crate) unsafe fn create_tcp_client(
         None => return null_mut(),
     };
 
-    let (handle, task) = rodbus::client::create_handle_and_task(
+    let options = rodbus::client::channel::ChannelOptions {
+        decode: decode_level.into(),
+        socket: socket_options.into(),
+        ..rodbus::client::channel::ChannelOptions::default()
+    };
+
+    let (handle, task) = rodbus::client::create_handle_and_task_with_options(
         addr,
         max_queued_requests as usize,
         rodbus::client::channel::strategy::default(),
+        options,
     );
 
     rt.spawn(task);
@@ -39,6 +48,18 @@ pub(crate) unsafe fn destroy_channel(channel: *mut crate::Channel) {
     };
 }
 
+pub(crate) unsafe fn channel_get_metrics(
+    channel: *mut crate::Channel,
+) -> crate::ffi::ChannelMetrics {
+    match channel.as_ref() {
+        Some(x) => x.inner.metrics().into(),
+        None => {
+            log::error!("channel may not be NULL");
+            rodbus::metrics::ChannelMetrics::default().into()
+        }
+    }
+}
+
 pub(crate) unsafe fn channel_read_coils_async(
     channel: *mut crate::Channel,
     range: crate::ffi::AddressRange,
@@ -284,3 +305,52 @@ pub(crate) unsafe fn channel_write_multiple_registers_async(
         .runtime
         .block_on(session.write_multiple_registers(argument, callback));
 }
+
+pub(crate) unsafe fn channel_read_write_multiple_registers_async(
+    channel: *mut crate::Channel,
+    range: crate::ffi::AddressRange,
+    start: u16,
+    items: *mut crate::RegisterList,
+    param: crate::ffi::RequestParam,
+    callback: crate::ffi::RegisterReadCallback,
+) {
+    let channel = match channel.as_ref() {
+        Some(x) => x,
+        None => {
+            log::error!("channel may not be NULL");
+            return callback.bad_argument();
+        }
+    };
+
+    let items = match items.as_ref() {
+        Some(x) => x,
+        None => {
+            log::error!("list may not be NULL");
+            return callback.bad_argument();
+        }
+    };
+
+    let callback = callback.convert_to_fn_once();
+
+    let range = match AddressRange::try_from(range.start, range.count) {
+        Err(err) => {
+            log::error!("Invalid address range: {}", err);
+            return callback(Err(err.into()));
+        }
+        Ok(range) => range,
+    };
+
+    let argument = match WriteMultiple::from(start, items.inner.clone()) {
+        Ok(x) => x,
+        Err(err) => {
+            log::error!("bad range: {}", err);
+            return callback(Err(err.into()));
+        }
+    };
+
+    let mut session = param.build_session(channel);
+
+    channel
+        .runtime
+        .block_on(session.read_write_multiple_registers(range, argument, callback));
+}
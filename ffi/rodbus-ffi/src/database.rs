@@ -1,47 +1,231 @@
-use std::collections::hash_map::Entry;
-use std::collections::HashMap;
+use std::ops::Range;
 
+/// Contiguous block of points starting at a particular address
 #[derive(Clone)]
-pub struct Database {
-    pub(crate) coils: HashMap<u16, bool>,
-    pub(crate) discrete_input: HashMap<u16, bool>,
-    pub(crate) holding_registers: HashMap<u16, u16>,
-    pub(crate) input_registers: HashMap<u16, u16>,
+struct Segment<T> {
+    start: u16,
+    values: Vec<T>,
 }
 
-impl Database {
+impl<T> Segment<T> {
+    // one past the last address, as a u32 so that a segment ending at u16::MAX doesn't overflow
+    fn end(&self) -> u32 {
+        self.start as u32 + self.values.len() as u32
+    }
+
+    fn contains(&self, index: u16) -> bool {
+        index >= self.start && (index as u32) < self.end()
+    }
+}
+
+/// Dense storage for a single point type
+///
+/// Points are stored in sorted, non-overlapping segments of contiguous addresses. Adjacent
+/// segments are always merged, so a range of points is present if and only if it lies within
+/// a single segment, and it can then be accessed as a slice.
+#[derive(Clone)]
+pub(crate) struct PointMap<T> {
+    segments: Vec<Segment<T>>,
+}
+
+impl<T> PointMap<T>
+where
+    T: Copy,
+{
     pub(crate) fn new() -> Self {
         Self {
-            coils: HashMap::new(),
-            discrete_input: HashMap::new(),
-            holding_registers: HashMap::new(),
-            input_registers: HashMap::new(),
+            segments: Vec::new(),
         }
     }
-}
 
-fn add_entry<T>(map: &mut HashMap<u16, T>, index: u16, value: T) -> bool {
-    if let Entry::Vacant(e) = map.entry(index) {
-        e.insert(value);
+    // position of the last segment that starts at or before the index
+    fn find(&self, index: u16) -> Option<usize> {
+        match self.segments.binary_search_by(|seg| seg.start.cmp(&index)) {
+            Ok(pos) => Some(pos),
+            Err(0) => None,
+            Err(pos) => Some(pos - 1),
+        }
+    }
+
+    fn find_containing(&self, index: u16) -> Option<usize> {
+        self.find(index)
+            .filter(|pos| self.segments[*pos].contains(index))
+    }
+
+    pub(crate) fn get(&self, index: u16) -> Option<&T> {
+        let pos = self.find_containing(index)?;
+        let seg = &self.segments[pos];
+        seg.values.get((index - seg.start) as usize)
+    }
+
+    pub(crate) fn get_mut(&mut self, index: u16) -> Option<&mut T> {
+        let pos = self.find_containing(index)?;
+        let seg = &mut self.segments[pos];
+        seg.values.get_mut((index - seg.start) as usize)
+    }
+
+    /// Retrieve a slice for a range of addresses, only if every address in the range is present
+    pub(crate) fn get_range(&self, range: Range<usize>) -> Option<&[T]> {
+        if range.start >= range.end || range.end > (u16::MAX as usize) + 1 {
+            return None;
+        }
+        let pos = self.find_containing(range.start as u16)?;
+        let seg = &self.segments[pos];
+        let offset = seg.start as usize;
+        seg.values.get(range.start - offset..range.end - offset)
+    }
+
+    /// Add a point, returning false if it already exists
+    pub(crate) fn add(&mut self, index: u16, value: T) -> bool {
+        let prev = self.find(index);
+
+        if let Some(pos) = prev {
+            if self.segments[pos].contains(index) {
+                return false;
+            }
+        }
+
+        let next = prev.map_or(0, |pos| pos + 1);
+        let joins_next = self
+            .segments
+            .get(next)
+            .map_or(false, |seg| seg.start as u32 == index as u32 + 1);
+
+        match prev.filter(|pos| self.segments[*pos].end() == index as u32) {
+            Some(pos) => {
+                // extend the previous segment, merging the following segment if it's now adjacent
+                self.segments[pos].values.push(value);
+                if joins_next {
+                    let seg = self.segments.remove(next);
+                    self.segments[pos].values.extend(seg.values);
+                }
+            }
+            None => {
+                if joins_next {
+                    let seg = &mut self.segments[next];
+                    seg.start = index;
+                    seg.values.insert(0, value);
+                } else {
+                    self.segments.insert(
+                        next,
+                        Segment {
+                            start: index,
+                            values: vec![value],
+                        },
+                    );
+                }
+            }
+        }
+
         true
-    } else {
-        false
     }
-}
 
-fn update_entry<T>(map: &mut HashMap<u16, T>, index: u16, value: T) -> bool {
-    if let Entry::Occupied(mut e) = map.entry(index) {
-        e.insert(value);
+    /// Update an existing point, returning false if it doesn't exist
+    pub(crate) fn update(&mut self, index: u16, value: T) -> bool {
+        match self.get_mut(index) {
+            Some(x) => {
+                *x = value;
+                true
+            }
+            None => false,
+        }
+    }
+
+    /// Update a contiguous range of existing points starting at an address. Nothing is updated
+    /// and false is returned unless every address in the range exists.
+    pub(crate) fn update_range(&mut self, start: u16, values: &[T]) -> bool {
+        if values.is_empty() || start as usize + values.len() > (u16::MAX as usize) + 1 {
+            return false;
+        }
+        let pos = match self.find_containing(start) {
+            Some(x) => x,
+            None => return false,
+        };
+        let seg = &mut self.segments[pos];
+        let offset = (start - seg.start) as usize;
+        match seg.values.get_mut(offset..offset + values.len()) {
+            Some(x) => {
+                x.copy_from_slice(values);
+                true
+            }
+            None => false,
+        }
+    }
+
+    /// Update existing points from index/value pairs in any order. Nothing is updated and
+    /// false is returned unless every index exists.
+    pub(crate) fn update_all<I>(&mut self, values: I) -> bool
+    where
+        I: Iterator<Item = (u16, T)> + Clone,
+    {
+        if !values
+            .clone()
+            .all(|(index, _)| self.find_containing(index).is_some())
+        {
+            return false;
+        }
+        for (index, value) in values {
+            self.update(index, value);
+        }
+        true
+    }
+
+    /// Remove a point, returning false if it doesn't exist
+    pub(crate) fn remove(&mut self, index: u16) -> bool {
+        let pos = match self.find_containing(index) {
+            Some(x) => x,
+            None => return false,
+        };
+
+        let seg = &mut self.segments[pos];
+        let offset = (index - seg.start) as usize;
+        if seg.values.len() == 1 {
+            self.segments.remove(pos);
+        } else if offset == 0 {
+            seg.values.remove(0);
+            seg.start += 1;
+        } else if offset == seg.values.len() - 1 {
+            seg.values.pop();
+        } else {
+            // split the segment in two
+            let tail = seg.values.split_off(offset + 1);
+            seg.values.pop();
+            self.segments.insert(
+                pos + 1,
+                Segment {
+                    start: index + 1,
+                    values: tail,
+                },
+            );
+        }
+
         true
-    } else {
-        false
+    }
+}
+
+#[derive(Clone)]
+pub struct Database {
+    pub(crate) coils: PointMap<bool>,
+    pub(crate) discrete_input: PointMap<bool>,
+    pub(crate) holding_registers: PointMap<u16>,
+    pub(crate) input_registers: PointMap<u16>,
+}
+
+impl Database {
+    pub(crate) fn new() -> Self {
+        Self {
+            coils: PointMap::new(),
+            discrete_input: PointMap::new(),
+            holding_registers: PointMap::new(),
+            input_registers: PointMap::new(),
+        }
     }
 }
 
 pub unsafe fn database_add_coil(database: *mut crate::Database, index: u16, value: bool) -> bool {
     match database.as_mut() {
         None => false,
-        Some(database) => add_entry(&mut database.coils, index, value),
+        Some(database) => database.coils.add(index, value),
     }
 }
 
@@ -52,7 +236,7 @@ pub unsafe fn database_add_discrete_input(
 ) -> bool {
     match database.as_mut() {
         None => false,
-        Some(database) => add_entry(&mut database.discrete_input, index, value),
+        Some(database) => database.discrete_input.add(index, value),
     }
 }
 
@@ -63,7 +247,7 @@ pub unsafe fn database_add_holding_register(
 ) -> bool {
     match database.as_mut() {
         None => false,
-        Some(database) => add_entry(&mut database.holding_registers, index, value),
+        Some(database) => database.holding_registers.add(index, value),
     }
 }
 
@@ -74,7 +258,7 @@ pub unsafe fn database_add_input_register(
 ) -> bool {
     match database.as_mut() {
         None => false,
-        Some(database) => add_entry(&mut database.input_registers, index, value),
+        Some(database) => database.input_registers.add(index, value),
     }
 }
 
@@ -85,7 +269,7 @@ pub unsafe fn database_update_coil(
 ) -> bool {
     match database.as_mut() {
         None => false,
-        Some(database) => update_entry(&mut database.coils, index, value),
+        Some(database) => database.coils.update(index, value),
     }
 }
 
@@ -96,7 +280,7 @@ pub unsafe fn database_update_discrete_input(
 ) -> bool {
     match database.as_mut() {
         None => false,
-        Some(database) => update_entry(&mut database.discrete_input, index, value),
+        Some(database) => database.discrete_input.update(index, value),
     }
 }
 
@@ -107,7 +291,7 @@ pub unsafe fn database_update_holding_register(
 ) -> bool {
     match database.as_mut() {
         None => false,
-        Some(database) => update_entry(&mut database.holding_registers, index, value),
+        Some(database) => database.holding_registers.update(index, value),
     }
 }
 
@@ -118,34 +302,223 @@ pub unsafe fn database_update_input_register(
 ) -> bool {
     match database.as_mut() {
         None => false,
-        Some(database) => update_entry(&mut database.input_registers, index, value),
+        Some(database) => database.input_registers.update(index, value),
+    }
+}
+
+pub unsafe fn database_update_coils(
+    database: *mut crate::Database,
+    start: u16,
+    values: *mut crate::BitList,
+) -> bool {
+    match (database.as_mut(), values.as_ref()) {
+        (Some(database), Some(values)) => database.coils.update_range(start, &values.inner),
+        _ => false,
+    }
+}
+
+pub unsafe fn database_update_discrete_inputs(
+    database: *mut crate::Database,
+    start: u16,
+    values: *mut crate::BitList,
+) -> bool {
+    match (database.as_mut(), values.as_ref()) {
+        (Some(database), Some(values)) => {
+            database.discrete_input.update_range(start, &values.inner)
+        }
+        _ => false,
+    }
+}
+
+pub unsafe fn database_update_holding_registers(
+    database: *mut crate::Database,
+    start: u16,
+    values: *mut crate::RegisterList,
+) -> bool {
+    match (database.as_mut(), values.as_ref()) {
+        (Some(database), Some(values)) => database
+            .holding_registers
+            .update_range(start, &values.inner),
+        _ => false,
+    }
+}
+
+pub unsafe fn database_update_input_registers(
+    database: *mut crate::Database,
+    start: u16,
+    values: *mut crate::RegisterList,
+) -> bool {
+    match (database.as_mut(), values.as_ref()) {
+        (Some(database), Some(values)) => {
+            database.input_registers.update_range(start, &values.inner)
+        }
+        _ => false,
+    }
+}
+
+// the caller passes a pointer to the first element of an array of `count` values
+unsafe fn values<'a, T>(first: Option<&'a T>, count: u32) -> Option<&'a [T]> {
+    first.map(|x| std::slice::from_raw_parts(x as *const T, count as usize))
+}
+
+pub unsafe fn database_update_coil_values(
+    database: *mut crate::Database,
+    values: Option<&crate::ffi::Bit>,
+    count: u32,
+) -> bool {
+    match (database.as_mut(), self::values(values, count)) {
+        (Some(database), Some(values)) => database
+            .coils
+            .update_all(values.iter().map(|x| (x.index, x.value))),
+        _ => false,
+    }
+}
+
+pub unsafe fn database_update_discrete_input_values(
+    database: *mut crate::Database,
+    values: Option<&crate::ffi::Bit>,
+    count: u32,
+) -> bool {
+    match (database.as_mut(), self::values(values, count)) {
+        (Some(database), Some(values)) => database
+            .discrete_input
+            .update_all(values.iter().map(|x| (x.index, x.value))),
+        _ => false,
+    }
+}
+
+pub unsafe fn database_update_holding_register_values(
+    database: *mut crate::Database,
+    values: Option<&crate::ffi::Register>,
+    count: u32,
+) -> bool {
+    match (database.as_mut(), self::values(values, count)) {
+        (Some(database), Some(values)) => database
+            .holding_registers
+            .update_all(values.iter().map(|x| (x.index, x.value))),
+        _ => false,
+    }
+}
+
+pub unsafe fn database_update_input_register_values(
+    database: *mut crate::Database,
+    values: Option<&crate::ffi::Register>,
+    count: u32,
+) -> bool {
+    match (database.as_mut(), self::values(values, count)) {
+        (Some(database), Some(values)) => database
+            .input_registers
+            .update_all(values.iter().map(|x| (x.index, x.value))),
+        _ => false,
     }
 }
 
 pub unsafe fn database_delete_coil(database: *mut crate::Database, index: u16) -> bool {
     match database.as_mut() {
         None => false,
-        Some(database) => database.coils.remove(&index).is_some(),
+        Some(database) => database.coils.remove(index),
     }
 }
 
 pub unsafe fn database_delete_discrete_input(database: *mut crate::Database, index: u16) -> bool {
     match database.as_mut() {
         None => false,
-        Some(database) => database.discrete_input.remove(&index).is_some(),
+        Some(database) => database.discrete_input.remove(index),
     }
 }
 
 pub unsafe fn database_delete_holding_register(database: *mut crate::Database, index: u16) -> bool {
     match database.as_mut() {
         None => false,
-        Some(database) => database.holding_registers.remove(&index).is_some(),
+        Some(database) => database.holding_registers.remove(index),
     }
 }
 
 pub unsafe fn database_delete_input_register(database: *mut crate::Database, index: u16) -> bool {
     match database.as_mut() {
         None => false,
-        Some(database) => database.input_registers.remove(&index).is_some(),
+        Some(database) => database.input_registers.remove(index),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn segments(map: &PointMap<u16>) -> Vec<(u16, Vec<u16>)> {
+        map.segments
+            .iter()
+            .map(|x| (x.start, x.values.clone()))
+            .collect()
+    }
+
+    #[test]
+    fn adjacent_points_are_merged_into_one_segment() {
+        let mut map = PointMap::new();
+        assert!(map.add(3, 3));
+        assert!(map.add(1, 1));
+        assert!(map.add(5, 5));
+        assert!(map.add(2, 2));
+        assert!(!map.add(2, 7));
+        assert_eq!(segments(&map), vec![(1, vec![1, 2, 3]), (5, vec![5])]);
+        assert!(map.add(4, 4));
+        assert_eq!(segments(&map), vec![(1, vec![1, 2, 3, 4, 5])]);
+        assert_eq!(map.get_range(2..5), Some([2u16, 3, 4].as_ref()));
+    }
+
+    #[test]
+    fn removing_a_point_splits_the_segment() {
+        let mut map = PointMap::new();
+        for i in 0..5 {
+            map.add(i, i);
+        }
+        assert!(map.remove(2));
+        assert!(!map.remove(2));
+        assert_eq!(segments(&map), vec![(0, vec![0, 1]), (3, vec![3, 4])]);
+        assert_eq!(map.get(2), None);
+        assert_eq!(map.get_range(1..4), None);
+        assert!(map.update(4, 42));
+        assert!(!map.update(2, 42));
+        assert_eq!(map.get(4), Some(&42));
+    }
+
+    #[test]
+    fn range_updates_are_all_or_nothing() {
+        let mut map = PointMap::new();
+        for i in 0..3 {
+            map.add(i, 0u16);
+        }
+        map.add(4, 0);
+        assert!(map.update_range(1, &[1, 2]));
+        assert!(!map.update_range(2, &[7, 7, 7]));
+        assert!(!map.update_range(0, &[]));
+        assert_eq!(segments(&map), vec![(0, vec![0, 1, 2]), (4, vec![0])]);
+    }
+
+    #[test]
+    fn updates_from_pairs_are_all_or_nothing() {
+        let mut map = PointMap::new();
+        for i in 0..3 {
+            map.add(i, 0u16);
+        }
+        map.add(7, 0);
+        let pairs = [(7, 1), (0, 2)];
+        assert!(map.update_all(pairs.iter().copied()));
+        let pairs = [(1, 3), (5, 3)];
+        assert!(!map.update_all(pairs.iter().copied()));
+        assert_eq!(segments(&map), vec![(0, vec![2, 0, 0]), (7, vec![1])]);
+    }
+
+    #[test]
+    fn handles_the_maximum_address() {
+        let mut map = PointMap::new();
+        assert!(map.add(u16::MAX, 1));
+        assert!(map.add(u16::MAX - 1, 2));
+        assert_eq!(
+            map.get_range((u16::MAX - 1) as usize..(u16::MAX as usize) + 1),
+            Some([2u16, 1].as_ref())
+        );
+        assert!(map.remove(u16::MAX));
+        assert_eq!(map.get(u16::MAX), None);
     }
 }
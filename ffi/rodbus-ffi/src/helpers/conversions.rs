@@ -41,6 +41,9 @@ impl From<rodbus::error::Error> for crate::ffi::ErrorInfo {
             rodbus::error::Error::Exception(ex) => ex.into(),
             rodbus::error::Error::Io(_) => from_status(crate::ffi::Status::IOError),
             rodbus::error::Error::BadResponse(_) => from_status(crate::ffi::Status::BadResponse),
+            rodbus::error::Error::UnitUnavailable => {
+                from_status(crate::ffi::Status::UnitUnavailable)
+            }
         }
     }
 }
@@ -108,3 +111,65 @@ impl std::convert::From<crate::ffi::Register> for rodbus::types::Indexed<u16> {
         rodbus::types::Indexed::new(x.index, x.value)
     }
 }
+
+fn to_micros(value: Option<std::time::Duration>) -> u64 {
+    value.map(|x| x.as_micros() as u64).unwrap_or(0)
+}
+
+impl std::convert::From<rodbus::metrics::ChannelMetrics> for crate::ffi::ChannelMetrics {
+    fn from(x: rodbus::metrics::ChannelMetrics) -> Self {
+        Self {
+            requests_sent: x.requests_sent,
+            responses_received: x.responses_received,
+            timeouts: x.timeouts,
+            exceptions: x.exceptions.total(),
+            tx_id_mismatches: x.tx_id_mismatches,
+            connects: x.connects,
+            connect_failures: x.connect_failures,
+            bytes_sent: x.bytes_sent,
+            bytes_received: x.bytes_received,
+            latency_mean_us: to_micros(x.response_latency.mean()),
+            latency_p50_us: to_micros(x.response_latency.percentile(50.0)),
+            latency_p99_us: to_micros(x.response_latency.percentile(99.0)),
+        }
+    }
+}
+
+impl std::convert::From<rodbus::metrics::ServerMetrics> for crate::ffi::ServerMetrics {
+    fn from(x: rodbus::metrics::ServerMetrics) -> Self {
+        Self {
+            active_sessions: x.active_sessions as u32,
+            sessions_accepted: x.sessions_accepted,
+            sessions_evicted: x.sessions_evicted,
+            requests_received: x.requests_received,
+            exceptions: x.exceptions.total(),
+            bytes_received: x.bytes_received,
+            bytes_sent: x.bytes_sent,
+            lock_wait_mean_us: to_micros(x.handler_lock_wait.mean()),
+            lock_wait_p99_us: to_micros(x.handler_lock_wait.percentile(99.0)),
+        }
+    }
+}
+
+impl std::convert::From<crate::ffi::SocketOptions> for rodbus::socket::SocketOptions {
+    fn from(x: crate::ffi::SocketOptions) -> Self {
+        // 0 selects the default of each setting
+        fn size(value: u32) -> Option<usize> {
+            match value {
+                0 => None,
+                x => Some(x as usize),
+            }
+        }
+
+        Self {
+            no_delay: x.no_delay,
+            recv_buffer_size: size(x.recv_buffer_size),
+            send_buffer_size: size(x.send_buffer_size),
+            keep_alive: match x.keep_alive_ms {
+                0 => None,
+                ms => Some(std::time::Duration::from_millis(ms as u64)),
+            },
+            read_buffer_size: size(x.read_buffer_size),
+        }
+    }
+}
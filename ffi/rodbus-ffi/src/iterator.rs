@@ -1,10 +1,141 @@
+enum Bits<'a> {
+    Range(rodbus::types::BitIterator<'a>),
+    // only the values of a poll that changed
+    Changes(std::slice::Iter<'a, rodbus::types::Indexed<bool>>),
+}
+
+impl<'a> Bits<'a> {
+    fn next(&mut self) -> Option<rodbus::types::Indexed<bool>> {
+        match self {
+            Bits::Range(x) => x.next(),
+            Bits::Changes(x) => x.next().copied(),
+        }
+    }
+
+    fn len(&self) -> usize {
+        match self {
+            Bits::Range(x) => x.len(),
+            Bits::Changes(x) => x.len(),
+        }
+    }
+
+    fn copy_to(&mut self, output: &mut [crate::ffi::Bit]) -> usize {
+        let set = |dest: &mut crate::ffi::Bit, index, value| {
+            dest.index = index;
+            dest.value = value;
+        };
+        match self {
+            Bits::Range(x) => {
+                let first = x.clone().next().map(|x| x.index);
+                copy_range(first, output, |values| x.copy_to(values), set)
+            }
+            Bits::Changes(x) => copy_changes(x, output, set),
+        }
+    }
+}
+
+enum Registers<'a> {
+    Range(rodbus::types::RegisterIterator<'a>),
+    // only the values of a poll that changed
+    Changes(std::slice::Iter<'a, rodbus::types::Indexed<u16>>),
+}
+
+impl<'a> Registers<'a> {
+    fn next(&mut self) -> Option<rodbus::types::Indexed<u16>> {
+        match self {
+            Registers::Range(x) => x.next(),
+            Registers::Changes(x) => x.next().copied(),
+        }
+    }
+
+    fn len(&self) -> usize {
+        match self {
+            Registers::Range(x) => x.len(),
+            Registers::Changes(x) => x.len(),
+        }
+    }
+
+    fn copy_to(&mut self, output: &mut [crate::ffi::Register]) -> usize {
+        let set = |dest: &mut crate::ffi::Register, index, value| {
+            dest.index = index;
+            dest.value = value;
+        };
+        match self {
+            Registers::Range(x) => {
+                let first = x.clone().next().map(|x| x.index);
+                copy_range(first, output, |values| x.copy_to(values), set)
+            }
+            Registers::Changes(x) => copy_changes(x, output, set),
+        }
+    }
+}
+
+// values are unpacked onto the stack in chunks of this size before being written out as
+// index/value pairs
+const CHUNK_SIZE: usize = 256;
+
+fn copy_range<T: Copy + Default, U>(
+    first: Option<u16>,
+    output: &mut [U],
+    mut copy: impl FnMut(&mut [T]) -> usize,
+    set: impl Fn(&mut U, u16, T),
+) -> usize {
+    let mut index = match first {
+        Some(x) => x,
+        None => return 0,
+    };
+    let mut values = [T::default(); CHUNK_SIZE];
+    let mut count = 0;
+    for dest in output.chunks_mut(CHUNK_SIZE) {
+        let num = copy(&mut values[..dest.len()]);
+        for (dest, value) in dest.iter_mut().zip(&values[..num]) {
+            set(dest, index, *value);
+            index = index.wrapping_add(1);
+        }
+        count += num;
+        if num < dest.len() {
+            break;
+        }
+    }
+    count
+}
+
+fn copy_changes<T: Copy, U>(
+    changes: &mut std::slice::Iter<rodbus::types::Indexed<T>>,
+    output: &mut [U],
+    set: impl Fn(&mut U, u16, T),
+) -> usize {
+    let mut count = 0;
+    for (dest, x) in output.iter_mut().zip(changes) {
+        set(dest, x.index, x.value);
+        count += 1;
+    }
+    count
+}
+
+/// the caller supplied array of values, None if the pointer is NULL
+///
+/// the generated bindings pass the array as a pointer to its first element
+unsafe fn output<'a, T>(first: Option<&'a T>, capacity: u32) -> Option<&'a mut [T]> {
+    let first = first? as *const T as *mut T;
+    Some(std::slice::from_raw_parts_mut(first, capacity as usize))
+}
+
 pub struct BitIterator<'a> {
-    inner: rodbus::types::BitIterator<'a>,
+    inner: Bits<'a>,
     current: crate::ffi::Bit,
 }
 
 impl<'a> BitIterator<'a> {
     pub(crate) fn new(inner: rodbus::types::BitIterator<'a>) -> Self {
+        Self::create(Bits::Range(inner))
+    }
+
+    pub(crate) fn changes(changes: &'a [rodbus::types::Indexed<bool>]) -> Self {
+        Self::create(Bits::Changes(changes.iter()))
+    }
+
+    fn create(inner: Bits<'a>) -> Self {
         Self {
             inner,
             current: crate::ffi::Bit {
@@ -16,12 +147,20 @@ impl<'a> BitIterator<'a> {
 }
 
 pub struct RegisterIterator<'a> {
-    inner: rodbus::types::RegisterIterator<'a>,
+    inner: Registers<'a>,
     current: crate::ffi::Register,
 }
 
 impl<'a> RegisterIterator<'a> {
     pub(crate) fn new(inner: rodbus::types::RegisterIterator<'a>) -> Self {
+        Self::create(Registers::Range(inner))
+    }
+
+    pub(crate) fn changes(changes: &'a [rodbus::types::Indexed<u16>]) -> Self {
+        Self::create(Registers::Changes(changes.iter()))
+    }
+
+    fn create(inner: Registers<'a>) -> Self {
         Self {
             inner,
             current: crate::ffi::Register { index: 0, value: 0 },
@@ -58,3 +197,39 @@ pub(crate) unsafe fn next_register(
         None => None,
     }
 }
+
+pub(crate) unsafe fn bit_iterator_remaining(it: *mut crate::BitIterator) -> u32 {
+    match it.as_ref() {
+        Some(it) => it.inner.len() as u32,
+        None => 0,
+    }
+}
+
+pub(crate) unsafe fn register_iterator_remaining(it: *mut crate::RegisterIterator) -> u32 {
+    match it.as_ref() {
+        Some(it) => it.inner.len() as u32,
+        None => 0,
+    }
+}
+
+pub(crate) unsafe fn bit_iterator_copy(
+    it: *mut crate::BitIterator,
+    buffer: Option<&crate::ffi::Bit>,
+    capacity: u32,
+) -> u32 {
+    match (it.as_mut(), output(buffer, capacity)) {
+        (Some(it), Some(buffer)) => it.inner.copy_to(buffer) as u32,
+        _ => 0,
+    }
+}
+
+pub(crate) unsafe fn register_iterator_copy(
+    it: *mut crate::RegisterIterator,
+    buffer: Option<&crate::ffi::Register>,
+    capacity: u32,
+) -> u32 {
+    match (it.as_mut(), output(buffer, capacity)) {
+        (Some(it), Some(buffer)) => it.inner.copy_to(buffer) as u32,
+        _ => 0,
+    }
+}
@@ -5,6 +5,7 @@ mod database;
 mod iterator;
 mod list;
 mod logging;
+mod poll;
 mod runtime;
 mod server;
 
@@ -22,6 +23,7 @@ pub use database::*;
 pub use iterator::*;
 pub use list::*;
 pub(crate) use logging::*;
+pub use poll::*;
 pub use runtime::*;
 pub use server::*;
 
@@ -35,6 +35,17 @@ impl Log for LoggerAdapter {
     fn flush(&self) {}
 }
 
+impl std::convert::From<crate::ffi::DecodeLevel> for rodbus::decode::DecodeLevel {
+    fn from(x: crate::ffi::DecodeLevel) -> Self {
+        match x {
+            crate::ffi::DecodeLevel::Nothing => rodbus::decode::DecodeLevel::Nothing,
+            crate::ffi::DecodeLevel::Header => rodbus::decode::DecodeLevel::Header,
+            crate::ffi::DecodeLevel::Function => rodbus::decode::DecodeLevel::Function,
+            crate::ffi::DecodeLevel::Payload => rodbus::decode::DecodeLevel::Payload,
+        }
+    }
+}
+
 impl std::convert::From<crate::ffi::LogLevel> for log::LevelFilter {
     fn from(x: crate::ffi::LogLevel) -> Self {
         match x {
@@ -0,0 +1,157 @@
+use rodbus::client::poll::{Poll, PollHandle, PollKind};
+use rodbus::types::{AddressRange, UnitId};
+use std::ptr::null_mut;
+use std::time::Duration;
+
+pub struct PollList {
+    pub(crate) inner: Vec<crate::ffi::Poll>,
+}
+
+pub(crate) unsafe fn poll_list_create(size_hint: u32) -> *mut crate::PollList {
+    Box::into_raw(Box::new(PollList {
+        inner: Vec::with_capacity(size_hint as usize),
+    }))
+}
+
+pub(crate) unsafe fn poll_list_destroy(list: *mut crate::PollList) {
+    if !list.is_null() {
+        Box::from_raw(list);
+    }
+}
+
+pub(crate) unsafe fn poll_list_add(list: *mut crate::PollList, item: crate::ffi::Poll) {
+    if let Some(list) = list.as_mut() {
+        list.inner.push(item)
+    }
+}
+
+pub struct PollTask {
+    _handle: PollHandle,
+}
+
+struct PollHandlerAdapter {
+    handler: crate::ffi::PollHandler,
+}
+
+impl rodbus::client::poll::PollHandler for PollHandlerAdapter {
+    fn on_bits(
+        &self,
+        index: usize,
+        result: std::result::Result<rodbus::types::BitIterator, rodbus::error::Error>,
+    ) {
+        match result {
+            Err(err) => self.handler.on_bits(index as u32, err.into()),
+            Ok(values) => {
+                let mut iter = crate::BitIterator::new(values);
+
+                let result = crate::ffi::BitReadResult {
+                    result: crate::ffi::ErrorInfo::success(),
+                    iterator: &mut iter as *mut crate::BitIterator,
+                };
+
+                self.handler.on_bits(index as u32, result);
+            }
+        }
+    }
+
+    fn on_registers(
+        &self,
+        index: usize,
+        result: std::result::Result<rodbus::types::RegisterIterator, rodbus::error::Error>,
+    ) {
+        match result {
+            Err(err) => self.handler.on_registers(index as u32, err.into()),
+            Ok(values) => {
+                let mut iter = crate::RegisterIterator::new(values);
+
+                let result = crate::ffi::RegisterReadResult {
+                    result: crate::ffi::ErrorInfo::success(),
+                    iterator: &mut iter as *mut crate::RegisterIterator,
+                };
+
+                self.handler.on_registers(index as u32, result);
+            }
+        }
+    }
+
+    fn on_bit_changes(&self, index: usize, changes: &[rodbus::types::Indexed<bool>]) {
+        let mut iter = crate::BitIterator::changes(changes);
+        self.handler
+            .on_bit_changes(index as u32, &mut iter as *mut crate::BitIterator);
+    }
+
+    fn on_register_changes(&self, index: usize, changes: &[rodbus::types::Indexed<u16>]) {
+        let mut iter = crate::RegisterIterator::changes(changes);
+        self.handler
+            .on_register_changes(index as u32, &mut iter as *mut crate::RegisterIterator);
+    }
+}
+
+pub(crate) unsafe fn channel_start_polls(
+    channel: *mut crate::Channel,
+    polls: *mut crate::PollList,
+    timeout_ms: u32,
+    handler: crate::ffi::PollHandler,
+) -> *mut crate::PollTask {
+    let channel = match channel.as_ref() {
+        Some(x) => x,
+        None => {
+            log::error!("channel may not be NULL");
+            return null_mut();
+        }
+    };
+
+    let polls = match polls.as_ref() {
+        Some(x) => x,
+        None => {
+            log::error!("poll list may not be NULL");
+            return null_mut();
+        }
+    };
+
+    let mut definitions = Vec::with_capacity(polls.inner.len());
+    for poll in polls.inner.iter() {
+        let range = match AddressRange::try_from(poll.range.start, poll.range.count) {
+            Err(err) => {
+                log::error!("Invalid address range: {}", err);
+                return null_mut();
+            }
+            Ok(range) => range,
+        };
+
+        let kind = match poll.kind {
+            crate::ffi::PollKind::ReadCoils => PollKind::ReadCoils,
+            crate::ffi::PollKind::ReadDiscreteInputs => PollKind::ReadDiscreteInputs,
+            crate::ffi::PollKind::ReadHoldingRegisters => PollKind::ReadHoldingRegisters,
+            crate::ffi::PollKind::ReadInputRegisters => PollKind::ReadInputRegisters,
+        };
+
+        let mut definition = Poll::new(
+            UnitId::new(poll.unit_id),
+            kind,
+            range,
+            Duration::from_millis(poll.period_ms as u64),
+        );
+        if poll.integrity_period_ms != 0 {
+            definition =
+                definition.report_changes(Duration::from_millis(poll.integrity_period_ms as u64));
+        }
+        definitions.push(definition);
+    }
+
+    let (handle, task) = channel.inner.create_poll_task(
+        definitions,
+        Duration::from_millis(timeout_ms as u64),
+        PollHandlerAdapter { handler },
+    );
+
+    channel.runtime.spawn(task);
+
+    Box::into_raw(Box::new(PollTask { _handle: handle }))
+}
+
+pub(crate) unsafe fn destroy_poll_task(task: *mut crate::PollTask) {
+    if !task.is_null() {
+        Box::from_raw(task);
+    }
+}
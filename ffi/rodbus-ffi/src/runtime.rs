@@ -1,16 +1,93 @@
+#[cfg(feature = "affinity")]
+use std::sync::atomic::{AtomicUsize, Ordering};
+
 pub use tokio::runtime::Runtime;
 
+// cores of the mask that the core threads of a runtime are pinned to, each thread takes the
+// next one
+#[cfg(feature = "affinity")]
+struct Affinity {
+    cores: Vec<core_affinity::CoreId>,
+    core_threads: usize,
+    // number of threads started so far
+    started: AtomicUsize,
+}
+
+#[cfg(feature = "affinity")]
+impl Affinity {
+    fn from_mask(mask: u64, core_threads: usize) -> Option<Self> {
+        let cores: Vec<core_affinity::CoreId> = (0..64usize)
+            .filter(|bit| mask & (1u64 << bit) != 0)
+            .map(|id| core_affinity::CoreId { id })
+            .collect();
+
+        if cores.is_empty() {
+            return None;
+        }
+
+        Some(Self {
+            cores,
+            core_threads,
+            started: AtomicUsize::new(0),
+        })
+    }
+
+    // The start hook runs on blocking threads as well, and there's no way to tell them apart.
+    // The core threads are started when the runtime is built, before any blocking thread, and
+    // don't exit until the runtime does, so only the first threads started are pinned. Blocking
+    // threads are left to the OS so that they don't compete with the workers for those cores.
+    fn pin_current_thread(&self) {
+        let started = self.started.fetch_add(1, Ordering::Relaxed);
+        if started >= self.core_threads {
+            return;
+        }
+        let index = started % self.cores.len();
+        if let Some(core) = self.cores.get(index) {
+            core_affinity::set_for_current(*core);
+        }
+    }
+}
+
+#[cfg(feature = "affinity")]
+fn set_affinity(builder: &mut tokio::runtime::Builder, mask: u64, core_threads: usize) {
+    if let Some(affinity) = Affinity::from_mask(mask, core_threads) {
+        builder.on_thread_start(move || affinity.pin_current_thread());
+    }
+}
+
+#[cfg(not(feature = "affinity"))]
+fn set_affinity(_builder: &mut tokio::runtime::Builder, mask: u64, _core_threads: usize) {
+    if mask != 0 {
+        log::warn!("affinity mask ignored, the library was built without the affinity feature");
+    }
+}
+
 pub(crate) unsafe fn runtime_new(
     config: Option<&crate::ffi::RuntimeConfig>,
 ) -> *mut tokio::runtime::Runtime {
     let mut builder = tokio::runtime::Builder::new();
 
-    builder.enable_all().threaded_scheduler();
+    builder
+        .enable_all()
+        .threaded_scheduler()
+        .thread_name("rodbus-runtime");
 
-    if let Some(x) = config.as_ref() {
-        if x.num_core_threads > 0 {
-            builder.core_threads(x.num_core_threads as usize);
+    if let Some(x) = config {
+        // a basic scheduler would only run tasks while a thread blocks on the runtime, which
+        // bindings never do, so single threaded mode is a pool with a single worker
+        let core_threads = if x.single_threaded {
+            1
+        } else if x.num_core_threads > 0 {
+            x.num_core_threads as usize
+        } else {
+            num_cpus::get()
+        };
+        builder.core_threads(core_threads);
+        if x.max_blocking_threads > 0 {
+            // the limit includes the core threads
+            builder.max_threads(core_threads + x.max_blocking_threads as usize);
         }
+        set_affinity(&mut builder, x.affinity_mask, core_threads);
     }
 
     match builder.build() {
@@ -2,14 +2,19 @@ use crate::Database;
 use rodbus::error::details::ExceptionCode;
 use rodbus::server::handler::{RequestHandler, ServerHandlerMap};
 use rodbus::shutdown::TaskHandle;
-use rodbus::types::{Indexed, UnitId, WriteCoils, WriteRegisters};
+use rodbus::types::{AddressRange, Indexed, UnitId, WriteCoils, WriteRegisters};
 use std::collections::HashMap;
 use std::ptr::null_mut;
 use tokio::net::TcpListener;
 
+// the database is versioned, so the replies to repeated polls of the same range are reused
+const RESPONSE_CACHE_SIZE: usize = 32;
+
 struct RequestHandlerWrapper {
     database: Database,
     write_handler: crate::ffi::WriteHandler,
+    // incremented whenever the database may have been modified
+    version: u64,
 }
 
 impl RequestHandlerWrapper {
@@ -17,8 +22,14 @@ impl RequestHandlerWrapper {
         Self {
             database: Database::new(),
             write_handler: handler,
+            version: 0,
         }
     }
+
+    // write callbacks get mutable access to the database even if they fail
+    fn modified(&mut self) {
+        self.version = self.version.wrapping_add(1);
+    }
 }
 
 pub struct DeviceMap {
@@ -37,36 +48,95 @@ impl DeviceMap {
     }
 }
 
+fn copy_range<T>(values: Option<&[T]>, output: &mut [T]) -> Result<(), ExceptionCode>
+where
+    T: Copy,
+{
+    match values {
+        Some(values) => {
+            output.copy_from_slice(values);
+            Ok(())
+        }
+        None => Err(ExceptionCode::IllegalDataAddress),
+    }
+}
+
 impl RequestHandler for RequestHandlerWrapper {
+    fn version(&self) -> Option<u64> {
+        Some(self.version)
+    }
+
     fn read_coil(&self, address: u16) -> Result<bool, ExceptionCode> {
-        match self.database.coils.get(&address) {
+        match self.database.coils.get(address) {
             Some(x) => Ok(*x),
             None => Err(ExceptionCode::IllegalDataAddress),
         }
     }
 
     fn read_discrete_input(&self, address: u16) -> Result<bool, ExceptionCode> {
-        match self.database.discrete_input.get(&address) {
+        match self.database.discrete_input.get(address) {
             Some(x) => Ok(*x),
             None => Err(ExceptionCode::IllegalDataAddress),
         }
     }
 
     fn read_holding_register(&self, address: u16) -> Result<u16, ExceptionCode> {
-        match self.database.holding_registers.get(&address) {
+        match self.database.holding_registers.get(address) {
             Some(x) => Ok(*x),
             None => Err(ExceptionCode::IllegalDataAddress),
         }
     }
 
     fn read_input_register(&self, address: u16) -> Result<u16, ExceptionCode> {
-        match self.database.input_registers.get(&address) {
+        match self.database.input_registers.get(address) {
             Some(x) => Ok(*x),
             None => Err(ExceptionCode::IllegalDataAddress),
         }
     }
 
+    fn read_coils(&self, range: AddressRange, output: &mut [bool]) -> Result<(), ExceptionCode> {
+        copy_range(self.database.coils.get_range(range.to_std_range()), output)
+    }
+
+    fn read_discrete_inputs(
+        &self,
+        range: AddressRange,
+        output: &mut [bool],
+    ) -> Result<(), ExceptionCode> {
+        copy_range(
+            self.database.discrete_input.get_range(range.to_std_range()),
+            output,
+        )
+    }
+
+    fn read_holding_registers(
+        &self,
+        range: AddressRange,
+        output: &mut [u16],
+    ) -> Result<(), ExceptionCode> {
+        copy_range(
+            self.database
+                .holding_registers
+                .get_range(range.to_std_range()),
+            output,
+        )
+    }
+
+    fn read_input_registers(
+        &self,
+        range: AddressRange,
+        output: &mut [u16],
+    ) -> Result<(), ExceptionCode> {
+        copy_range(
+            self.database
+                .input_registers
+                .get_range(range.to_std_range()),
+            output,
+        )
+    }
+
     fn write_single_coil(&mut self, value: Indexed<bool>) -> Result<(), ExceptionCode> {
+        self.modified();
         match self
             .write_handler
             .write_single_coil(value.value, value.index, &mut self.database)
@@ -83,6 +153,7 @@ impl RequestHandler for RequestHandlerWrapper {
     }
 
     fn write_single_register(&mut self, value: Indexed<u16>) -> Result<(), ExceptionCode> {
+        self.modified();
         match self
             .write_handler
             .write_single_register(value.value, value.index, &mut self.database)
@@ -93,6 +164,7 @@ impl RequestHandler for RequestHandlerWrapper {
     }
 
     fn write_multiple_coils(&mut self, values: WriteCoils) -> Result<(), ExceptionCode> {
+        self.modified();
         let mut iterator = crate::BitIterator::new(values.iterator);
 
         match self.write_handler.write_multiple_coils(
@@ -106,6 +178,7 @@ impl RequestHandler for RequestHandlerWrapper {
     }
 
     fn write_multiple_registers(&mut self, values: WriteRegisters) -> Result<(), ExceptionCode> {
+        self.modified();
         let mut iterator = crate::RegisterIterator::new(values.iterator);
 
         match self.write_handler.write_multiple_registers(
@@ -124,6 +197,7 @@ pub struct Server {
     // never used but we have to hang onto it otherwise the server shuts down
     _server: rodbus::shutdown::TaskHandle,
     map: ServerHandlerMap<RequestHandlerWrapper>,
+    metrics: rodbus::server::ServerMetricsHandle,
 }
 
 pub(crate) unsafe fn create_device_map() -> *mut DeviceMap {
@@ -167,6 +241,8 @@ pub(crate) unsafe fn create_tcp_server(
     address: &std::ffi::CStr,
     max_sessions: u16,
     endpoints: *mut crate::DeviceMap,
+    decode_level: crate::ffi::DecodeLevel,
+    socket_options: crate::ffi::SocketOptions,
 ) -> *mut crate::Server {
     let runtime = match runtime.as_mut() {
         Some(x) => x,
@@ -201,11 +277,16 @@ pub(crate) unsafe fn create_tcp_server(
     let (tx, rx) = tokio::sync::mpsc::channel(1);
 
     let handler_map = endpoints.drain_and_convert();
-    let task = rodbus::server::create_tcp_server_task(
+    let (metrics, task) = rodbus::server::create_tcp_server_task_with_handlers(
         rx,
         max_sessions as usize,
         listener,
-        handler_map.clone(),
+        rodbus::server::handler::ServerHandlers::new(handler_map.clone()),
+        rodbus::server::ServerOptions {
+            decode: decode_level.into(),
+            socket: socket_options.into(),
+            response_cache_size: RESPONSE_CACHE_SIZE,
+        },
     );
     let join_handle = runtime.spawn(task);
 
@@ -213,6 +294,7 @@ pub(crate) unsafe fn create_tcp_server(
         _server: TaskHandle::new(tx, join_handle),
         runtime: runtime.handle().clone(),
         map: handler_map,
+        metrics,
     };
 
     Box::into_raw(Box::new(server_handle))
@@ -224,6 +306,16 @@ pub(crate) unsafe fn destroy_server(server: *mut crate::Server) {
     }
 }
 
+pub(crate) unsafe fn server_get_metrics(server: *mut crate::Server) -> crate::ffi::ServerMetrics {
+    match server.as_ref() {
+        Some(x) => x.metrics.get().into(),
+        None => {
+            log::error!("server may not be NULL");
+            rodbus::metrics::ServerMetrics::default().into()
+        }
+    }
+}
+
 pub(crate) unsafe fn server_update_database(
     server: *mut crate::Server,
     unit_id: u8,
@@ -242,6 +334,7 @@ pub(crate) unsafe fn server_update_database(
     let transaction = async {
         let mut lock = handler.lock().await;
         transaction.callback(&mut lock.database);
+        lock.modified();
     };
 
     server.runtime.block_on(transaction);
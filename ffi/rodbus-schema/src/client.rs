@@ -27,6 +27,16 @@ pub(crate) fn build(
             Type::Uint16,
             "Maximum number of requests to queue before failing the next request",
         )?
+        .param(
+            "decode_level",
+            Type::Enum(common.decode_level.clone()),
+            "level of detail used when logging the frames sent and received on the channel",
+        )?
+        .param(
+            "socket_options",
+            Type::Struct(common.socket_options.clone()),
+            "settings applied to the socket of each connection",
+        )?
         .return_type(ReturnType::Type(
             Type::ClassRef(channel.clone()),
             "pointer to the created channel or NULL if an error occurred".into(),
@@ -46,8 +56,41 @@ pub(crate) fn build(
         .doc("destroy a channel instance")?
         .build()?;
 
-    let bit_read_callback = build_bit_read_callback(lib, common)?;
-    let register_read_callback = build_register_read_callback(lib, common)?;
+    let channel_metrics = build_channel_metrics(lib)?;
+
+    let get_metrics_fn = lib
+        .declare_native_function("channel_get_metrics")?
+        .param(
+            "channel",
+            Type::ClassRef(channel.clone()),
+            "channel from which to retrieve the metrics",
+        )?
+        .return_type(ReturnType::Type(
+            Type::Struct(channel_metrics),
+            "snapshot of the channel's counters".into(),
+        ))?
+        .doc("take a snapshot of the counters maintained by the channel without blocking it")?
+        .build()?;
+
+    let bit_read_result =
+        build_callback_struct(lib, &common.bit, &common.bit_iterator, &common.error_info)?;
+    let register_read_result = build_callback_struct(
+        lib,
+        &common.register,
+        &common.register_iterator,
+        &common.error_info,
+    )?;
+
+    let bit_read_callback = build_bit_read_callback(lib, &bit_read_result)?;
+    let register_read_callback = build_register_read_callback(lib, &register_read_result)?;
+
+    let start_polls_fn = build_start_polls_fn(
+        lib,
+        common,
+        &channel,
+        &bit_read_result,
+        &register_read_result,
+    )?;
     let result_only_callback = build_result_only_callback(lib, common)?;
 
     let read_coils_fn = build_async_read_fn(
@@ -106,7 +149,7 @@ pub(crate) fn build(
         "write a single register",
     )?;
 
-    let list_of_bit = build_list(lib, "Bit", Type::Bool)?;
+    let list_of_bit = common.bit_list.clone();
     let write_multiple_coils_fn = build_async_write_multiple_fn(
         "channel_write_multiple_coils_async",
         lib,
@@ -117,7 +160,7 @@ pub(crate) fn build(
         "write multiple coils",
     )?;
 
-    let list_of_register = build_list(lib, "Register", Type::Uint16)?;
+    let list_of_register = common.register_list.clone();
     let write_multiple_registers_fn = build_async_write_multiple_fn(
         "channel_write_multiple_registers_async",
         lib,
@@ -128,6 +171,38 @@ pub(crate) fn build(
         "write multiple registers",
     )?;
 
+    let read_write_multiple_registers_fn = lib
+        .declare_native_function("channel_read_write_multiple_registers_async")?
+        .param(
+            "channel",
+            Type::ClassRef(channel.clone()),
+            "channel on which to perform the request",
+        )?
+        .param(
+            "range",
+            Type::Struct(common.address_range.clone()),
+            "range of holding registers to read once the write is complete",
+        )?
+        .param("start", Type::Uint16, "Starting address of the write")?
+        .param(
+            "items",
+            Type::Collection(list_of_register.clone()),
+            "list of registers to write",
+        )?
+        .param(
+            "param",
+            Type::Struct(common.request_param.clone()),
+            "parameters for the request",
+        )?
+        .param(
+            "callback",
+            Type::OneTimeCallback(register_read_callback.clone()),
+            "callback invoked on completion",
+        )?
+        .return_type(ReturnType::void())?
+        .doc("write multiple registers and then read holding registers in a single request")?
+        .build()?;
+
     lib.define_class(&channel)?
         // abstract factory methods, later we'll have TLS/serial
         .static_method("create_tcp_client", &create_tcp_client_fn)?
@@ -141,6 +216,14 @@ pub(crate) fn build(
         .async_method("write_single_register", &write_single_register_fn)?
         .async_method("write_multiple_coils", &write_multiple_coils_fn)?
         .async_method("write_multiple_registers", &write_multiple_registers_fn)?
+        .async_method(
+            "read_write_multiple_registers",
+            &read_write_multiple_registers_fn,
+        )?
+        // polling
+        .method("start_polls", &start_polls_fn)?
+        // metrics
+        .method("get_metrics", &get_metrics_fn)?
         // destructor
         .destructor(&destroy_channel_fn)?
         .doc("Abstract representation of a channel")?
@@ -149,6 +232,69 @@ pub(crate) fn build(
     Ok(())
 }
 
+fn build_channel_metrics(lib: &mut LibraryBuilder) -> Result<NativeStructHandle, BindingError> {
+    let metrics = lib.declare_native_struct("ChannelMetrics")?;
+    lib.define_native_struct(&metrics)?
+        .add(
+            "requests_sent",
+            Type::Uint64,
+            "Number of requests written to the connection",
+        )?
+        .add(
+            "responses_received",
+            Type::Uint64,
+            "Number of responses that matched an outstanding request",
+        )?
+        .add(
+            "timeouts",
+            Type::Uint64,
+            "Number of requests that didn't receive a response before their timeout expired",
+        )?
+        .add(
+            "exceptions",
+            Type::Uint64,
+            "Number of exception responses received",
+        )?
+        .add(
+            "tx_id_mismatches",
+            Type::Uint64,
+            "Number of responses whose transaction id didn't match any outstanding request",
+        )?
+        .add("connects", Type::Uint64, "Number of successful connections")?
+        .add(
+            "connect_failures",
+            Type::Uint64,
+            "Number of failed connection attempts",
+        )?
+        .add(
+            "bytes_sent",
+            Type::Uint64,
+            "Number of bytes written to the connection",
+        )?
+        .add(
+            "bytes_received",
+            Type::Uint64,
+            "Number of bytes received in complete frames",
+        )?
+        .add(
+            "latency_mean_us",
+            Type::Uint64,
+            "Mean response latency in microseconds, 0 if no responses were received",
+        )?
+        .add(
+            "latency_p50_us",
+            Type::Uint64,
+            "Upper bound of the histogram bucket containing the median response latency in microseconds",
+        )?
+        .add(
+            "latency_p99_us",
+            Type::Uint64,
+            "Upper bound of the histogram bucket containing the 99th percentile response latency in microseconds",
+        )?
+        .doc("Snapshot of the counters maintained by a channel")?
+        .build()
+}
+
 fn build_async_write_single_fn(
     name: &str,
     lib: &mut LibraryBuilder,
@@ -256,10 +402,8 @@ fn build_async_read_fn(
 
 fn build_bit_read_callback(
     lib: &mut LibraryBuilder,
-    common: &CommonDefinitions,
+    bit_read_result: &NativeStructHandle,
 ) -> Result<OneTimeCallbackHandle, BindingError> {
-    let bit_read_result =
-        build_callback_struct(lib, &common.bit, &common.bit_iterator, &common.error_info)?;
     let bit_read_callback = lib
         .define_one_time_callback(
             "BitReadCallback",
@@ -269,7 +413,7 @@ fn build_bit_read_callback(
             "on_complete",
             "Called when the operation is complete or fails",
         )?
-        .param("result", Type::Struct(bit_read_result), "result")?
+        .param("result", Type::Struct(bit_read_result.clone()), "result")?
         .return_type(ReturnType::void())?
         .build()?
         .build()?;
@@ -279,14 +423,8 @@ fn build_bit_read_callback(
 
 fn build_register_read_callback(
     lib: &mut LibraryBuilder,
-    common: &CommonDefinitions,
+    read_result: &NativeStructHandle,
 ) -> Result<OneTimeCallbackHandle, BindingError> {
-    let read_result = build_callback_struct(
-        lib,
-        &common.register,
-        &common.register_iterator,
-        &common.error_info,
-    )?;
     let read_callback = lib
         .define_one_time_callback(
             "RegisterReadCallback",
@@ -296,7 +434,7 @@ fn build_register_read_callback(
             "on_complete",
             "Called when the operation is complete or fails",
         )?
-        .param("result", Type::Struct(read_result), "result")?
+        .param("result", Type::Struct(read_result.clone()), "result")?
         .return_type(ReturnType::void())?
         .build()?
         .build()?;
@@ -304,6 +442,154 @@ fn build_register_read_callback(
     Ok(read_callback)
 }
 
+fn build_start_polls_fn(
+    lib: &mut LibraryBuilder,
+    common: &CommonDefinitions,
+    channel: &ClassDeclarationHandle,
+    bit_read_result: &NativeStructHandle,
+    register_read_result: &NativeStructHandle,
+) -> Result<NativeFunctionHandle, BindingError> {
+    let poll_kind = lib
+        .define_native_enum("PollKind")?
+        .variant("ReadCoils", 0, "read a range of coils")?
+        .variant("ReadDiscreteInputs", 1, "read a range of discrete inputs")?
+        .variant(
+            "ReadHoldingRegisters",
+            2,
+            "read a range of holding registers",
+        )?
+        .variant("ReadInputRegisters", 3, "read a range of input registers")?
+        .doc("Type of read performed by a poll")?
+        .build()?;
+
+    let poll = lib.declare_native_struct("Poll")?;
+    let poll = lib
+        .define_native_struct(&poll)?
+        .add(
+            "unit_id",
+            Type::Uint8,
+            "Modbus address of the device to read",
+        )?
+        .add("kind", Type::Enum(poll_kind), "type of read to perform")?
+        .add(
+            "range",
+            Type::Struct(common.address_range.clone()),
+            "range of addresses to read",
+        )?
+        .add(
+            "period_ms",
+            Type::Uint32,
+            "time between the start of each read in milliseconds",
+        )?
+        .add(
+            "integrity_period_ms",
+            Type::Uint32,
+            "if non-zero, only the values that changed since the previous response are passed to the on_bit_changes or on_register_changes callback of the handler, and every value is passed to on_bits or on_registers once per integrity period in milliseconds. Failures are always reported. If zero, every response is passed to on_bits or on_registers.",
+        )?
+        .doc("A read that the channel performs periodically")?
+        .build()?;
+
+    let poll_list = crate::common::build_list(lib, "Poll", Type::Struct(poll))?;
+
+    let poll_handler = lib
+        .define_interface(
+            "PollHandler",
+            "Receives the results of the polls. Callbacks are invoked from the channel task and must not block.",
+        )?
+        .callback(
+            "on_bits",
+            "Called when a coil or discrete input poll completes or fails",
+        )?
+        .param("index", Type::Uint32, "index of the poll in the list")?
+        .param("result", Type::Struct(bit_read_result.clone()), "result")?
+        .return_type(ReturnType::void())?
+        .build()?
+        .callback(
+            "on_registers",
+            "Called when a holding or input register poll completes or fails",
+        )?
+        .param("index", Type::Uint32, "index of the poll in the list")?
+        .param(
+            "result",
+            Type::Struct(register_read_result.clone()),
+            "result",
+        )?
+        .return_type(ReturnType::void())?
+        .build()?
+        .callback(
+            "on_bit_changes",
+            "Called when a coil or discrete input poll that reports changes completes and some of the values differ from the previous response. Only the changed values are passed.",
+        )?
+        .param("index", Type::Uint32, "index of the poll in the list")?
+        .param(
+            "changes",
+            Type::Iterator(common.bit_iterator.clone()),
+            "values that changed",
+        )?
+        .return_type(ReturnType::void())?
+        .build()?
+        .callback(
+            "on_register_changes",
+            "Called when a holding or input register poll that reports changes completes and some of the values differ from the previous response. Only the changed values are passed.",
+        )?
+        .param("index", Type::Uint32, "index of the poll in the list")?
+        .param(
+            "changes",
+            Type::Iterator(common.register_iterator.clone()),
+            "values that changed",
+        )?
+        .return_type(ReturnType::void())?
+        .build()?
+        .destroy_callback("on_destroy")?
+        .build()?;
+
+    let poll_task = lib.declare_class("PollTask")?;
+
+    let destroy_poll_task_fn = lib
+        .declare_native_function("destroy_poll_task")?
+        .param(
+            "task",
+            Type::ClassRef(poll_task.clone()),
+            "poll task to stop and destroy",
+        )?
+        .return_type(ReturnType::void())?
+        .doc("stop a poll task and destroy its handle")?
+        .build()?;
+
+    lib.define_class(&poll_task)?
+        .destructor(&destroy_poll_task_fn)?
+        .doc("Handle to a poll task. The polls stop when this handle is destroyed")?
+        .build()?;
+
+    lib.declare_native_function("channel_start_polls")?
+        .param(
+            "channel",
+            Type::ClassRef(channel.clone()),
+            "channel through which to perform the polls",
+        )?
+        .param(
+            "polls",
+            Type::Collection(poll_list),
+            "reads to perform, results are identified by their index in this list",
+        )?
+        .param(
+            "timeout_ms",
+            Type::Uint32,
+            "response timeout applied to every read in milliseconds",
+        )?
+        .param(
+            "handler",
+            Type::Interface(poll_handler),
+            "interface that receives the results",
+        )?
+        .return_type(ReturnType::Type(
+            Type::ClassRef(poll_task),
+            "handle to the poll task or NULL if a poll is invalid".into(),
+        ))?
+        .doc("start performing a table of polls, each one is scheduled by the channel according to its period")?
+        .build()
+}
+
 fn build_result_only_callback(
     lib: &mut LibraryBuilder,
     common: &CommonDefinitions,
@@ -351,50 +637,3 @@ fn build_callback_struct(
 
     Ok(callback_struct)
 }
-
-fn build_list(
-    lib: &mut LibraryBuilder,
-    name: &str,
-    value_type: Type,
-) -> Result<CollectionHandle, BindingError> {
-    let list_class = lib.declare_class(&format!("{}List", name))?;
-
-    let create_fn = lib
-        .declare_native_function(&format!("{}_list_create", name.to_lowercase()))?
-        .param(
-            "size_hint",
-            Type::Uint32,
-            "Starting size of the list. Can be used to avoid multiple allocations if you already know how many items you're going to add.",
-        )?
-        .return_type(ReturnType::new(
-            Type::ClassRef(list_class.clone()),
-            "created list",
-        ))?
-        .doc(format!("create a {} list", name).as_str())?
-        .build()?;
-
-    let destroy_fn = lib
-        .declare_native_function(&format!("{}_list_destroy", name.to_lowercase()))?
-        .param(
-            "list",
-            Type::ClassRef(list_class.clone()),
-            "list to destroy",
-        )?
-        .return_type(ReturnType::void())?
-        .doc(format!("destroy a {} list", name).as_str())?
-        .build()?;
-
-    let add_fn = lib
-        .declare_native_function(&format!("{}_list_add", name.to_lowercase()))?
-        .param(
-            "list",
-            Type::ClassRef(list_class),
-            "list to which to add the item",
-        )?
-        .param("item", value_type, "item to add to the list")?
-        .return_type(ReturnType::void())?
-        .doc("Add an item to the list")?
-        .build()?;
-
-    lib.define_collection(&create_fn, &destroy_fn, &add_fn)
-}
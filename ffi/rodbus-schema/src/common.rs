@@ -1,4 +1,5 @@
 use oo_bindgen::class::ClassHandle;
+use oo_bindgen::collection::CollectionHandle;
 use oo_bindgen::iterator::IteratorHandle;
 use oo_bindgen::native_enum::NativeEnumHandle;
 use oo_bindgen::native_function::{ReturnType, Type};
@@ -14,7 +15,11 @@ pub(crate) struct CommonDefinitions {
     pub(crate) register: NativeStructHandle,
     pub(crate) bit_iterator: IteratorHandle,
     pub(crate) register_iterator: IteratorHandle,
+    pub(crate) bit_list: CollectionHandle,
+    pub(crate) register_list: CollectionHandle,
     pub(crate) exception: NativeEnumHandle,
+    pub(crate) decode_level: NativeEnumHandle,
+    pub(crate) socket_options: NativeStructHandle,
 }
 
 impl CommonDefinitions {
@@ -32,7 +37,11 @@ impl CommonDefinitions {
             register: register.clone(),
             bit_iterator: build_iterator(lib, &bit)?,
             register_iterator: build_iterator(lib, &register)?,
+            bit_list: build_list(lib, "Bit", Type::Bool)?,
+            register_list: build_list(lib, "Register", Type::Uint16)?,
             exception,
+            decode_level: crate::logging::define_decode_level(lib)?,
+            socket_options: build_socket_options(lib)?,
         })
     }
 }
@@ -83,6 +92,41 @@ fn build_request_param(lib: &mut LibraryBuilder) -> Result<NativeStructHandle, B
     Ok(param)
 }
 
+fn build_socket_options(lib: &mut LibraryBuilder) -> Result<NativeStructHandle, BindingError> {
+    let options = lib.declare_native_struct("SocketOptions")?;
+    let options = lib
+        .define_native_struct(&options)?
+        .add(
+            "no_delay",
+            Type::Bool,
+            "Disable Nagle's algorithm (TCP_NODELAY) so that each frame is sent immediately",
+        )?
+        .add(
+            "recv_buffer_size",
+            Type::Uint32,
+            "Size of the kernel receive buffer (SO_RCVBUF) in bytes. For the system default, use 0.",
+        )?
+        .add(
+            "send_buffer_size",
+            Type::Uint32,
+            "Size of the kernel send buffer (SO_SNDBUF) in bytes. For the system default, use 0.",
+        )?
+        .add(
+            "keep_alive_ms",
+            Type::Uint32,
+            "Idle time in milliseconds before TCP keepalive probes are sent (SO_KEEPALIVE). To leave keepalive disabled, use 0.",
+        )?
+        .add(
+            "read_buffer_size",
+            Type::Uint32,
+            "Capacity of the buffer that frames are read into in bytes. For the default, use 0.",
+        )?
+        .doc("Settings applied to the socket of each TCP connection. For low latency links, set no_delay and a keep_alive_ms of a few seconds.")?
+        .build()?;
+
+    Ok(options)
+}
+
 fn build_error_info(
     lib: &mut LibraryBuilder,
     exception: &NativeEnumHandle,
@@ -121,7 +165,7 @@ fn build_iterator(
     let iterator = lib.declare_class(&format!("{}Iterator", base_name))?;
     let iterator_next_fn = lib
         .declare_native_function(&format!("next_{}", base_name.to_lowercase()))?
-        .param("it", Type::ClassRef(iterator), "iterator")?
+        .param("it", Type::ClassRef(iterator.clone()), "iterator")?
         .return_type(ReturnType::new(
             Type::StructRef(value_type.declaration()),
             "next value of the iterator or NULL if the iterator has reached the end",
@@ -129,5 +173,88 @@ fn build_iterator(
         .doc("advance the iterator")?
         .build()?;
 
+    let remaining_fn = lib
+        .declare_native_function(&format!("{}_iterator_remaining", base_name.to_lowercase()))?
+        .param("it", Type::ClassRef(iterator.clone()), "iterator")?
+        .return_type(ReturnType::new(
+            Type::Uint32,
+            "number of values that remain in the iterator",
+        ))?
+        .doc("get the number of values that calls to next will return, so that storage for the whole response can be allocated at once")?
+        .build()?;
+
+    let copy_fn = lib
+        .declare_native_function(&format!("{}_iterator_copy", base_name.to_lowercase()))?
+        .param("it", Type::ClassRef(iterator.clone()), "iterator")?
+        .param(
+            "buffer",
+            Type::StructRef(value_type.declaration()),
+            "first element of an array into which the values are copied",
+        )?
+        .param(
+            "capacity",
+            Type::Uint32,
+            "number of elements in the array",
+        )?
+        .return_type(ReturnType::new(
+            Type::Uint32,
+            "number of values copied into the array",
+        ))?
+        .doc("copy as many of the remaining values as fit into an array and advance the iterator past them. Copying the whole response this way takes a single call instead of one per value.")?
+        .build()?;
+
+    lib.define_class(&iterator)?
+        .method("remaining", &remaining_fn)?
+        .method("copy", &copy_fn)?
+        .doc(format!("Iterator over {} values", base_name.to_lowercase()).as_str())?
+        .build()?;
+
     lib.define_iterator_with_lifetime(&iterator_next_fn, &value_type)
 }
+
+pub(crate) fn build_list(
+    lib: &mut LibraryBuilder,
+    name: &str,
+    value_type: Type,
+) -> Result<CollectionHandle, BindingError> {
+    let list_class = lib.declare_class(&format!("{}List", name))?;
+
+    let create_fn = lib
+        .declare_native_function(&format!("{}_list_create", name.to_lowercase()))?
+        .param(
+            "size_hint",
+            Type::Uint32,
+            "Starting size of the list. Can be used to avoid multiple allocations if you already know how many items you're going to add.",
+        )?
+        .return_type(ReturnType::new(
+            Type::ClassRef(list_class.clone()),
+            "created list",
+        ))?
+        .doc(format!("create a {} list", name).as_str())?
+        .build()?;
+
+    let destroy_fn = lib
+        .declare_native_function(&format!("{}_list_destroy", name.to_lowercase()))?
+        .param(
+            "list",
+            Type::ClassRef(list_class.clone()),
+            "list to destroy",
+        )?
+        .return_type(ReturnType::void())?
+        .doc(format!("destroy a {} list", name).as_str())?
+        .build()?;
+
+    let add_fn = lib
+        .declare_native_function(&format!("{}_list_add", name.to_lowercase()))?
+        .param(
+            "list",
+            Type::ClassRef(list_class),
+            "list to which to add the item",
+        )?
+        .param("item", value_type, "item to add to the list")?
+        .return_type(ReturnType::void())?
+        .doc("Add an item to the list")?
+        .build()?;
+
+    lib.define_collection(&create_fn, &destroy_fn, &add_fn)
+}
@@ -72,6 +72,11 @@ pub(crate) fn define_status(lib: &mut LibraryBuilder) -> Result<Handle<NativeEnu
             10,
             "An invalid argument was supplied and the request could not be performed",
         )?
+        .variant(
+            "UnitUnavailable",
+            11,
+            "The request wasn't sent because the unit has stopped responding to requests",
+        )?
         .doc("Status returned during synchronous and asynchronous API calls")?
         .build()
 }
@@ -1,4 +1,4 @@
-use oo_bindgen::native_enum::NativeEnum;
+use oo_bindgen::native_enum::{NativeEnum, NativeEnumHandle};
 use oo_bindgen::native_function::{ReturnType, Type};
 use oo_bindgen::{BindingError, Handle, LibraryBuilder};
 
@@ -17,6 +17,26 @@ fn define_log_level(lib: &mut LibraryBuilder) -> Result<Handle<NativeEnum>, Bind
         .build()
 }
 
+pub(crate) fn define_decode_level(
+    lib: &mut LibraryBuilder,
+) -> Result<NativeEnumHandle, BindingError> {
+    lib.define_native_enum("DecodeLevel")?
+        .variant("Nothing", 0, "don't log any frames")?
+        .variant(
+            "Header",
+            1,
+            "log the transaction id, unit id and length of each frame",
+        )?
+        .variant("Function", 2, "log the header and the function code")?
+        .variant(
+            "Payload",
+            3,
+            "log the header, the function code and a hex dump of the ADU",
+        )?
+        .doc("controls how much of each frame is decoded and logged at the Info level")?
+        .build()
+}
+
 pub(crate) fn define_logging(lib: &mut LibraryBuilder) -> Result<(), BindingError> {
     let level = define_log_level(lib)?;
 
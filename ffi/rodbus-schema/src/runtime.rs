@@ -13,7 +13,22 @@ pub fn build_runtime_class(lib: &mut LibraryBuilder) -> Result<ClassHandle, Bind
             Type::Uint16,
             "Number of runtime threads to spawn. For a guess of the number of CPUs, use 0.",
         )?
-        .doc("Runtime configuration")?
+        .add(
+            "single_threaded",
+            Type::Bool,
+            "Run every task on a single worker thread, e.g. to leave the other cores to a realtime process. num_core_threads is ignored.",
+        )?
+        .add(
+            "max_blocking_threads",
+            Type::Uint16,
+            "Maximum number of threads used for blocking operations, in addition to the core threads. To use the default limit of the runtime, use 0, which allows up to 512 threads in total, core threads included.",
+        )?
+        .add(
+            "affinity_mask",
+            Type::Uint64,
+            "Cores the core threads of the runtime are pinned to, bit N selecting core N. Threads are assigned to the selected cores in turn, threads used for blocking operations are never pinned. To let the OS schedule the threads, use 0.",
+        )?
+        .doc("Runtime configuration. Channels and servers run on the runtime they are created with, so several runtimes with different configurations can be used to isolate them from each other.")?
         .build()?;
 
     // Declare the native functions
@@ -2,6 +2,7 @@ use crate::common::CommonDefinitions;
 
 use oo_bindgen::callback::{InterfaceHandle, OneTimeCallbackHandle};
 use oo_bindgen::class::{ClassDeclarationHandle, ClassHandle};
+use oo_bindgen::collection::CollectionHandle;
 use oo_bindgen::native_function::{NativeFunctionHandle, ReturnType, Type};
 use oo_bindgen::native_struct::NativeStructHandle;
 use oo_bindgen::{BindingError, LibraryBuilder};
@@ -18,7 +19,7 @@ pub(crate) fn build_server(
     lib: &mut LibraryBuilder,
     common: &CommonDefinitions,
 ) -> Result<ClassHandle, BindingError> {
-    let database = build_database_class(lib)?;
+    let database = build_database_class(lib, common)?;
 
     let db_update_callback = lib
         .define_one_time_callback(
@@ -53,6 +54,16 @@ pub(crate) fn build_server(
             Type::ClassRef(handler_map.declaration.clone()),
             "map of endpoints which is emptied upon passing to this function",
         )?
+        .param(
+            "decode_level",
+            Type::Enum(common.decode_level.clone()),
+            "level of detail used when logging the frames sent and received on each session",
+        )?
+        .param(
+            "socket_options",
+            Type::Struct(common.socket_options.clone()),
+            "settings applied to the socket of each accepted connection",
+        )?
         .return_type(ReturnType::Type(
             Type::ClassRef(server.clone()),
             "handle to the server".into(),
@@ -80,14 +91,83 @@ pub(crate) fn build_server(
         .doc("Update the database associated with a particular unit id. If the unit id exists, lock the database and call user code to perform the transaction")?
         .build()?;
 
+    let server_metrics = build_server_metrics(lib)?;
+
+    let get_metrics_fn = lib
+        .declare_native_function("server_get_metrics")?
+        .param(
+            "server",
+            Type::ClassRef(server.clone()),
+            "server from which to retrieve the metrics",
+        )?
+        .return_type(ReturnType::Type(
+            Type::Struct(server_metrics),
+            "snapshot of the server's counters".into(),
+        ))?
+        .doc("take a snapshot of the counters maintained by the server without blocking its sessions")?
+        .build()?;
+
     lib.define_class(&server)?
         .destructor(&destroy_fn)?
         .method("update", &update_fn)?
+        .method("get_metrics", &get_metrics_fn)?
         .static_method("create_tcp_server", &create_tcp_server_fn)?
         .doc("Handle to the running server. The server remains alive until this reference is destroyed")?
         .build()
 }
 
+fn build_server_metrics(lib: &mut LibraryBuilder) -> Result<NativeStructHandle, BindingError> {
+    let metrics = lib.declare_native_struct("ServerMetrics")?;
+    lib.define_native_struct(&metrics)?
+        .add(
+            "active_sessions",
+            Type::Uint32,
+            "Number of sessions that are currently open",
+        )?
+        .add(
+            "sessions_accepted",
+            Type::Uint64,
+            "Number of connections accepted",
+        )?
+        .add(
+            "sessions_evicted",
+            Type::Uint64,
+            "Number of sessions closed to make room for a new connection",
+        )?
+        .add(
+            "requests_received",
+            Type::Uint64,
+            "Number of requests received for a mapped unit id",
+        )?
+        .add(
+            "exceptions",
+            Type::Uint64,
+            "Number of exception responses sent",
+        )?
+        .add(
+            "bytes_received",
+            Type::Uint64,
+            "Number of bytes received in complete frames",
+        )?
+        .add(
+            "bytes_sent",
+            Type::Uint64,
+            "Number of bytes written to the sessions",
+        )?
+        .add(
+            "lock_wait_mean_us",
+            Type::Uint64,
+            "Mean time spent waiting to lock a database in microseconds",
+        )?
+        .add(
+            "lock_wait_p99_us",
+            Type::Uint64,
+            "Upper bound of the histogram bucket containing the 99th percentile lock wait in microseconds",
+        )?
+        .doc("Snapshot of the counters maintained by a server")?
+        .build()
+}
+
 pub(crate) fn build_add_fn(
     lib: &mut LibraryBuilder,
     db: &ClassDeclarationHandle,
@@ -184,7 +264,78 @@ pub(crate) fn build_update_fn(
         .build()
 }
 
-pub(crate) fn build_database_class(lib: &mut LibraryBuilder) -> Result<ClassHandle, BindingError> {
+pub(crate) fn build_update_range_fn(
+    lib: &mut LibraryBuilder,
+    db: &ClassDeclarationHandle,
+    snake_name: &str,
+    list_type: &CollectionHandle,
+) -> Result<NativeFunctionHandle, BindingError> {
+    let spaced_name = snake_name.replace("_", " ");
+
+    lib.declare_native_function(&format!("database_update_{}", snake_name))?
+        .param(
+            "database",
+            Type::ClassRef(db.clone()),
+            "database to manipulate",
+        )?
+        .param("start", Type::Uint16, "address of the first value")?
+        .param(
+            "values",
+            Type::Collection(list_type.clone()),
+            "new values, starting at the start address",
+        )?
+        .return_type(ReturnType::Type(
+            Type::Bool,
+            "true if every address in the range is defined, false otherwise in which case nothing is updated".into(),
+        ))?
+        .doc(
+            format!(
+                "update the current values of a contiguous range of {} in the database. Use within the transaction of server_update_database so that clients observe the whole range change at once",
+                spaced_name
+            )
+            .as_str(),
+        )?
+        .build()
+}
+
+pub(crate) fn build_update_values_fn(
+    lib: &mut LibraryBuilder,
+    db: &ClassDeclarationHandle,
+    snake_name: &str,
+    value_type: &NativeStructHandle,
+) -> Result<NativeFunctionHandle, BindingError> {
+    let spaced_name = snake_name.replace("_", " ");
+
+    lib.declare_native_function(&format!("database_update_{}_values", snake_name))?
+        .param(
+            "database",
+            Type::ClassRef(db.clone()),
+            "database to manipulate",
+        )?
+        .param(
+            "values",
+            Type::StructRef(value_type.declaration()),
+            format!("first element of an array of {} index/value pairs, e.g. filled by the copy method of an iterator", spaced_name).as_str(),
+        )?
+        .param("count", Type::Uint32, "number of elements in the array")?
+        .return_type(ReturnType::Type(
+            Type::Bool,
+            "true if every address in the array is defined, false otherwise in which case nothing is updated".into(),
+        ))?
+        .doc(
+            format!(
+                "update the current values of any number of {}s in the database with a single call",
+                spaced_name
+            )
+            .as_str(),
+        )?
+        .build()
+}
+
+pub(crate) fn build_database_class(
+    lib: &mut LibraryBuilder,
+    common: &CommonDefinitions,
+) -> Result<ClassHandle, BindingError> {
     let database = lib.declare_class("Database")?;
 
     let add_coil_fn = build_add_fn(lib, &database, "coil", Type::Bool)?;
@@ -198,6 +349,22 @@ pub(crate) fn build_database_class(lib: &mut LibraryBuilder) -> Result<ClassHand
         build_update_fn(lib, &database, "holding_register", Type::Uint16)?;
     let update_input_register_fn = build_update_fn(lib, &database, "input_register", Type::Uint16)?;
 
+    let update_coils_fn = build_update_range_fn(lib, &database, "coils", &common.bit_list)?;
+    let update_discrete_inputs_fn =
+        build_update_range_fn(lib, &database, "discrete_inputs", &common.bit_list)?;
+    let update_holding_registers_fn =
+        build_update_range_fn(lib, &database, "holding_registers", &common.register_list)?;
+    let update_input_registers_fn =
+        build_update_range_fn(lib, &database, "input_registers", &common.register_list)?;
+
+    let update_coil_values_fn = build_update_values_fn(lib, &database, "coil", &common.bit)?;
+    let update_discrete_input_values_fn =
+        build_update_values_fn(lib, &database, "discrete_input", &common.bit)?;
+    let update_holding_register_values_fn =
+        build_update_values_fn(lib, &database, "holding_register", &common.register)?;
+    let update_input_register_values_fn =
+        build_update_values_fn(lib, &database, "input_register", &common.register)?;
+
     let delete_coil_fn = build_delete_fn(lib, &database, "coil")?;
     let delete_discrete_input_fn = build_delete_fn(lib, &database, "discrete_input")?;
     let delete_holding_register_fn = build_delete_fn(lib, &database, "holding_register")?;
@@ -214,6 +381,25 @@ pub(crate) fn build_database_class(lib: &mut LibraryBuilder) -> Result<ClassHand
         .method("update_discrete_input", &update_discrete_input_fn)?
         .method("update_holding_register", &update_holding_register_fn)?
         .method("update_input_register", &update_input_register_fn)?
+        // range update methods
+        .method("update_coils", &update_coils_fn)?
+        .method("update_discrete_inputs", &update_discrete_inputs_fn)?
+        .method("update_holding_registers", &update_holding_registers_fn)?
+        .method("update_input_registers", &update_input_registers_fn)?
+        // index/value array update methods
+        .method("update_coil_values", &update_coil_values_fn)?
+        .method(
+            "update_discrete_input_values",
+            &update_discrete_input_values_fn,
+        )?
+        .method(
+            "update_holding_register_values",
+            &update_holding_register_values_fn,
+        )?
+        .method(
+            "update_input_register_values",
+            &update_input_register_values_fn,
+        )?
         // delete methods
         .method("delete_coil", &delete_coil_fn)?
         .method("delete_discrete_input", &delete_discrete_input_fn)?
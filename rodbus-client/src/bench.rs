@@ -0,0 +1,353 @@
+//! Load generation and latency profiling using the library's own client stack
+
+use std::net::SocketAddr;
+use std::str::FromStr;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+use rodbus::metrics::LatencyHistogram;
+use rodbus::prelude::*;
+
+use crate::Error;
+
+/// A request issued by the load generator, all of them target the same address range
+#[derive(Copy, Clone, Debug)]
+pub(crate) enum Operation {
+    ReadCoils,
+    ReadDiscreteInputs,
+    ReadHoldingRegisters,
+    ReadInputRegisters,
+    WriteSingleCoil,
+    WriteSingleRegister,
+    WriteMultipleCoils,
+    WriteMultipleRegisters,
+}
+
+impl FromStr for Operation {
+    type Err = Error;
+
+    fn from_str(s: &str) -> Result<Self, Self::Err> {
+        // same names as the sub-commands
+        match s {
+            "rc" => Ok(Operation::ReadCoils),
+            "rdi" => Ok(Operation::ReadDiscreteInputs),
+            "rhr" => Ok(Operation::ReadHoldingRegisters),
+            "rir" => Ok(Operation::ReadInputRegisters),
+            "wsc" => Ok(Operation::WriteSingleCoil),
+            "wsr" => Ok(Operation::WriteSingleRegister),
+            "wmc" => Ok(Operation::WriteMultipleCoils),
+            "wmr" => Ok(Operation::WriteMultipleRegisters),
+            _ => Err(Error::BadMix(s.to_string())),
+        }
+    }
+}
+
+/// Parse a comma delimited list of weighted operations, e.g. `rhr=8,wsr=2`
+///
+/// Each operation appears in the returned schedule as many times as its weight
+pub(crate) fn parse_mix(mix: &str) -> Result<Vec<Operation>, Error> {
+    let mut schedule = Vec::new();
+    for item in mix.split(',') {
+        let mut parts = item.splitn(2, '=');
+        let operation = Operation::from_str(parts.next().unwrap_or("").trim())?;
+        let weight = match parts.next() {
+            Some(x) => usize::from_str(x.trim())?,
+            None => 1,
+        };
+        schedule.extend(std::iter::repeat(operation).take(weight));
+    }
+    if schedule.is_empty() {
+        return Err(Error::BadMix(mix.to_string()));
+    }
+    Ok(schedule)
+}
+
+/// When the load generator stops issuing requests
+#[derive(Copy, Clone)]
+pub(crate) enum Limit {
+    Duration(Duration),
+    Requests(u64),
+}
+
+pub(crate) struct Config {
+    /// number of TCP connections, each with its own channel
+    pub(crate) connections: usize,
+    /// number of sessions sharing each connection
+    pub(crate) sessions: usize,
+    /// number of requests each session keeps outstanding
+    pub(crate) depth: usize,
+    pub(crate) limit: Limit,
+    pub(crate) range: AddressRange,
+    pub(crate) timeout: Duration,
+    pub(crate) schedule: Vec<Operation>,
+}
+
+/// Hands out the right to issue one more request until the limit is reached
+struct Budget {
+    deadline: Option<Instant>,
+    max_requests: Option<u64>,
+    issued: AtomicU64,
+}
+
+impl Budget {
+    fn new(limit: Limit, start: Instant) -> Self {
+        let (deadline, max_requests) = match limit {
+            Limit::Duration(x) => (Some(start + x), None),
+            Limit::Requests(x) => (None, Some(x)),
+        };
+        Self {
+            deadline,
+            max_requests,
+            issued: AtomicU64::new(0),
+        }
+    }
+
+    fn take(&self) -> bool {
+        if let Some(deadline) = self.deadline {
+            if Instant::now() >= deadline {
+                return false;
+            }
+        }
+        match self.max_requests {
+            Some(max) => self.issued.fetch_add(1, Ordering::Relaxed) < max,
+            None => true,
+        }
+    }
+}
+
+#[derive(Default)]
+struct Stats {
+    // latency of every request that received a response, exceptions included
+    latency: LatencyHistogram,
+    exceptions: u64,
+    timeouts: u64,
+    errors: u64,
+}
+
+impl Stats {
+    fn merge(&mut self, other: Stats) {
+        self.latency.merge(&other.latency);
+        self.exceptions += other.exceptions;
+        self.timeouts += other.timeouts;
+        self.errors += other.errors;
+    }
+
+    fn record(&mut self, result: Result<(), rodbus::error::Error>, latency: Duration) {
+        match result {
+            Ok(()) => self.latency.record(latency),
+            Err(rodbus::error::Error::Exception(_)) => {
+                self.latency.record(latency);
+                self.exceptions += 1;
+            }
+            Err(rodbus::error::Error::ResponseTimeout) => self.timeouts += 1,
+            Err(_) => self.errors += 1,
+        }
+    }
+
+    // upper bound of the histogram bucket that contains the percentile
+    fn percentile(&self, percentile: f64) -> Duration {
+        self.latency.percentile(percentile).unwrap_or_default()
+    }
+
+    fn print(&self, elapsed: Duration) {
+        let responses = self.latency.count();
+        let total = responses + self.timeouts + self.errors;
+
+        println!("requests: {} in {:.3} s", total, elapsed.as_secs_f64());
+        println!(
+            "throughput: {:.1} responses/sec",
+            responses as f64 / elapsed.as_secs_f64()
+        );
+        println!(
+            "latency: p50 < {:?} p99 < {:?} p999 < {:?} max < {:?}",
+            self.percentile(50.0),
+            self.percentile(99.0),
+            self.percentile(99.9),
+            self.percentile(100.0)
+        );
+        println!(
+            "exceptions: {} timeouts: {} other errors: {}",
+            self.exceptions, self.timeouts, self.errors
+        );
+    }
+}
+
+// how long the connections may take to come up before the run is abandoned
+const CONNECT_TIMEOUT: Duration = Duration::from_secs(5);
+
+async fn wait_for_connections(channels: &[Channel]) -> Result<(), Error> {
+    let deadline = Instant::now() + CONNECT_TIMEOUT;
+    while channels.iter().any(|x| x.metrics().connects == 0) {
+        if Instant::now() >= deadline {
+            return Err(Error::Request(rodbus::error::Error::NoConnection));
+        }
+        tokio::time::delay_for(Duration::from_millis(10)).await;
+    }
+    Ok(())
+}
+
+async fn execute(
+    session: &mut AsyncSession,
+    operation: Operation,
+    range: AddressRange,
+    counter: u16,
+) -> Result<(), rodbus::error::Error> {
+    // the values written change with every request so that servers can't ignore them
+    let bit = counter % 2 == 0;
+    match operation {
+        Operation::ReadCoils => session.read_coils(range).await.map(|_| ()),
+        Operation::ReadDiscreteInputs => session.read_discrete_inputs(range).await.map(|_| ()),
+        Operation::ReadHoldingRegisters => session.read_holding_registers(range).await.map(|_| ()),
+        Operation::ReadInputRegisters => session.read_input_registers(range).await.map(|_| ()),
+        Operation::WriteSingleCoil => session
+            .write_single_coil(Indexed::new(range.start, bit))
+            .await
+            .map(|_| ()),
+        Operation::WriteSingleRegister => session
+            .write_single_register(Indexed::new(range.start, counter))
+            .await
+            .map(|_| ()),
+        Operation::WriteMultipleCoils => {
+            let values = vec![bit; range.count as usize];
+            session
+                .write_multiple_coils(WriteMultiple::from(range.start, values)?)
+                .await
+                .map(|_| ())
+        }
+        Operation::WriteMultipleRegisters => {
+            let values = vec![counter; range.count as usize];
+            session
+                .write_multiple_registers(WriteMultiple::from(range.start, values)?)
+                .await
+                .map(|_| ())
+        }
+    }
+}
+
+async fn worker(
+    mut session: AsyncSession,
+    config: Arc<Config>,
+    budget: Arc<Budget>,
+    offset: usize,
+) -> Stats {
+    let mut stats = Stats::default();
+    let mut counter: u16 = 0;
+    // workers start at different points of the schedule so that the mix is spread evenly
+    let mut operations = config.schedule.iter().cycle().skip(offset);
+
+    while budget.take() {
+        let operation = match operations.next() {
+            Some(x) => *x,
+            None => break,
+        };
+        counter = counter.wrapping_add(1);
+        let start = Instant::now();
+        let result = execute(&mut session, operation, config.range, counter).await;
+        stats.record(result, start.elapsed());
+    }
+
+    stats
+}
+
+pub(crate) async fn run(address: SocketAddr, id: UnitId, config: Config) -> Result<(), Error> {
+    let config = Arc::new(config);
+    let outstanding = std::cmp::max(config.sessions * config.depth, 1);
+
+    println!(
+        "{} connection(s), {} session(s) per connection, {} outstanding request(s) per session",
+        config.connections, config.sessions, config.depth
+    );
+
+    let channels: Vec<Channel> = (0..config.connections)
+        .map(|_| {
+            let max_in_flight = std::cmp::min(outstanding, u16::MAX as usize) as u16;
+            let options = ChannelOptions::new(max_in_flight);
+            spawn_tcp_client_task_with_options(address, outstanding, strategy::default(), options)
+        })
+        .collect();
+
+    // connecting isn't part of the measurement
+    wait_for_connections(&channels).await?;
+
+    let start = Instant::now();
+    let budget = Arc::new(Budget::new(config.limit, start));
+
+    let mut workers = Vec::new();
+    for channel in channels.iter() {
+        for _ in 0..config.sessions {
+            let session = channel.create_session(id, config.timeout);
+            for _ in 0..config.depth {
+                let offset = workers.len();
+                workers.push(tokio::spawn(worker(
+                    session.clone(),
+                    config.clone(),
+                    budget.clone(),
+                    offset,
+                )));
+            }
+        }
+    }
+
+    let mut stats = Stats::default();
+    for worker in workers {
+        if let Ok(x) = worker.await {
+            stats.merge(x);
+        }
+    }
+
+    stats.print(start.elapsed());
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn names(schedule: Vec<Operation>) -> Vec<String> {
+        schedule.iter().map(|x| format!("{:?}", x)).collect()
+    }
+
+    #[test]
+    fn parses_weighted_mix() {
+        assert_eq!(
+            names(parse_mix("rhr=2, wsc").unwrap()),
+            vec![
+                "ReadHoldingRegisters",
+                "ReadHoldingRegisters",
+                "WriteSingleCoil"
+            ]
+        );
+    }
+
+    #[test]
+    fn rejects_bad_mix() {
+        assert!(parse_mix("").is_err());
+        assert!(parse_mix("xyz").is_err());
+        assert!(parse_mix("rc=many").is_err());
+        assert!(parse_mix("rc=0").is_err());
+    }
+
+    #[test]
+    fn percentiles_include_exception_replies() {
+        let mut stats = Stats::default();
+        stats.record(Ok(()), Duration::from_micros(3));
+        stats.record(
+            Err(rodbus::error::Error::Exception(
+                rodbus::error::details::ExceptionCode::IllegalDataAddress,
+            )),
+            Duration::from_micros(1000),
+        );
+        stats.record(
+            Err(rodbus::error::Error::ResponseTimeout),
+            Duration::from_secs(1),
+        );
+
+        assert_eq!(stats.latency.count(), 2);
+        assert_eq!(stats.exceptions, 1);
+        assert_eq!(stats.timeouts, 1);
+        assert_eq!(stats.percentile(50.0), Duration::from_micros(4));
+        assert_eq!(stats.percentile(100.0), Duration::from_micros(1024));
+        assert_eq!(Stats::default().percentile(50.0), Duration::from_secs(0));
+    }
+}
@@ -10,6 +10,8 @@ use rodbus::error::details::{InvalidRange, InvalidRequest};
 use rodbus::prelude::*;
 use simple_logger::SimpleLogger;
 
+mod bench;
+
 #[derive(Debug)]
 enum Error {
     BadRange(InvalidRange),
@@ -17,6 +19,7 @@ enum Error {
     BadInt(std::num::ParseIntError),
     BadBool(std::str::ParseBoolError),
     BadCharInBitString(char),
+    BadMix(String),
     Request(rodbus::error::Error),
     MissingSubCommand,
 }
@@ -30,6 +33,7 @@ enum Command {
     WriteSingleCoil(Indexed<bool>),
     WriteMultipleCoils(WriteMultiple<bool>),
     WriteMultipleRegisters(WriteMultiple<u16>),
+    Bench(bench::Config),
 }
 
 struct Args {
@@ -67,18 +71,72 @@ async fn main() -> Result<(), Box<dyn std::error::Error>> {
 
 async fn run() -> Result<(), Error> {
     let args = parse_args()?;
+    if let Command::Bench(config) = args.command {
+        // the load generator creates its own channels
+        return bench::run(args.address, args.id, config).await;
+    }
+
     let channel = spawn_tcp_client_task(args.address, 1, strategy::default());
     let mut session = channel.create_session(args.id, Duration::from_secs(1));
 
     match args.period {
         None => run_command(&args.command, &mut session).await,
-        Some(period) => loop {
-            run_command(&args.command, &mut session).await?;
-            tokio::time::delay_for(period).await
+        Some(period) => match args.command.poll(args.id, period) {
+            // reads are scheduled by the channel
+            Some(poll) => {
+                let _handle =
+                    channel.spawn_poll_task(vec![poll], Duration::from_secs(1), PollPrinter);
+                loop {
+                    tokio::time::delay_for(Duration::from_secs(3600)).await
+                }
+            }
+            None => loop {
+                run_command(&args.command, &mut session).await?;
+                tokio::time::delay_for(period).await
+            },
         },
     }
 }
 
+impl Command {
+    fn poll(&self, id: UnitId, period: Duration) -> Option<Poll> {
+        let (kind, range) = match self {
+            Command::ReadCoils(range) => (PollKind::ReadCoils, *range),
+            Command::ReadDiscreteInputs(range) => (PollKind::ReadDiscreteInputs, *range),
+            Command::ReadHoldingRegisters(range) => (PollKind::ReadHoldingRegisters, *range),
+            Command::ReadInputRegisters(range) => (PollKind::ReadInputRegisters, *range),
+            _ => return None,
+        };
+        Some(Poll::new(id, kind, range, period))
+    }
+}
+
+struct PollPrinter;
+
+impl PollHandler for PollPrinter {
+    fn on_bits(&self, _index: usize, result: Result<BitIterator, rodbus::error::Error>) {
+        match result {
+            Ok(values) => {
+                for x in values {
+                    println!("index: {} value: {}", x.index, x.value)
+                }
+            }
+            Err(err) => println!("error: {}", err),
+        }
+    }
+
+    fn on_registers(&self, _index: usize, result: Result<RegisterIterator, rodbus::error::Error>) {
+        match result {
+            Ok(values) => {
+                for x in values {
+                    println!("index: {} value: {}", x.index, x.value)
+                }
+            }
+            Err(err) => println!("error: {}", err),
+        }
+    }
+}
+
 async fn run_command(command: &Command, session: &mut AsyncSession) -> Result<(), Error> {
     match command {
         Command::ReadCoils(range) => {
@@ -113,6 +171,8 @@ async fn run_command(command: &Command, session: &mut AsyncSession) -> Result<()
         Command::WriteMultipleRegisters(arg) => {
             session.write_multiple_registers(arg.clone()).await?;
         }
+        // handled by run before a session is created
+        Command::Bench(_) => {}
     }
     Ok(())
 }
@@ -215,9 +275,32 @@ fn get_command(matches: &ArgMatches) -> Result<Command, Error> {
         )?));
     }
 
+    if let Some(matches) = matches.subcommand_matches("bench") {
+        return Ok(Command::Bench(get_bench_config(matches)?));
+    }
+
     Err(Error::MissingSubCommand)
 }
 
+fn get_bench_config(arg: &ArgMatches) -> Result<bench::Config, Error> {
+    let limit = match arg.value_of("requests") {
+        Some(x) => bench::Limit::Requests(u64::from_str(x)?),
+        None => bench::Limit::Duration(Duration::from_secs(u64::from_str(
+            arg.value_of("duration").unwrap(),
+        )?)),
+    };
+
+    Ok(bench::Config {
+        connections: usize::from_str(arg.value_of("connections").unwrap())?,
+        sessions: usize::from_str(arg.value_of("sessions").unwrap())?,
+        depth: usize::from_str(arg.value_of("depth").unwrap())?,
+        limit,
+        range: get_address_range(arg)?,
+        timeout: get_period_ms(arg.value_of("timeout").unwrap())?,
+        schedule: bench::parse_mix(arg.value_of("mix").unwrap())?,
+    })
+}
+
 fn parse_args() -> Result<Args, Error> {
     let matches = App::new("Modbus Client Console")
         .version("0.1.0")
@@ -408,6 +491,80 @@ fn parse_args() -> Result<Args, Error> {
                         .help("the values of the registers specified as a comma delimited list (e.g. 1,4,7)"),
                 ),
         )
+        .subcommand(
+            SubCommand::with_name("bench")
+                .about("generate load and report throughput and latency")
+                .arg(
+                    Arg::with_name("connections")
+                        .short("c")
+                        .long("connections")
+                        .takes_value(true)
+                        .default_value("1")
+                        .help("number of TCP connections"),
+                )
+                .arg(
+                    Arg::with_name("sessions")
+                        .short("n")
+                        .long("sessions")
+                        .takes_value(true)
+                        .default_value("1")
+                        .help("number of sessions per connection"),
+                )
+                .arg(
+                    Arg::with_name("depth")
+                        .short("d")
+                        .long("depth")
+                        .takes_value(true)
+                        .default_value("1")
+                        .help("number of requests each session keeps outstanding"),
+                )
+                .arg(
+                    Arg::with_name("duration")
+                        .short("t")
+                        .long("duration")
+                        .takes_value(true)
+                        .default_value("10")
+                        .help("duration of the test in seconds"),
+                )
+                .arg(
+                    Arg::with_name("requests")
+                        .short("r")
+                        .long("requests")
+                        .takes_value(true)
+                        .help("total number of requests to make, instead of a duration"),
+                )
+                .arg(
+                    Arg::with_name("mix")
+                        .short("m")
+                        .long("mix")
+                        .takes_value(true)
+                        .default_value("rhr")
+                        .help("the requests to make and their weights as a comma delimited list (e.g. rhr=8,wsr=2)"),
+                )
+                .arg(
+                    Arg::with_name("start")
+                        .short("s")
+                        .long("start")
+                        .takes_value(true)
+                        .default_value("0")
+                        .help("the starting address of every request"),
+                )
+                .arg(
+                    Arg::with_name("quantity")
+                        .short("q")
+                        .long("quantity")
+                        .takes_value(true)
+                        .default_value("10")
+                        .help("quantity of values read or written by multiple requests"),
+                )
+                .arg(
+                    Arg::with_name("timeout")
+                        .long("timeout")
+                        .takes_value(true)
+                        .default_value("1000")
+                        .help("response timeout in milliseconds"),
+                ),
+        )
         .get_matches();
 
     let address = SocketAddr::from_str(matches.value_of("host").unwrap())?;
@@ -431,6 +588,7 @@ impl std::fmt::Display for Error {
             Error::BadInt(err) => err.fmt(f),
             Error::BadBool(err) => err.fmt(f),
             Error::BadCharInBitString(char) => write!(f, "Bad character in bit string: {}", char),
+            Error::BadMix(mix) => write!(f, "Bad request mix: {}", mix),
             Error::Request(err) => err.fmt(f),
             Error::MissingSubCommand => f.write_str("No sub-command provided"),
         }
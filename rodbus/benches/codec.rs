@@ -0,0 +1,106 @@
+use criterion::{black_box, criterion_group, criterion_main, Criterion, Throughput};
+
+use rodbus::bench::*;
+use rodbus::types::AddressRange;
+
+// build a stream of read holding registers requests (tx id 0, unit 1, start 0, count 10)
+fn request_stream(count: usize) -> Vec<u8> {
+    let frame = [
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A,
+    ];
+    frame
+        .iter()
+        .cycle()
+        .take(count * frame.len())
+        .copied()
+        .collect()
+}
+
+fn parse_frames(c: &mut Criterion) {
+    const NUM_FRAMES: usize = 100;
+    let input = request_stream(NUM_FRAMES);
+    let mut runtime = tokio::runtime::Builder::new()
+        .basic_scheduler()
+        .build()
+        .unwrap();
+    let mut parser = MbapParser::new(input.len());
+
+    let mut group = c.benchmark_group("mbap");
+    group.throughput(Throughput::Elements(NUM_FRAMES as u64));
+    group.bench_function("parse", |b| {
+        b.iter(|| runtime.block_on(parser.parse_all(black_box(&input))))
+    });
+    group.finish();
+}
+
+fn format_frames(c: &mut Criterion) {
+    let registers = [0xCAFEu16; 125];
+    let bits = [true; 2000];
+    let mut formatter = MbapFormatter::new();
+
+    let mut group = c.benchmark_group("mbap");
+    group.bench_function("format 125 registers", |b| {
+        b.iter(|| formatter.format_registers(black_box(&registers)).unwrap())
+    });
+    group.bench_function("format 2000 bits", |b| {
+        b.iter(|| formatter.format_bits(black_box(&bits)).unwrap())
+    });
+    group.finish();
+}
+
+fn parse_values(c: &mut Criterion) {
+    let registers = [0xAAu8; 250];
+    let bits = [0x55u8; 250];
+
+    let mut group = c.benchmark_group("iterator");
+    group.throughput(Throughput::Elements(125));
+    group.bench_function("registers", |b| {
+        let range = AddressRange::try_from(0, 125).unwrap();
+        b.iter(|| parse_registers(range, black_box(&registers)).unwrap())
+    });
+    group.throughput(Throughput::Elements(2000));
+    group.bench_function("bits", |b| {
+        let range = AddressRange::try_from(0, 2000).unwrap();
+        b.iter(|| parse_bits(range, black_box(&bits)).unwrap())
+    });
+    group.finish();
+
+    let mut group = c.benchmark_group("bulk");
+    group.throughput(Throughput::Elements(125));
+    group.bench_function("registers", |b| {
+        let range = AddressRange::try_from(0, 125).unwrap();
+        let mut output = Vec::with_capacity(125);
+        b.iter(|| copy_registers(range, black_box(&registers), &mut output).unwrap())
+    });
+    group.throughput(Throughput::Elements(2000));
+    group.bench_function("bits", |b| {
+        let range = AddressRange::try_from(0, 2000).unwrap();
+        let mut output = Vec::with_capacity(2000);
+        b.iter(|| copy_bits(range, black_box(&bits), &mut output).unwrap())
+    });
+    group.finish();
+}
+
+fn parse_requests(c: &mut Criterion) {
+    let read = [0x03, 0x00, 0x00, 0x00, 0x7D];
+    let mut write = vec![0x10, 0x00, 0x00, 0x00, 0x7B, 0xF6];
+    write.extend_from_slice(&[0xAA; 0xF6]);
+
+    let mut group = c.benchmark_group("request");
+    group.bench_function("read holding registers", |b| {
+        b.iter(|| assert!(parse_request(black_box(&read))))
+    });
+    group.bench_function("write 123 registers", |b| {
+        b.iter(|| assert!(parse_request(black_box(&write))))
+    });
+    group.finish();
+}
+
+criterion_group!(
+    benches,
+    parse_frames,
+    format_frames,
+    parse_values,
+    parse_requests
+);
+criterion_main!(benches);
@@ -0,0 +1,147 @@
+use std::net::SocketAddr;
+use std::time::{Duration, Instant};
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use tokio::net::TcpListener;
+use tokio::runtime::Runtime;
+
+use rodbus::error::details::ExceptionCode;
+use rodbus::metrics::LatencyHistogram;
+use rodbus::prelude::*;
+use rodbus::shutdown::TaskHandle;
+
+const NUM_REGISTERS: usize = 100;
+
+struct Handler {
+    registers: [u16; NUM_REGISTERS],
+}
+
+impl RequestHandler for Handler {
+    fn read_holding_register(&self, address: u16) -> Result<u16, ExceptionCode> {
+        match self.registers.get(address as usize) {
+            Some(x) => Ok(*x),
+            None => Err(ExceptionCode::IllegalDataAddress),
+        }
+    }
+
+    fn read_holding_registers(
+        &self,
+        range: AddressRange,
+        output: &mut [u16],
+    ) -> Result<(), ExceptionCode> {
+        let start = range.start as usize;
+        match self.registers.get(start..start + range.count as usize) {
+            Some(x) => {
+                output.copy_from_slice(x);
+                Ok(())
+            }
+            None => Err(ExceptionCode::IllegalDataAddress),
+        }
+    }
+}
+
+// start a server on a free loopback port and connect `num_sessions` independent channels to it
+fn setup(
+    runtime: &mut Runtime,
+    num_sessions: usize,
+) -> (TaskHandle, Vec<Channel>, Vec<AsyncSession>) {
+    runtime.block_on(async {
+        let listener = TcpListener::bind(SocketAddr::from(([127, 0, 0, 1], 0)))
+            .await
+            .unwrap();
+        let addr = listener.local_addr().unwrap();
+        let handler = Handler {
+            registers: [0xCAFE; NUM_REGISTERS],
+        }
+        .wrap();
+
+        let server = spawn_tcp_server_task(
+            num_sessions,
+            listener,
+            ServerHandlerMap::single(UnitId::new(1), handler),
+        );
+
+        let mut channels = Vec::new();
+        let mut sessions = Vec::new();
+        for _ in 0..num_sessions {
+            let channel = spawn_tcp_client_task(addr, 10, strategy::default());
+            let mut session = channel.create_session(UnitId::new(1), Duration::from_secs(1));
+            // wait for the connection to be established
+            while session
+                .read_holding_registers(AddressRange::try_from(0, 1).unwrap())
+                .await
+                .is_err()
+            {
+                tokio::time::delay_for(Duration::from_millis(10)).await;
+            }
+            channels.push(channel);
+            sessions.push(session);
+        }
+        (server, channels, sessions)
+    })
+}
+
+// criterion only reports the mean time of an iteration, so the distribution of the response
+// latency recorded by every channel during the pass (including warm-up) is printed as well
+fn print_percentiles(channels: &[Channel]) {
+    let mut latency = LatencyHistogram::default();
+    for channel in channels {
+        latency.merge(&channel.metrics().response_latency);
+    }
+    let format = |x: Option<Duration>| x.map(|x| format!("{:?}", x)).unwrap_or_default();
+    println!(
+        "response latency of {} requests: p50 < {} p99 < {} p999 < {}",
+        latency.count(),
+        format(latency.percentile(50.0)),
+        format(latency.percentile(99.0)),
+        format(latency.percentile(99.9)),
+    );
+}
+
+// every session performs `iters` requests back-to-back, all sessions run concurrently
+async fn run(sessions: &[AsyncSession], iters: u64) -> Duration {
+    let range = AddressRange::try_from(0, NUM_REGISTERS as u16).unwrap();
+    let start = Instant::now();
+    let tasks: Vec<_> = sessions
+        .iter()
+        .cloned()
+        .map(|mut session| {
+            tokio::spawn(async move {
+                for _ in 0..iters {
+                    session.read_holding_registers(range).await.unwrap();
+                }
+            })
+        })
+        .collect();
+    for task in tasks {
+        task.await.unwrap();
+    }
+    start.elapsed()
+}
+
+fn loopback(c: &mut Criterion) {
+    let mut runtime = tokio::runtime::Builder::new()
+        .threaded_scheduler()
+        .enable_all()
+        .build()
+        .unwrap();
+
+    let mut group = c.benchmark_group("loopback");
+    for num_sessions in [1, 16, 256].iter().copied() {
+        // the server is shut down when its handle is dropped at the end of each pass
+        let (_server, channels, sessions) = setup(&mut runtime, num_sessions);
+        // one iteration is a single request on every session, so the reported throughput is req/s
+        // and the reported time is the mean latency of a request under this level of concurrency
+        group.throughput(Throughput::Elements(num_sessions as u64));
+        group.bench_with_input(
+            BenchmarkId::new("read 100 registers", num_sessions),
+            &sessions,
+            |b, sessions| b.iter_custom(|iters| runtime.block_on(run(sessions, iters))),
+        );
+        print_percentiles(&channels);
+    }
+    group.finish();
+}
+
+criterion_group!(benches, loopback);
+criterion_main!(benches);
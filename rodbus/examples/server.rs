@@ -50,6 +50,21 @@ impl RequestHandler for SimpleHandler {
         Self::convert(self.input_registers.get(address as usize))
     }
 
+    fn read_holding_registers(
+        &self,
+        range: AddressRange,
+        output: &mut [u16],
+    ) -> Result<(), details::ExceptionCode> {
+        // contiguous storage can service the whole range with a single copy
+        match self.holding_registers.get(range.to_std_range()) {
+            Some(values) => {
+                output.copy_from_slice(values);
+                Ok(())
+            }
+            None => Err(details::ExceptionCode::IllegalDataAddress),
+        }
+    }
+
     fn write_single_coil(&mut self, value: Indexed<bool>) -> Result<(), details::ExceptionCode> {
         log::info!(
             "write single coil, index: {} value: {}",
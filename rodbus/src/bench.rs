@@ -0,0 +1,125 @@
+//! Thin wrappers around internal types used by the benchmarks in `benches/`
+//!
+//! This module is only compiled with the `bench` feature and is not part of the public API.
+
+use crate::common::cursor::ReadCursor;
+use crate::common::frame::{FrameFormatter, FrameHeader, FramedReader, TxId};
+use crate::common::function::FunctionCode;
+use crate::decode::DecodeLevel;
+use crate::error::Error;
+use crate::server::request::Request;
+use crate::tcp::frame::{MBAPFormatter, MBAPParser};
+use crate::types::{AddressRange, BitIterator, CopyValues, RegisterIterator, UnitId};
+
+/// Parses MBAP frames from a byte stream exactly as a client or server session does
+pub struct MbapParser {
+    reader: FramedReader<MBAPParser>,
+}
+
+impl MbapParser {
+    /// Create a parser whose buffer can hold `capacity` bytes
+    pub fn new(capacity: usize) -> Self {
+        Self {
+            reader: FramedReader::with_capacity(MBAPParser::new(), capacity, DecodeLevel::Nothing),
+        }
+    }
+
+    /// Parse every complete frame in `input`, returning the total number of ADU bytes
+    pub async fn parse_all(&mut self, mut input: &[u8]) -> usize {
+        let mut total = 0;
+        while let Ok(frame) = self.reader.next_frame(&mut input).await {
+            total += frame.payload().len();
+        }
+        total
+    }
+}
+
+impl Default for MbapParser {
+    fn default() -> Self {
+        Self::new(crate::tcp::frame::constants::MAX_FRAME_LENGTH)
+    }
+}
+
+/// Formats MBAP responses exactly as a server session does
+pub struct MbapFormatter {
+    formatter: MBAPFormatter,
+}
+
+impl MbapFormatter {
+    /// Create a formatter
+    pub fn new() -> Self {
+        Self {
+            formatter: MBAPFormatter::new(DecodeLevel::Nothing),
+        }
+    }
+
+    /// Format a read holding registers response, returning the length of the frame
+    pub fn format_registers(&mut self, values: &[u16]) -> Result<usize, Error> {
+        let header = FrameHeader::new(UnitId::new(1), TxId::new(0));
+        let frame = self
+            .formatter
+            .format(header, FunctionCode::ReadHoldingRegisters, &values)?;
+        Ok(frame.len())
+    }
+
+    /// Format a read coils response, returning the length of the frame
+    pub fn format_bits(&mut self, values: &[bool]) -> Result<usize, Error> {
+        let header = FrameHeader::new(UnitId::new(1), TxId::new(0));
+        let frame = self
+            .formatter
+            .format(header, FunctionCode::ReadCoils, &values)?;
+        Ok(frame.len())
+    }
+}
+
+impl Default for MbapFormatter {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+/// Parse and iterate over packed bits, returning the number of bits that are set
+pub fn parse_bits(range: AddressRange, bytes: &[u8]) -> Result<usize, Error> {
+    let mut cursor = ReadCursor::new(bytes);
+    let iterator = BitIterator::parse_all(range, &mut cursor)?;
+    Ok(iterator.filter(|x| x.value).count())
+}
+
+/// Parse and iterate over big-endian registers, returning the sum of their values
+pub fn parse_registers(range: AddressRange, bytes: &[u8]) -> Result<u32, Error> {
+    let mut cursor = ReadCursor::new(bytes);
+    let iterator = RegisterIterator::parse_all(range, &mut cursor)?;
+    Ok(iterator.map(|x| x.value as u32).sum())
+}
+
+/// Parse packed bits and copy them into `output` in bulk, as a `ReadBuffer` does
+pub fn copy_bits(range: AddressRange, bytes: &[u8], output: &mut Vec<bool>) -> Result<(), Error> {
+    let mut cursor = ReadCursor::new(bytes);
+    let iterator = BitIterator::parse_all(range, &mut cursor)?;
+    output.clear();
+    iterator.copy_values(output);
+    Ok(())
+}
+
+/// Parse big-endian registers and copy them into `output` in bulk, as a `ReadBuffer` does
+pub fn copy_registers(
+    range: AddressRange,
+    bytes: &[u8],
+    output: &mut Vec<u16>,
+) -> Result<(), Error> {
+    let mut cursor = ReadCursor::new(bytes);
+    let iterator = RegisterIterator::parse_all(range, &mut cursor)?;
+    output.clear();
+    iterator.copy_values(output);
+    Ok(())
+}
+
+/// Parse a request PDU as the server would, returning true if it is valid
+pub fn parse_request(pdu: &[u8]) -> bool {
+    let mut cursor = ReadCursor::new(pdu);
+    let function = match cursor.read_u8().ok().and_then(FunctionCode::get) {
+        Some(x) => x,
+        None => return false,
+    };
+    Request::parse(function, &mut cursor).is_ok()
+}
@@ -0,0 +1,216 @@
+use std::convert::TryFrom;
+use std::time::Duration;
+
+use tokio::time::Instant;
+
+use crate::types::{Indexed, RawValues};
+
+/// What should be reported for a response to a poll that reports changes
+pub(crate) enum Report<'a, T> {
+    /// every value in the response
+    Full,
+    /// only the values that differ from the previous response, which may be none
+    Changes(&'a [Indexed<T>]),
+}
+
+/// Last known values of a poll, used to report only the values that have changed
+///
+/// A full report is made for the first response, the first response after a failure and
+/// once every integrity period.
+///
+/// The bytes of each response are compared with those of the previous response a word at a
+/// time, and only the values encoded in words that differ are decoded and compared. Polled
+/// values rarely change, so most responses are compared without decoding any values.
+pub(crate) struct ChangeTracker<T> {
+    integrity_period: Duration,
+    // bytes of the last response, with the words that changed since the last full report updated
+    raw: Vec<u8>,
+    values: Vec<T>,
+    // index of the first value
+    start: u16,
+    // None if the next response must be reported in full
+    next_integrity: Option<Instant>,
+    // reused for every response so that comparing doesn't allocate
+    changes: Vec<Indexed<T>>,
+}
+
+// number of bytes compared at once
+const WORD_SIZE: usize = std::mem::size_of::<u64>();
+
+fn same_word(new: &[u8], old: &[u8]) -> bool {
+    match (
+        <[u8; WORD_SIZE]>::try_from(new),
+        <[u8; WORD_SIZE]>::try_from(old),
+    ) {
+        (Ok(new), Ok(old)) => u64::from_ne_bytes(new) == u64::from_ne_bytes(old),
+        // the end of the response may be shorter than a word
+        _ => new == old,
+    }
+}
+
+impl<T> ChangeTracker<T>
+where
+    T: Copy + PartialEq,
+{
+    pub(crate) fn new(integrity_period: Duration) -> Self {
+        Self {
+            integrity_period,
+            raw: Vec::new(),
+            values: Vec::new(),
+            start: 0,
+            next_integrity: None,
+            changes: Vec::new(),
+        }
+    }
+
+    /// the values are unknown, e.g. because a read failed
+    pub(crate) fn invalidate(&mut self) {
+        self.next_integrity = None;
+    }
+
+    pub(crate) fn update<I>(&mut self, values: I, now: Instant) -> Report<'_, T>
+    where
+        I: RawValues<T>,
+    {
+        let full = match self.next_integrity {
+            Some(x) => now >= x,
+            None => true,
+        };
+
+        // a response for a different number of values can't be compared
+        if full || values.raw().len() != self.raw.len() {
+            self.raw.clear();
+            self.raw.extend_from_slice(values.raw());
+            self.start = values.clone().next().map_or(0, |x| x.index);
+            self.values.clear();
+            self.values.extend(values.map(|x| x.value));
+            self.next_integrity = Some(now + self.integrity_period);
+            return Report::Full;
+        }
+
+        self.changes.clear();
+        for (word, (new, old)) in values
+            .raw()
+            .chunks(WORD_SIZE)
+            .zip(self.raw.chunks_mut(WORD_SIZE))
+            .enumerate()
+        {
+            if same_word(new, old) {
+                continue;
+            }
+            old.copy_from_slice(new);
+            let bytes = word * WORD_SIZE..word * WORD_SIZE + new.len();
+            for point in values.raw_sub_range(bytes).into_iter().flatten() {
+                let last = match self
+                    .values
+                    .get_mut(point.index.wrapping_sub(self.start) as usize)
+                {
+                    Some(x) => x,
+                    None => continue,
+                };
+                if *last != point.value {
+                    *last = point.value;
+                    self.changes.push(point);
+                }
+            }
+        }
+        Report::Changes(self.changes.as_slice())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::common::cursor::ReadCursor;
+    use crate::types::{AddressRange, BitIterator, RegisterIterator};
+
+    fn update(
+        tracker: &mut ChangeTracker<u16>,
+        values: &[u16],
+        now: Instant,
+    ) -> Option<Vec<Indexed<u16>>> {
+        let bytes: Vec<u8> = values
+            .iter()
+            .flat_map(|x| x.to_be_bytes().to_vec())
+            .collect();
+        let range = AddressRange::try_from(10, values.len() as u16).unwrap();
+        let mut cursor = ReadCursor::new(&bytes);
+        let values = RegisterIterator::parse_all(range, &mut cursor).unwrap();
+        match tracker.update(values, now) {
+            Report::Full => None,
+            Report::Changes(x) => Some(x.to_vec()),
+        }
+    }
+
+    #[test]
+    fn reports_only_changed_values_between_integrity_reports() {
+        let mut tracker = ChangeTracker::new(Duration::from_secs(60));
+        let now = Instant::now();
+
+        assert_eq!(update(&mut tracker, &[1, 2, 3], now), None);
+        assert_eq!(update(&mut tracker, &[1, 2, 3], now), Some(vec![]));
+        assert_eq!(
+            update(&mut tracker, &[1, 5, 3], now),
+            Some(vec![Indexed::new(11, 5)])
+        );
+        // compared to the updated values, not the values of the last full report
+        assert_eq!(
+            update(&mut tracker, &[1, 5, 4], now),
+            Some(vec![Indexed::new(12, 4)])
+        );
+
+        // integrity period elapsed
+        let later = now + Duration::from_secs(60);
+        assert_eq!(update(&mut tracker, &[1, 5, 4], later), None);
+
+        // a failure makes the next report a full one
+        tracker.invalidate();
+        assert_eq!(update(&mut tracker, &[1, 5, 4], later), None);
+    }
+
+    #[test]
+    fn changes_are_found_in_every_word_of_the_response() {
+        let mut tracker = ChangeTracker::new(Duration::from_secs(60));
+        let now = Instant::now();
+        let mut values = [0u16; 11];
+
+        assert_eq!(update(&mut tracker, &values, now), None);
+        // the first, a middle and the last value, which is alone in a partial word
+        values[0] = 1;
+        values[5] = 2;
+        values[10] = 3;
+        assert_eq!(
+            update(&mut tracker, &values, now),
+            Some(vec![
+                Indexed::new(10, 1),
+                Indexed::new(15, 2),
+                Indexed::new(20, 3)
+            ])
+        );
+        assert_eq!(update(&mut tracker, &values, now), Some(vec![]));
+    }
+
+    #[test]
+    fn compares_bits_that_do_not_start_on_a_byte() {
+        let mut tracker = ChangeTracker::new(Duration::from_secs(60));
+        let now = Instant::now();
+        let mut update = |bytes: &[u8]| {
+            let range = AddressRange::try_from(0, 72).unwrap();
+            let mut cursor = ReadCursor::new(bytes);
+            let values = BitIterator::parse_all(range, &mut cursor)
+                .unwrap()
+                .sub_range(AddressRange::try_from(3, 68).unwrap());
+            match tracker.update(values, now) {
+                Report::Full => None,
+                Report::Changes(x) => Some(x.to_vec()),
+            }
+        };
+
+        assert_eq!(update(&[0; 9]), None);
+        // bits 2 and 71 are outside of the range
+        assert_eq!(
+            update(&[0b0000_1100, 0, 0, 0, 0, 0, 0, 0, 0b1100_0000]),
+            Some(vec![Indexed::new(3, true), Indexed::new(70, true)])
+        );
+    }
+}
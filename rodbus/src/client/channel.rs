@@ -1,16 +1,171 @@
 use std::net::SocketAddr;
+use std::sync::Arc;
 use std::time::Duration;
 
-use tokio::sync::mpsc;
-
-use crate::client::message::Request;
+use crate::client::poll::{Poll, PollHandle, PollHandler, PollTask};
+use crate::client::queue::{RequestQueue, RequestSenders};
 use crate::client::session::AsyncSession;
+use crate::client::task::ClientLoop;
+use crate::decode::DecodeLevel;
+use crate::metrics::{ChannelCounters, ChannelMetrics};
+use crate::socket::SocketOptions;
 use crate::tcp::client::TcpChannelTask;
 use crate::types::UnitId;
 
 /// Channel from which `AsyncSession` objects can be created to make requests
 pub struct Channel {
-    tx: mpsc::Sender<Request>,
+    tx: RequestSenders,
+    metrics: Arc<ChannelCounters>,
+}
+
+/// Priority of the requests made by a session
+///
+/// Each priority has its own request queue. The channel only takes a request from a queue
+/// when all of the higher priority queues are empty, so a command never waits behind the
+/// reads that were queued before it.
+#[derive(Copy, Clone, Debug, PartialEq, Eq, PartialOrd, Ord)]
+pub enum Priority {
+    /// control operations such as commands to a breaker
+    Control,
+    /// reads and writes made on behalf of an operator, this is the default
+    Interactive,
+    /// periodic polls, used by the poll tasks created by the channel
+    Background,
+}
+
+impl Priority {
+    pub(crate) const ALL: [Priority; 3] = [
+        Priority::Control,
+        Priority::Interactive,
+        Priority::Background,
+    ];
+}
+
+impl Default for Priority {
+    fn default() -> Self {
+        Priority::Interactive
+    }
+}
+
+/// Settings for adaptive response timeouts
+///
+/// The channel keeps a smoothed round trip time and its variance for each unit, and the
+/// timeout of each request is derived from them in the same way TCP derives its retransmission
+/// timeout. The timeout requested by the session is used until the unit first responds.
+/// Each consecutive timeout doubles the timeout of the unit, up to `max_timeout`.
+///
+/// Requests to a unit that has timed out `failure_threshold` times in a row fail immediately with
+/// `Error::UnitUnavailable`. Once `retry_delay` has passed, a single request is sent to probe
+/// the unit. A response to it closes the breaker, a timeout keeps it open for another delay.
+#[derive(Copy, Clone, Debug, PartialEq)]
+pub struct AdaptiveTimeout {
+    /// Lower bound on the timeout of a request
+    pub min_timeout: Duration,
+    /// Upper bound on the timeout of a request
+    pub max_timeout: Duration,
+    /// Number of consecutive timeouts after which requests to a unit fail without being sent.
+    /// A value of 0 disables this behavior.
+    pub failure_threshold: u16,
+    /// Time that requests to a unit fail without being sent before the unit is probed again
+    pub retry_delay: Duration,
+}
+
+impl AdaptiveTimeout {
+    /// Create settings with the specified bounds, the breaker opens after 3 consecutive
+    /// timeouts and the unit is probed again every 10 seconds
+    pub fn new(min_timeout: Duration, max_timeout: Duration) -> Self {
+        Self {
+            min_timeout,
+            max_timeout,
+            failure_threshold: 3,
+            retry_delay: Duration::from_secs(10),
+        }
+    }
+}
+
+/// Settings that control how a channel task processes the requests in its queue
+#[derive(Copy, Clone, Debug, PartialEq)]
+pub struct ChannelOptions {
+    /// Maximum number of requests that may be outstanding (sent, but not yet answered) on the
+    /// connection at any given time. Responses are matched to requests by transaction id.
+    ///
+    /// The default value of 1 disables pipelining, i.e. the channel waits for each response
+    /// before sending the next request. A value of 0 is treated as 1.
+    pub max_in_flight: u16,
+    /// Level of detail used when logging the frames sent and received on the channel
+    pub decode: DecodeLevel,
+    /// Merge reads that are waiting in the request queue into a single request when they
+    /// target the same unit with the same function and their ranges overlap or are adjacent.
+    /// The response is split back out to each of the original reads.
+    ///
+    /// Reads are never moved ahead of a queued write. An exception response to a merged
+    /// read fails all of the reads that were merged into it.
+    pub coalesce_reads: bool,
+    /// Combine single writes that are waiting in the request queue into a write multiple
+    /// coils or registers request when they target consecutive, increasing addresses on the
+    /// same unit. Each of the original writes completes when the response arrives.
+    ///
+    /// Only writes that immediately follow each other in the queue are combined, so the order
+    /// of the requests is preserved. Leave this disabled for devices that treat single and
+    /// multiple writes differently.
+    pub coalesce_writes: bool,
+    /// Maximum number of requests that may be waiting in the queue of `Priority::Control`.
+    /// The `max_queued_requests` of the channel applies to the `Priority::Interactive` queue.
+    pub control_queue_depth: usize,
+    /// Maximum number of requests that may be waiting in the queue of `Priority::Background`
+    pub background_queue_depth: usize,
+    /// Minimum silence that RTU channels keep on the line between receiving a frame and
+    /// sending the next request. After a corrupted frame, a reply that doesn't match the
+    /// request or a timeout, received bytes are discarded until the line has been idle this
+    /// long. Use [`serial_inter_frame_delay`] to obtain the delay required by a serial line.
+    /// Ignored by TCP channels.
+    ///
+    /// [`serial_inter_frame_delay`]: #method.serial_inter_frame_delay
+    pub inter_frame_delay: Duration,
+    /// Derive the timeout of each request from the round trip times measured to its unit
+    /// instead of using the fixed timeout of the session. Disabled by default.
+    pub adaptive_timeout: Option<AdaptiveTimeout>,
+    /// Settings applied to the socket of each TCP connection. Only the read buffer size
+    /// applies to RTU channels over a stream provided by the caller.
+    pub socket: SocketOptions,
+}
+
+impl ChannelOptions {
+    /// Create options with the specified pipelining window
+    pub fn new(max_in_flight: u16) -> Self {
+        Self {
+            max_in_flight,
+            decode: DecodeLevel::default(),
+            coalesce_reads: false,
+            coalesce_writes: false,
+            control_queue_depth: 16,
+            background_queue_depth: 64,
+            inter_frame_delay: Duration::from_secs(0),
+            adaptive_timeout: None,
+            socket: SocketOptions::default(),
+        }
+    }
+
+    /// The silence of 3.5 character times that separates RTU frames on a serial line with
+    /// 11 bits per character. Above 19200 baud the fixed value of 1.75 ms recommended
+    /// by the specification is used.
+    pub fn serial_inter_frame_delay(baud_rate: u32) -> Duration {
+        if baud_rate == 0 || baud_rate > 19200 {
+            return Duration::from_micros(1750);
+        }
+        // 3.5 characters * 11 bits
+        Duration::from_micros(38_500_000 / baud_rate as u64)
+    }
+
+    pub(crate) fn window(&self) -> usize {
+        std::cmp::max(self.max_in_flight, 1) as usize
+    }
+}
+
+impl Default for ChannelOptions {
+    fn default() -> Self {
+        Self::new(1)
+    }
 }
 
 /// Dynamic trait that controls how the channel
@@ -73,8 +228,10 @@ impl Channel {
         addr: SocketAddr,
         max_queued_requests: usize,
         connect_retry: Box<dyn ReconnectStrategy + Send>,
+        options: ChannelOptions,
     ) -> Self {
-        let (handle, task) = Self::create_handle_and_task(addr, max_queued_requests, connect_retry);
+        let (handle, task) =
+            Self::create_handle_and_task(addr, max_queued_requests, connect_retry, options);
         tokio::spawn(task);
         handle
     }
@@ -83,14 +240,135 @@ impl Channel {
         addr: SocketAddr,
         max_queued_requests: usize,
         connect_retry: Box<dyn ReconnectStrategy + Send>,
+        options: ChannelOptions,
+    ) -> (Self, impl std::future::Future<Output = ()>) {
+        let (channel, rx) = Self::create_queue(max_queued_requests, &options);
+        let metrics = channel.metrics.clone();
+        let task = async move {
+            let client_loop = ClientLoop::new(rx, options, metrics.clone());
+            TcpChannelTask::new(addr, client_loop, connect_retry, options.socket, metrics)
+                .run()
+                .await
+        };
+        (channel, task)
+    }
+
+    pub(crate) fn create_rtu_over_tcp_handle_and_task(
+        addr: SocketAddr,
+        max_queued_requests: usize,
+        connect_retry: Box<dyn ReconnectStrategy + Send>,
+        options: ChannelOptions,
     ) -> (Self, impl std::future::Future<Output = ()>) {
-        let (tx, rx) = mpsc::channel(max_queued_requests);
-        let task = async move { TcpChannelTask::new(addr, rx, connect_retry).run().await };
-        (Channel { tx }, task)
+        let (channel, rx) = Self::create_queue(max_queued_requests, &options);
+        let metrics = channel.metrics.clone();
+        let task = async move {
+            let client_loop = ClientLoop::rtu(rx, options, metrics.clone());
+            TcpChannelTask::new(addr, client_loop, connect_retry, options.socket, metrics)
+                .run()
+                .await
+        };
+        (channel, task)
+    }
+
+    pub(crate) fn create_rtu_handle_and_task<T>(
+        io: T,
+        max_queued_requests: usize,
+        options: ChannelOptions,
+    ) -> (Self, impl std::future::Future<Output = ()>)
+    where
+        T: tokio::io::AsyncRead + tokio::io::AsyncWrite + Unpin,
+    {
+        let (channel, rx) = Self::create_queue(max_queued_requests, &options);
+        let metrics = channel.metrics.clone();
+        let task = async move {
+            let client_loop = ClientLoop::rtu(rx, options, metrics);
+            crate::rtu::client::run_stream(client_loop, io).await
+        };
+        (channel, task)
+    }
+
+    fn create_queue(max_queued_requests: usize, options: &ChannelOptions) -> (Self, RequestQueue) {
+        let (tx, rx) = RequestQueue::create(
+            options.control_queue_depth,
+            max_queued_requests,
+            options.background_queue_depth,
+        );
+        let metrics = Arc::new(ChannelCounters::default());
+        (Channel { tx, metrics }, rx)
     }
 
     /// Create an `AsyncSession` struct that can be used to make requests
     pub fn create_session(&self, id: UnitId, response_timeout: Duration) -> AsyncSession {
-        AsyncSession::new(id, response_timeout, self.tx.clone())
+        self.create_session_with_priority(id, response_timeout, Priority::default())
+    }
+
+    /// Create an `AsyncSession` whose requests are sent through the queue of a particular priority
+    pub fn create_session_with_priority(
+        &self,
+        id: UnitId,
+        response_timeout: Duration,
+        priority: Priority,
+    ) -> AsyncSession {
+        AsyncSession::new(id, response_timeout, self.tx.get(priority))
+    }
+
+    /// Spawn a task onto the runtime that periodically performs the polls through this channel.
+    /// This method can only be called from within the runtime context.
+    ///
+    /// * `polls` - The reads to perform, results are identified by their index in this list
+    /// * `response_timeout` - The response timeout applied to every read
+    /// * `handler` - Receives the results of the reads
+    ///
+    /// The reads are sent through the `Priority::Background` queue. The task stops when the
+    /// returned handle is dropped or the channel shuts down.
+    pub fn spawn_poll_task<H>(
+        &self,
+        polls: Vec<Poll>,
+        response_timeout: Duration,
+        handler: H,
+    ) -> PollHandle
+    where
+        H: PollHandler,
+    {
+        let (handle, task) = self.create_poll_task(polls, response_timeout, handler);
+        tokio::spawn(task);
+        handle
+    }
+
+    /// Same as [`spawn_poll_task`], but the task is returned so that it can be spawned
+    /// manually, e.g. using a Runtime handle from outside the runtime.
+    ///
+    /// [`spawn_poll_task`]: #method.spawn_poll_task
+    pub fn create_poll_task<H>(
+        &self,
+        polls: Vec<Poll>,
+        response_timeout: Duration,
+        handler: H,
+    ) -> (PollHandle, impl std::future::Future<Output = ()>)
+    where
+        H: PollHandler,
+    {
+        let (handle, mut task) = PollTask::create(
+            polls,
+            response_timeout,
+            Arc::new(handler),
+            self.tx.get(Priority::Background),
+        );
+        (handle, async move { task.run().await })
+    }
+
+    /// Take a snapshot of the counters maintained by the channel task
+    ///
+    /// The counters are updated with atomic operations, so the snapshot never blocks the task
+    pub fn metrics(&self) -> ChannelMetrics {
+        self.metrics.snapshot()
+    }
+
+    pub(crate) fn senders(&self) -> RequestSenders {
+        self.tx.clone()
+    }
+
+    pub(crate) fn counters(&self) -> Arc<ChannelCounters> {
+        self.metrics.clone()
     }
 }
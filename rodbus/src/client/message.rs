@@ -2,10 +2,12 @@ use crate::common::function::FunctionCode;
 use crate::error::details::{ADUParseError, ExceptionCode};
 use crate::error::*;
 
+use crate::client::pool::Outstanding;
 use crate::client::requests::read_bits::ReadBits;
 use crate::client::requests::read_registers::ReadRegisters;
+use crate::client::requests::read_write_registers::ReadWriteRegisters;
 use crate::client::requests::write_multiple::MultipleWrite;
-use crate::client::requests::write_single::SingleWrite;
+use crate::client::requests::write_single::{SingleWrite, SingleWriteOperation};
 use crate::common::cursor::{ReadCursor, WriteCursor};
 use crate::common::traits::Serialize;
 use crate::types::{Indexed, UnitId};
@@ -16,6 +18,8 @@ pub(crate) struct Request {
     pub(crate) id: UnitId,
     pub(crate) timeout: Duration,
     pub(crate) details: RequestDetails,
+    // set when the request is sent through a connection of a pool
+    pub(crate) outstanding: Option<Outstanding>,
 }
 
 // possible requests that can be sent through the channel
@@ -28,6 +32,7 @@ pub(crate) enum RequestDetails {
     WriteSingleRegister(SingleWrite<Indexed<u16>>),
     WriteMultipleCoils(MultipleWrite<bool>),
     WriteMultipleRegisters(MultipleWrite<u16>),
+    ReadWriteMultipleRegisters(ReadWriteRegisters),
 }
 
 impl Request {
@@ -36,6 +41,58 @@ impl Request {
             id,
             timeout,
             details,
+            outstanding: None,
+        }
+    }
+
+    /// merge another read into this one if both target the same unit with the same function
+    /// and their ranges can be combined into a single request, otherwise the request is returned
+    pub(crate) fn coalesce(&mut self, other: Request) -> Result<(), Request> {
+        let Request {
+            id,
+            timeout,
+            details,
+            outstanding,
+        } = other;
+
+        if id != self.id {
+            return Err(Request {
+                id,
+                timeout,
+                details,
+                outstanding,
+            });
+        }
+
+        let result = match (&mut self.details, details) {
+            (RequestDetails::ReadCoils(x), RequestDetails::ReadCoils(y)) => {
+                x.merge(y).map_err(RequestDetails::ReadCoils)
+            }
+            (RequestDetails::ReadDiscreteInputs(x), RequestDetails::ReadDiscreteInputs(y)) => {
+                x.merge(y).map_err(RequestDetails::ReadDiscreteInputs)
+            }
+            (RequestDetails::ReadHoldingRegisters(x), RequestDetails::ReadHoldingRegisters(y)) => {
+                x.merge(y).map_err(RequestDetails::ReadHoldingRegisters)
+            }
+            (RequestDetails::ReadInputRegisters(x), RequestDetails::ReadInputRegisters(y)) => {
+                x.merge(y).map_err(RequestDetails::ReadInputRegisters)
+            }
+            (_, details) => Err(details),
+        };
+
+        match result {
+            Ok(()) => {
+                // the merged request must be answered before any of the reads times out
+                self.timeout = std::cmp::min(self.timeout, timeout);
+                self.outstanding = Outstanding::merge(self.outstanding.take(), outstanding);
+                Ok(())
+            }
+            Err(details) => Err(Request {
+                id,
+                timeout,
+                details,
+                outstanding,
+            }),
         }
     }
 
@@ -78,6 +135,126 @@ impl Request {
     }
 }
 
+/// Single writes to consecutive addresses on the same unit that are sent as one multiple write
+pub(crate) struct WriteRun {
+    id: UnitId,
+    timeout: Duration,
+    writes: WriteRunKind,
+    outstanding: Option<Outstanding>,
+}
+
+enum WriteRunKind {
+    Coils(Vec<SingleWrite<Indexed<bool>>>),
+    Registers(Vec<SingleWrite<Indexed<u16>>>),
+}
+
+impl WriteRun {
+    /// start a run with a single write, any other request is returned
+    pub(crate) fn start(request: Request) -> Result<Self, Request> {
+        let writes = match request.details {
+            RequestDetails::WriteSingleCoil(x) => WriteRunKind::Coils(vec![x]),
+            RequestDetails::WriteSingleRegister(x) => WriteRunKind::Registers(vec![x]),
+            _ => return Err(request),
+        };
+        Ok(Self {
+            id: request.id,
+            timeout: request.timeout,
+            writes,
+            outstanding: request.outstanding,
+        })
+    }
+
+    /// add a write to the run if it targets the address after the last write in the run and
+    /// the run fits in a single request, otherwise the request is returned
+    pub(crate) fn push(&mut self, request: Request) -> Result<(), Request> {
+        let Request {
+            id,
+            timeout,
+            details,
+            outstanding,
+        } = request;
+
+        if id != self.id {
+            return Err(Request {
+                id,
+                timeout,
+                details,
+                outstanding,
+            });
+        }
+
+        let result = match (&mut self.writes, details) {
+            (WriteRunKind::Coils(writes), RequestDetails::WriteSingleCoil(x)) => {
+                Self::extend(writes, x, crate::constants::limits::MAX_WRITE_COILS_COUNT)
+                    .map_err(RequestDetails::WriteSingleCoil)
+            }
+            (WriteRunKind::Registers(writes), RequestDetails::WriteSingleRegister(x)) => {
+                Self::extend(
+                    writes,
+                    x,
+                    crate::constants::limits::MAX_WRITE_REGISTERS_COUNT,
+                )
+                .map_err(RequestDetails::WriteSingleRegister)
+            }
+            (_, details) => Err(details),
+        };
+
+        match result {
+            Ok(()) => {
+                self.timeout = std::cmp::min(self.timeout, timeout);
+                self.outstanding = Outstanding::merge(self.outstanding.take(), outstanding);
+                Ok(())
+            }
+            Err(details) => Err(Request {
+                id,
+                timeout,
+                details,
+                outstanding,
+            }),
+        }
+    }
+
+    fn extend<T>(
+        writes: &mut Vec<SingleWrite<Indexed<T>>>,
+        write: SingleWrite<Indexed<T>>,
+        limit: u16,
+    ) -> Result<(), SingleWrite<Indexed<T>>>
+    where
+        Indexed<T>: SingleWriteOperation,
+    {
+        let next = writes.last().and_then(|x| x.index().checked_add(1));
+        if next != Some(write.index()) || writes.len() >= limit as usize {
+            return Err(write);
+        }
+        writes.push(write);
+        Ok(())
+    }
+
+    /// a run of one write is sent unchanged, otherwise the writes are combined
+    pub(crate) fn finish(self) -> Request {
+        let details = match self.writes {
+            WriteRunKind::Coils(mut writes) if writes.len() == 1 => {
+                RequestDetails::WriteSingleCoil(writes.remove(0))
+            }
+            WriteRunKind::Coils(writes) => {
+                RequestDetails::WriteMultipleCoils(SingleWrite::combine(writes))
+            }
+            WriteRunKind::Registers(mut writes) if writes.len() == 1 => {
+                RequestDetails::WriteSingleRegister(writes.remove(0))
+            }
+            WriteRunKind::Registers(writes) => {
+                RequestDetails::WriteMultipleRegisters(SingleWrite::combine(writes))
+            }
+        };
+        Request {
+            id: self.id,
+            timeout: self.timeout,
+            details,
+            outstanding: self.outstanding,
+        }
+    }
+}
+
 impl RequestDetails {
     pub(crate) fn function(&self) -> FunctionCode {
         match self {
@@ -89,6 +266,23 @@ impl RequestDetails {
             RequestDetails::WriteSingleRegister(_) => FunctionCode::WriteSingleRegister,
             RequestDetails::WriteMultipleCoils(_) => FunctionCode::WriteMultipleCoils,
             RequestDetails::WriteMultipleRegisters(_) => FunctionCode::WriteMultipleRegisters,
+            RequestDetails::ReadWriteMultipleRegisters(_) => {
+                FunctionCode::ReadWriteMultipleRegisters
+            }
+        }
+    }
+
+    pub(crate) fn is_read(&self) -> bool {
+        match self {
+            RequestDetails::ReadCoils(_)
+            | RequestDetails::ReadDiscreteInputs(_)
+            | RequestDetails::ReadHoldingRegisters(_)
+            | RequestDetails::ReadInputRegisters(_) => true,
+            RequestDetails::WriteSingleCoil(_)
+            | RequestDetails::WriteSingleRegister(_)
+            | RequestDetails::WriteMultipleCoils(_)
+            | RequestDetails::WriteMultipleRegisters(_)
+            | RequestDetails::ReadWriteMultipleRegisters(_) => false,
         }
     }
 
@@ -102,6 +296,7 @@ impl RequestDetails {
             RequestDetails::WriteSingleRegister(x) => x.failure(err),
             RequestDetails::WriteMultipleCoils(x) => x.failure(err),
             RequestDetails::WriteMultipleRegisters(x) => x.failure(err),
+            RequestDetails::ReadWriteMultipleRegisters(x) => x.failure(err),
         }
     }
 
@@ -115,6 +310,7 @@ impl RequestDetails {
             RequestDetails::WriteSingleRegister(x) => x.handle_response(cursor),
             RequestDetails::WriteMultipleCoils(x) => x.handle_response(cursor),
             RequestDetails::WriteMultipleRegisters(x) => x.handle_response(cursor),
+            RequestDetails::ReadWriteMultipleRegisters(x) => x.handle_response(cursor),
         }
     }
 }
@@ -130,6 +326,7 @@ impl Serialize for RequestDetails {
             RequestDetails::WriteSingleRegister(x) => x.serialize(cursor),
             RequestDetails::WriteMultipleCoils(x) => x.serialize(cursor),
             RequestDetails::WriteMultipleRegisters(x) => x.serialize(cursor),
+            RequestDetails::ReadWriteMultipleRegisters(x) => x.serialize(cursor),
         }
     }
 }
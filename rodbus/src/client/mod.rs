@@ -1,16 +1,27 @@
 use std::net::SocketAddr;
 
-use crate::client::channel::{Channel, ReconnectStrategy};
+use crate::client::channel::{Channel, ChannelOptions, ReconnectStrategy};
+use crate::client::pool::{ChannelPool, Distribution};
 
 /// persistent communication channel such as a TCP connection
 pub mod channel;
 
+/// periodic reads scheduled by a channel
+pub mod poll;
+
+/// multiple connections to the same server used as a single channel
+pub mod pool;
+
 /// API used to communicate with the server
 pub mod session;
 
+pub(crate) mod changes;
 pub(crate) mod message;
+pub(crate) mod queue;
 pub(crate) mod requests;
+pub(crate) mod slot;
 pub(crate) mod task;
+pub(crate) mod timeout;
 
 /// Spawns a channel task onto the runtime that maintains a TCP connection and processes
 /// requests from an mpsc request queue. The task completes when the returned channel handle
@@ -28,7 +39,61 @@ pub fn spawn_tcp_client_task(
     max_queued_requests: usize,
     retry: Box<dyn ReconnectStrategy + Send>,
 ) -> Channel {
-    Channel::new(addr, max_queued_requests, retry)
+    Channel::new(addr, max_queued_requests, retry, ChannelOptions::default())
+}
+
+/// Same as [`spawn_tcp_client_task`], but allows the caller to specify [`ChannelOptions`]
+/// such as the number of requests that may be pipelined on the connection.
+///
+/// * `addr` - Socket address of the remote server
+/// * `max_queued_requests` - The maximum size of the request queue
+/// * `retry` - A boxed trait object that controls when the connection is retried on failure
+/// * `options` - Settings that control how requests are processed
+///
+/// [`spawn_tcp_client_task`]: fn.spawn_tcp_client_task.html
+/// [`ChannelOptions`]: ./channel/struct.ChannelOptions.html
+pub fn spawn_tcp_client_task_with_options(
+    addr: SocketAddr,
+    max_queued_requests: usize,
+    retry: Box<dyn ReconnectStrategy + Send>,
+    options: ChannelOptions,
+) -> Channel {
+    Channel::new(addr, max_queued_requests, retry, options)
+}
+
+/// Spawns `size` channel tasks onto the runtime that each maintain a TCP connection to the
+/// same server, and a task that distributes requests across them if required by the
+/// [`Distribution`]. The tasks complete when the returned pool and all derived session handles
+/// are dropped.
+///
+/// * `addr` - Socket address of the remote server
+/// * `size` - The number of connections, a size of 0 is treated as 1
+/// * `max_queued_requests` - The maximum size of the request queue of each connection
+/// * `retry` - Called once per connection to create the strategy that controls when the
+/// connection is retried on failure, e.g. `strategy::default`
+/// * `options` - Settings that control how requests are processed, applied to each connection
+/// * `distribution` - How requests are assigned to the connections
+///
+/// [`Distribution`]: ./pool/enum.Distribution.html
+pub fn spawn_tcp_client_pool<F>(
+    addr: SocketAddr,
+    size: usize,
+    max_queued_requests: usize,
+    retry: F,
+    options: ChannelOptions,
+    distribution: Distribution,
+) -> ChannelPool
+where
+    F: FnMut() -> Box<dyn ReconnectStrategy + Send>,
+{
+    ChannelPool::new(
+        addr,
+        size,
+        max_queued_requests,
+        retry,
+        options,
+        distribution,
+    )
 }
 
 /// Creates a channel task, but does not spawn it. Most users will prefer
@@ -48,5 +113,101 @@ pub fn create_handle_and_task(
     max_queued_requests: usize,
     retry: Box<dyn ReconnectStrategy + Send>,
 ) -> (Channel, impl std::future::Future<Output = ()>) {
-    Channel::create_handle_and_task(addr, max_queued_requests, retry)
+    Channel::create_handle_and_task(addr, max_queued_requests, retry, ChannelOptions::default())
+}
+
+/// Same as [`create_handle_and_task`], but allows the caller to specify [`ChannelOptions`]
+///
+/// * `addr` - Socket address of the remote server
+/// * `max_queued_requests` - The maximum size of the request queue
+/// * `retry` - A boxed trait object that controls when the connection is retried on failure
+/// * `options` - Settings that control how requests are processed
+///
+/// [`create_handle_and_task`]: fn.create_handle_and_task.html
+/// [`ChannelOptions`]: ./channel/struct.ChannelOptions.html
+pub fn create_handle_and_task_with_options(
+    addr: SocketAddr,
+    max_queued_requests: usize,
+    retry: Box<dyn ReconnectStrategy + Send>,
+    options: ChannelOptions,
+) -> (Channel, impl std::future::Future<Output = ()>) {
+    Channel::create_handle_and_task(addr, max_queued_requests, retry, options)
+}
+
+/// Spawns a channel task onto the runtime that maintains a TCP connection to a gateway that
+/// forwards Modbus RTU frames, e.g. a serial device server. The frames on the connection are
+/// RTU frames (unit id, ADU and CRC) instead of MBAP frames.
+///
+/// RTU frames have no transaction id, so requests are made one at a time and
+/// `max_in_flight` is ignored.
+///
+/// * `addr` - Socket address of the gateway
+/// * `max_queued_requests` - The maximum size of the request queue
+/// * `retry` - A boxed trait object that controls when the connection is retried on failure
+/// * `options` - Settings that control how requests are processed
+pub fn spawn_rtu_over_tcp_client_task(
+    addr: SocketAddr,
+    max_queued_requests: usize,
+    retry: Box<dyn ReconnectStrategy + Send>,
+    options: ChannelOptions,
+) -> Channel {
+    let (channel, task) =
+        Channel::create_rtu_over_tcp_handle_and_task(addr, max_queued_requests, retry, options);
+    tokio::spawn(task);
+    channel
+}
+
+/// Same as [`spawn_rtu_over_tcp_client_task`], but the task is returned so that it can be
+/// spawned manually
+///
+/// [`spawn_rtu_over_tcp_client_task`]: fn.spawn_rtu_over_tcp_client_task.html
+pub fn create_rtu_over_tcp_handle_and_task(
+    addr: SocketAddr,
+    max_queued_requests: usize,
+    retry: Box<dyn ReconnectStrategy + Send>,
+    options: ChannelOptions,
+) -> (Channel, impl std::future::Future<Output = ()>) {
+    Channel::create_rtu_over_tcp_handle_and_task(addr, max_queued_requests, retry, options)
+}
+
+/// Spawns a channel task onto the runtime that exchanges Modbus RTU frames over a stream
+/// provided by the caller, such as a serial port
+///
+/// Set `options.inter_frame_delay` to [`ChannelOptions::serial_inter_frame_delay`] for the baud
+/// rate of the port so that the line is silent between frames. A corrupted frame is discarded
+/// along with the bytes that follow it until the line is idle, and the channel continues on
+/// the same stream. If the stream fails, every request fails
+/// with `Error::NoConnection` until the channel is dropped.
+///
+/// * `io` - The stream, which must already be configured and open
+/// * `max_queued_requests` - The maximum size of the request queue
+/// * `options` - Settings that control how requests are processed
+///
+/// [`ChannelOptions::serial_inter_frame_delay`]: ./channel/struct.ChannelOptions.html#method.serial_inter_frame_delay
+pub fn spawn_rtu_client_task<T>(
+    io: T,
+    max_queued_requests: usize,
+    options: ChannelOptions,
+) -> Channel
+where
+    T: tokio::io::AsyncRead + tokio::io::AsyncWrite + Unpin + Send + 'static,
+{
+    let (channel, task) = Channel::create_rtu_handle_and_task(io, max_queued_requests, options);
+    tokio::spawn(task);
+    channel
+}
+
+/// Same as [`spawn_rtu_client_task`], but the task is returned so that it can be spawned
+/// manually
+///
+/// [`spawn_rtu_client_task`]: fn.spawn_rtu_client_task.html
+pub fn create_rtu_handle_and_task<T>(
+    io: T,
+    max_queued_requests: usize,
+    options: ChannelOptions,
+) -> (Channel, impl std::future::Future<Output = ()>)
+where
+    T: tokio::io::AsyncRead + tokio::io::AsyncWrite + Unpin,
+{
+    Channel::create_rtu_handle_and_task(io, max_queued_requests, options)
 }
@@ -0,0 +1,478 @@
+use std::cmp::Reverse;
+use std::collections::BinaryHeap;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Arc, Mutex, MutexGuard};
+use std::time::Duration;
+
+use tokio::sync::mpsc;
+use tokio::time::Instant;
+
+use crate::client::changes::{ChangeTracker, Report};
+use crate::client::message::{Request, RequestDetails};
+use crate::client::requests::read_bits::ReadBits;
+use crate::client::requests::read_registers::ReadRegisters;
+use crate::error::*;
+use crate::types::{AddressRange, BitIterator, Indexed, RegisterIterator, UnitId};
+
+// a period of zero would make the task spin, so this is the shortest period that's honored
+const MIN_PERIOD: Duration = Duration::from_millis(1);
+
+/// Type of read performed by a [`Poll`]
+///
+/// [`Poll`]: struct.Poll.html
+#[derive(Copy, Clone, Debug, PartialEq)]
+pub enum PollKind {
+    /// read a range of coils
+    ReadCoils,
+    /// read a range of discrete inputs
+    ReadDiscreteInputs,
+    /// read a range of holding registers
+    ReadHoldingRegisters,
+    /// read a range of input registers
+    ReadInputRegisters,
+}
+
+/// A read that a poll task performs periodically
+#[derive(Copy, Clone, Debug, PartialEq)]
+pub struct Poll {
+    /// unit id of the device to read
+    pub id: UnitId,
+    /// type of read to perform
+    pub kind: PollKind,
+    /// range of addresses to read
+    pub range: AddressRange,
+    /// time between the start of each read, a period of zero is treated as 1 ms
+    pub period: Duration,
+    /// If set, only the values that changed since the previous response are reported, and
+    /// every value is reported once per integrity period. See [`report_changes`].
+    ///
+    /// [`report_changes`]: #method.report_changes
+    pub integrity_period: Option<Duration>,
+}
+
+impl Poll {
+    /// Create a poll definition
+    pub fn new(id: UnitId, kind: PollKind, range: AddressRange, period: Duration) -> Self {
+        Self {
+            id,
+            kind,
+            range,
+            period,
+            integrity_period: None,
+        }
+    }
+
+    /// Report only the values that have changed instead of every response
+    ///
+    /// The first response, the first response after a failure and the first response once
+    /// `integrity_period` has elapsed since the last full report are passed to `on_bits` or
+    /// `on_registers` as usual. Any other response is compared to the previous one and only
+    /// the values that differ are passed to `on_bit_changes` or `on_register_changes`. If
+    /// nothing changed, no callback is made. Failures are always reported.
+    pub fn report_changes(self, integrity_period: Duration) -> Self {
+        Self {
+            integrity_period: Some(integrity_period),
+            ..self
+        }
+    }
+}
+
+/// Receives the results of the polls performed by a poll task
+///
+/// Each result is identified by the index of the poll in the list provided when the task
+/// was created. The callbacks are invoked from the channel task and must not block.
+pub trait PollHandler: Send + Sync + 'static {
+    /// Called when a coil or discrete input poll completes or fails
+    fn on_bits(&self, index: usize, result: Result<BitIterator, Error>);
+    /// Called when a holding or input register poll completes or fails
+    fn on_registers(&self, index: usize, result: Result<RegisterIterator, Error>);
+    /// Called with the values that changed when a coil or discrete input poll created with
+    /// [`Poll::report_changes`] completes. The default implementation ignores the changes.
+    ///
+    /// [`Poll::report_changes`]: struct.Poll.html#method.report_changes
+    fn on_bit_changes(&self, _index: usize, _changes: &[Indexed<bool>]) {}
+    /// Called with the values that changed when a holding or input register poll created with
+    /// [`Poll::report_changes`] completes. The default implementation ignores the changes.
+    ///
+    /// [`Poll::report_changes`]: struct.Poll.html#method.report_changes
+    fn on_register_changes(&self, _index: usize, _changes: &[Indexed<u16>]) {}
+}
+
+type Tracker<T> = Option<Arc<Mutex<ChangeTracker<T>>>>;
+
+fn lock<T>(tracker: &Mutex<ChangeTracker<T>>) -> MutexGuard<'_, ChangeTracker<T>> {
+    // a tracker left in any state only affects which values are reported next
+    match tracker.lock() {
+        Ok(x) => x,
+        Err(x) => x.into_inner(),
+    }
+}
+
+fn create_trackers<T>(polls: &[Poll], bits: bool) -> Vec<Tracker<T>>
+where
+    T: Copy + PartialEq,
+{
+    polls
+        .iter()
+        .map(|poll| {
+            let is_bits = match poll.kind {
+                PollKind::ReadCoils | PollKind::ReadDiscreteInputs => true,
+                PollKind::ReadHoldingRegisters | PollKind::ReadInputRegisters => false,
+            };
+            match poll.integrity_period {
+                Some(period) if is_bits == bits => {
+                    Some(Arc::new(Mutex::new(ChangeTracker::new(period))))
+                }
+                _ => None,
+            }
+        })
+        .collect()
+}
+
+/// Handle to a poll task created by [`Channel::create_poll_task`]. The task stops when
+/// the handle is dropped.
+///
+/// [`Channel::create_poll_task`]: ../channel/struct.Channel.html#method.create_poll_task
+pub struct PollHandle {
+    _stop: mpsc::Sender<()>,
+}
+
+/// Issues a list of polls through the request queue of a channel
+///
+/// The next deadline of every poll is kept in a min-heap so that a single timer services
+/// the whole table. Deadlines advance by exactly one period, so the polls don't drift.
+pub(crate) struct PollTask {
+    polls: Vec<Poll>,
+    response_timeout: Duration,
+    handler: Arc<dyn PollHandler>,
+    requests: mpsc::Sender<Request>,
+    stop: mpsc::Receiver<()>,
+    // set while a poll's request is queued or in flight so a slow device doesn't accumulate requests
+    busy: Arc<Vec<AtomicBool>>,
+    // last known values of the polls that report changes
+    bit_trackers: Vec<Tracker<bool>>,
+    register_trackers: Vec<Tracker<u16>>,
+    schedule: BinaryHeap<Reverse<(Instant, usize)>>,
+}
+
+impl PollTask {
+    pub(crate) fn create(
+        polls: Vec<Poll>,
+        response_timeout: Duration,
+        handler: Arc<dyn PollHandler>,
+        requests: mpsc::Sender<Request>,
+    ) -> (PollHandle, Self) {
+        let (tx, rx) = mpsc::channel(1);
+        let busy = polls.iter().map(|_| AtomicBool::new(false)).collect();
+        let bit_trackers = create_trackers(&polls, true);
+        let register_trackers = create_trackers(&polls, false);
+        let task = Self {
+            polls,
+            response_timeout,
+            handler,
+            requests,
+            stop: rx,
+            busy: Arc::new(busy),
+            bit_trackers,
+            register_trackers,
+            schedule: BinaryHeap::new(),
+        };
+        (PollHandle { _stop: tx }, task)
+    }
+
+    pub(crate) async fn run(&mut self) {
+        let now = Instant::now();
+        for index in 0..self.polls.len() {
+            self.schedule.push(Reverse((now, index)));
+        }
+
+        loop {
+            let (deadline, index) = match self.schedule.peek() {
+                Some(Reverse(x)) => *x,
+                None => {
+                    // nothing to poll, just wait for the handle to be dropped
+                    self.stop.recv().await;
+                    return;
+                }
+            };
+
+            tokio::select! {
+                _ = self.stop.recv() => return,
+                _ = tokio::time::delay_until(deadline) => {}
+            }
+
+            self.schedule.pop();
+            if self.issue(index).await.is_err() {
+                // the channel has shut down
+                return;
+            }
+
+            let period = std::cmp::max(self.polls[index].period, MIN_PERIOD);
+            let next = next_deadline(deadline, period, Instant::now());
+            self.schedule.push(Reverse((next, index)));
+        }
+    }
+
+    async fn issue(&mut self, index: usize) -> Result<(), Error> {
+        if self.busy[index].swap(true, Ordering::AcqRel) {
+            // skip this period, the previous read hasn't completed yet
+            return Ok(());
+        }
+
+        let poll = self.polls[index];
+        let details = match poll.kind {
+            PollKind::ReadCoils => self.read_bits(index, poll.range, RequestDetails::ReadCoils),
+            PollKind::ReadDiscreteInputs => {
+                self.read_bits(index, poll.range, RequestDetails::ReadDiscreteInputs)
+            }
+            PollKind::ReadHoldingRegisters => {
+                self.read_registers(index, poll.range, RequestDetails::ReadHoldingRegisters)
+            }
+            PollKind::ReadInputRegisters => {
+                self.read_registers(index, poll.range, RequestDetails::ReadInputRegisters)
+            }
+        };
+
+        let details = match details {
+            Some(x) => x,
+            // the range is invalid, the handler has already been notified
+            None => return Ok(()),
+        };
+
+        let request = Request::new(poll.id, self.response_timeout, details);
+        if let Err(mpsc::error::SendError(x)) = self.requests.send(request).await {
+            x.details.fail(Error::Shutdown);
+            return Err(Error::Shutdown);
+        }
+        Ok(())
+    }
+
+    fn read_bits<W>(&self, index: usize, range: AddressRange, wrap: W) -> Option<RequestDetails>
+    where
+        W: Fn(ReadBits) -> RequestDetails,
+    {
+        let handler = self.handler.clone();
+        let busy = self.busy.clone();
+        let tracker = self.bit_trackers[index].clone();
+        let promise = crate::client::requests::read_bits::Promise::Callback(Box::new(
+            move |result: Result<BitIterator, Error>| {
+                busy[index].store(false, Ordering::Release);
+                match (result, tracker) {
+                    (Ok(values), Some(tracker)) => {
+                        match lock(&tracker).update(values, Instant::now()) {
+                            Report::Full => handler.on_bits(index, Ok(values)),
+                            Report::Changes(changes) => {
+                                if !changes.is_empty() {
+                                    handler.on_bit_changes(index, changes)
+                                }
+                            }
+                        }
+                    }
+                    (result, tracker) => {
+                        if let Some(tracker) = tracker {
+                            lock(&tracker).invalidate();
+                        }
+                        handler.on_bits(index, result)
+                    }
+                }
+            },
+        ));
+        match range.of_read_bits() {
+            Ok(range) => Some(wrap(ReadBits::new(range, promise))),
+            Err(err) => {
+                promise.failure(err.into());
+                None
+            }
+        }
+    }
+
+    fn read_registers<W>(
+        &self,
+        index: usize,
+        range: AddressRange,
+        wrap: W,
+    ) -> Option<RequestDetails>
+    where
+        W: Fn(ReadRegisters) -> RequestDetails,
+    {
+        let handler = self.handler.clone();
+        let busy = self.busy.clone();
+        let tracker = self.register_trackers[index].clone();
+        let promise = crate::client::requests::read_registers::Promise::Callback(Box::new(
+            move |result: Result<RegisterIterator, Error>| {
+                busy[index].store(false, Ordering::Release);
+                match (result, tracker) {
+                    (Ok(values), Some(tracker)) => {
+                        match lock(&tracker).update(values, Instant::now()) {
+                            Report::Full => handler.on_registers(index, Ok(values)),
+                            Report::Changes(changes) => {
+                                if !changes.is_empty() {
+                                    handler.on_register_changes(index, changes)
+                                }
+                            }
+                        }
+                    }
+                    (result, tracker) => {
+                        if let Some(tracker) = tracker {
+                            lock(&tracker).invalidate();
+                        }
+                        handler.on_registers(index, result)
+                    }
+                }
+            },
+        ));
+        match range.of_read_registers() {
+            Ok(range) => Some(wrap(ReadRegisters::new(range, promise))),
+            Err(err) => {
+                promise.failure(err.into());
+                None
+            }
+        }
+    }
+}
+
+/// The deadline one period after the previous one. If the task has fallen behind by more
+/// than a period, the missed deadlines are skipped instead of being issued in a burst.
+fn next_deadline(previous: Instant, period: Duration, now: Instant) -> Instant {
+    let next = previous + period;
+    if next > now {
+        return next;
+    }
+    let periods = (now - previous).as_nanos() / period.as_nanos() + 1;
+    previous + Duration::from_nanos((period.as_nanos() * periods) as u64)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::Mutex;
+
+    #[derive(Default)]
+    struct Results {
+        bits: Mutex<Vec<(usize, Result<usize, Error>)>>,
+        bit_changes: Mutex<Vec<(usize, Vec<Indexed<bool>>)>>,
+    }
+
+    impl PollHandler for Results {
+        fn on_bits(&self, index: usize, result: Result<BitIterator, Error>) {
+            self.bits
+                .lock()
+                .unwrap()
+                .push((index, result.map(|x| x.count())));
+        }
+
+        fn on_registers(&self, _index: usize, _result: Result<RegisterIterator, Error>) {
+            unreachable!()
+        }
+
+        fn on_bit_changes(&self, index: usize, changes: &[Indexed<bool>]) {
+            self.bit_changes
+                .lock()
+                .unwrap()
+                .push((index, changes.to_vec()));
+        }
+    }
+
+    #[test]
+    fn next_deadline_advances_by_one_period_without_drift() {
+        let start = Instant::now();
+        let period = Duration::from_millis(100);
+
+        // the task woke up late, but the next deadline is still aligned to the start
+        assert_eq!(
+            next_deadline(start, period, start + Duration::from_millis(30)),
+            start + period
+        );
+        // missed periods are skipped
+        assert_eq!(
+            next_deadline(start, period, start + Duration::from_millis(250)),
+            start + Duration::from_millis(300)
+        );
+        assert_eq!(
+            next_deadline(start, period, start + Duration::from_millis(100)),
+            start + Duration::from_millis(200)
+        );
+    }
+
+    #[test]
+    fn does_not_reissue_a_poll_until_the_previous_read_completes() {
+        let (tx, mut rx) = mpsc::channel(10);
+        let results = Arc::new(Results::default());
+        let poll = Poll::new(
+            UnitId::new(1),
+            PollKind::ReadCoils,
+            AddressRange::try_from(0, 4).unwrap(),
+            Duration::from_secs(1),
+        );
+        let (_handle, mut task) =
+            PollTask::create(vec![poll], Duration::from_secs(1), results.clone(), tx);
+
+        tokio_test::block_on(task.issue(0)).unwrap();
+        tokio_test::block_on(task.issue(0)).unwrap();
+
+        let request = rx.try_recv().unwrap();
+        assert!(rx.try_recv().is_err());
+        assert_eq!(request.id, UnitId::new(1));
+
+        request.details.fail(Error::ResponseTimeout);
+        assert_eq!(
+            results.bits.lock().unwrap().as_slice(),
+            &[(0, Err(Error::ResponseTimeout))]
+        );
+
+        // the read completed, so the next period issues another request
+        tokio_test::block_on(task.issue(0)).unwrap();
+        assert!(rx.try_recv().is_ok());
+    }
+
+    #[test]
+    fn invalid_ranges_are_reported_to_the_handler() {
+        let (tx, mut rx) = mpsc::channel(10);
+        let results = Arc::new(Results::default());
+        let poll = Poll::new(
+            UnitId::new(1),
+            PollKind::ReadCoils,
+            AddressRange::try_from(0, 0x07D1).unwrap(),
+            Duration::from_secs(1),
+        );
+        let (_handle, mut task) =
+            PollTask::create(vec![poll], Duration::from_secs(1), results.clone(), tx);
+
+        tokio_test::block_on(task.issue(0)).unwrap();
+
+        assert!(rx.try_recv().is_err());
+        let bits = results.bits.lock().unwrap();
+        assert_eq!(bits.len(), 1);
+        assert!(bits[0].1.is_err());
+    }
+
+    #[test]
+    fn reports_changes_between_integrity_reports() {
+        let (tx, mut rx) = mpsc::channel(10);
+        let results = Arc::new(Results::default());
+        let poll = Poll::new(
+            UnitId::new(1),
+            PollKind::ReadCoils,
+            AddressRange::try_from(0, 4).unwrap(),
+            Duration::from_secs(1),
+        )
+        .report_changes(Duration::from_secs(3600));
+        let (_handle, mut task) =
+            PollTask::create(vec![poll], Duration::from_secs(1), results.clone(), tx);
+
+        let mut respond = |bits: u8| {
+            tokio_test::block_on(task.issue(0)).unwrap();
+            rx.try_recv().unwrap().handle_response(&[0x01, 0x01, bits]);
+        };
+
+        respond(0b0101);
+        respond(0b0101);
+        respond(0b0111);
+
+        assert_eq!(results.bits.lock().unwrap().as_slice(), &[(0, Ok(4))]);
+        assert_eq!(
+            results.bit_changes.lock().unwrap().as_slice(),
+            &[(0, vec![Indexed::new(1, true)])]
+        );
+    }
+}
@@ -0,0 +1,233 @@
+use std::net::SocketAddr;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::time::Duration;
+
+use tokio::sync::mpsc;
+
+use crate::client::channel::{Channel, ChannelOptions, Priority, ReconnectStrategy};
+use crate::client::queue::{RequestQueue, RequestSenders};
+use crate::client::session::AsyncSession;
+use crate::error::Error;
+use crate::metrics::{ChannelCounters, ChannelMetrics};
+use crate::types::UnitId;
+
+/// How a [`ChannelPool`] assigns requests to its connections
+///
+/// [`ChannelPool`]: struct.ChannelPool.html
+#[derive(Copy, Clone, Debug, PartialEq)]
+pub enum Distribution {
+    /// Each session is bound to a single connection chosen by its unit id, so the requests
+    /// for a unit are processed in the order they are made
+    UnitId,
+    /// Each request is sent on the connected connection with the fewest outstanding requests.
+    /// The requests made through a session may complete in a different order.
+    LeastOutstanding,
+}
+
+/// Multiple TCP connections to the same server that are used like a single channel
+///
+/// Every connection is maintained by its own channel task, so a connection that fails is
+/// re-established independently of the others using its own [`ReconnectStrategy`]. Sessions
+/// created from the pool are ordinary [`AsyncSession`] objects.
+///
+/// [`ReconnectStrategy`]: ./channel/trait.ReconnectStrategy.html
+/// [`AsyncSession`]: ./session/struct.AsyncSession.html
+pub struct ChannelPool {
+    channels: Vec<Channel>,
+    distribution: Distribution,
+    // queues read by the dispatcher task, only used with Distribution::LeastOutstanding
+    dispatcher: Option<RequestSenders>,
+}
+
+/// Counts a request as outstanding on a connection of a pool until the request is dropped,
+/// i.e. once it has been completed or failed
+pub(crate) struct Outstanding {
+    counter: Arc<AtomicUsize>,
+    // number of requests that were merged into the request that holds this value
+    count: usize,
+}
+
+impl Outstanding {
+    fn new(counter: Arc<AtomicUsize>) -> Self {
+        counter.fetch_add(1, Ordering::Relaxed);
+        Self { counter, count: 1 }
+    }
+
+    /// combine the values of two requests that are merged into one. Merged requests were
+    /// taken from the same connection queue, so they always refer to the same counter.
+    pub(crate) fn merge(first: Option<Self>, second: Option<Self>) -> Option<Self> {
+        match (first, second) {
+            (Some(mut x), Some(mut y)) => {
+                x.count += y.count;
+                y.count = 0;
+                Some(x)
+            }
+            (x, None) => x,
+            (None, y) => y,
+        }
+    }
+}
+
+impl Drop for Outstanding {
+    fn drop(&mut self) {
+        self.counter.fetch_sub(self.count, Ordering::Relaxed);
+    }
+}
+
+struct Connection {
+    tx: RequestSenders,
+    counters: Arc<ChannelCounters>,
+    outstanding: Arc<AtomicUsize>,
+}
+
+impl ChannelPool {
+    pub(crate) fn new<F>(
+        addr: SocketAddr,
+        size: usize,
+        max_queued_requests: usize,
+        mut connect_retry: F,
+        options: ChannelOptions,
+        distribution: Distribution,
+    ) -> Self
+    where
+        F: FnMut() -> Box<dyn ReconnectStrategy + Send>,
+    {
+        let channels: Vec<Channel> = (0..std::cmp::max(size, 1))
+            .map(|_| Channel::new(addr, max_queued_requests, connect_retry(), options))
+            .collect();
+
+        let dispatcher = match distribution {
+            Distribution::UnitId => None,
+            Distribution::LeastOutstanding => {
+                let (tx, rx) = RequestQueue::create(
+                    options.control_queue_depth,
+                    max_queued_requests,
+                    options.background_queue_depth,
+                );
+                let connections = channels
+                    .iter()
+                    .map(|x| Connection {
+                        tx: x.senders(),
+                        counters: x.counters(),
+                        outstanding: Arc::new(AtomicUsize::new(0)),
+                    })
+                    .collect();
+                tokio::spawn(Self::dispatch(rx, connections));
+                Some(tx)
+            }
+        };
+
+        Self {
+            channels,
+            distribution,
+            dispatcher,
+        }
+    }
+
+    /// Create an `AsyncSession` struct that can be used to make requests
+    pub fn create_session(&self, id: UnitId, response_timeout: Duration) -> AsyncSession {
+        self.create_session_with_priority(id, response_timeout, Priority::default())
+    }
+
+    /// Create an `AsyncSession` whose requests are sent through the queues of a particular
+    /// priority
+    pub fn create_session_with_priority(
+        &self,
+        id: UnitId,
+        response_timeout: Duration,
+        priority: Priority,
+    ) -> AsyncSession {
+        if let Some(tx) = &self.dispatcher {
+            return AsyncSession::new(id, response_timeout, tx.get(priority));
+        }
+        // the pool always has at least one connection
+        let index = id.value as usize % self.channels.len();
+        self.channels[index].create_session_with_priority(id, response_timeout, priority)
+    }
+
+    /// How requests are assigned to the connections of the pool
+    pub fn distribution(&self) -> Distribution {
+        self.distribution
+    }
+
+    /// The channel that maintains each connection of the pool, e.g. to spawn polls on a
+    /// particular connection
+    pub fn channels(&self) -> &[Channel] {
+        &self.channels
+    }
+
+    /// Take a snapshot of the counters of each connection of the pool
+    pub fn metrics(&self) -> Vec<ChannelMetrics> {
+        self.channels.iter().map(|x| x.metrics()).collect()
+    }
+
+    async fn dispatch(mut rx: RequestQueue, mut connections: Vec<Connection>) {
+        // ends once the pool and every session created from it are dropped
+        while let Some((priority, mut request)) = rx.next().await {
+            let selected = Self::least_outstanding(connections.iter().map(|x| {
+                (
+                    x.counters.is_connected(),
+                    x.outstanding.load(Ordering::Relaxed),
+                )
+            }));
+            let connection = match selected.and_then(|x| connections.get_mut(x)) {
+                Some(x) => x,
+                None => {
+                    request.details.fail(Error::Shutdown);
+                    continue;
+                }
+            };
+            request.outstanding = Some(Outstanding::new(connection.outstanding.clone()));
+            // waiting for room in the queue of the connection applies back pressure to callers
+            if let Err(mpsc::error::SendError(request)) =
+                connection.tx.get_mut(priority).send(request).await
+            {
+                request.details.fail(Error::Shutdown);
+            }
+        }
+    }
+
+    /// index of the connection with the fewest outstanding requests, preferring connections
+    /// that are connected. Connections that are down fail their requests right away, so
+    /// they would otherwise attract every request.
+    fn least_outstanding<I>(connections: I) -> Option<usize>
+    where
+        I: Iterator<Item = (bool, usize)>,
+    {
+        connections
+            .enumerate()
+            .min_by_key(|(_, (connected, outstanding))| (!connected, *outstanding))
+            .map(|(index, _)| index)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn selects_connected_connection_with_fewest_outstanding_requests() {
+        let select = |x: &[(bool, usize)]| ChannelPool::least_outstanding(x.iter().copied());
+
+        assert_eq!(select(&[]), None);
+        assert_eq!(select(&[(true, 0), (true, 0)]), Some(0));
+        assert_eq!(select(&[(true, 3), (true, 1), (true, 2)]), Some(1));
+        assert_eq!(select(&[(false, 0), (true, 5)]), Some(1));
+        assert_eq!(select(&[(false, 2), (false, 1)]), Some(1));
+    }
+
+    #[test]
+    fn merged_requests_are_outstanding_until_dropped() {
+        let counter = Arc::new(AtomicUsize::new(0));
+        let first = Some(Outstanding::new(counter.clone()));
+        let second = Some(Outstanding::new(counter.clone()));
+        assert_eq!(counter.load(Ordering::Relaxed), 2);
+
+        let merged = Outstanding::merge(first, second);
+        assert_eq!(counter.load(Ordering::Relaxed), 2);
+
+        drop(merged);
+        assert_eq!(counter.load(Ordering::Relaxed), 0);
+    }
+}
@@ -0,0 +1,282 @@
+use std::collections::VecDeque;
+
+use tokio::sync::mpsc;
+
+use crate::client::channel::Priority;
+use crate::client::message::Request;
+
+/// one value for each priority
+#[derive(Clone)]
+struct Lanes<T> {
+    control: T,
+    interactive: T,
+    background: T,
+}
+
+impl<T> Lanes<T> {
+    fn get(&self, priority: Priority) -> &T {
+        match priority {
+            Priority::Control => &self.control,
+            Priority::Interactive => &self.interactive,
+            Priority::Background => &self.background,
+        }
+    }
+
+    fn get_mut(&mut self, priority: Priority) -> &mut T {
+        match priority {
+            Priority::Control => &mut self.control,
+            Priority::Interactive => &mut self.interactive,
+            Priority::Background => &mut self.background,
+        }
+    }
+}
+
+/// Sending side of the request queues, there is one bounded queue per priority
+#[derive(Clone)]
+pub(crate) struct RequestSenders {
+    lanes: Lanes<mpsc::Sender<Request>>,
+}
+
+impl RequestSenders {
+    pub(crate) fn get(&self, priority: Priority) -> mpsc::Sender<Request> {
+        self.lanes.get(priority).clone()
+    }
+
+    pub(crate) fn get_mut(&mut self, priority: Priority) -> &mut mpsc::Sender<Request> {
+        self.lanes.get_mut(priority)
+    }
+}
+
+struct Lane {
+    rx: mpsc::Receiver<Request>,
+    // requests taken from the queue, but not yet sent
+    pending: VecDeque<Request>,
+    // capacity of the queue, also the most requests pending may hold
+    depth: usize,
+    closed: bool,
+}
+
+impl Lane {
+    fn new(rx: mpsc::Receiver<Request>, depth: usize) -> Self {
+        Self {
+            rx,
+            pending: VecDeque::new(),
+            depth,
+            closed: false,
+        }
+    }
+
+    fn receive(&mut self, request: Option<Request>) {
+        match request {
+            Some(x) => self.pending.push_back(x),
+            None => self.closed = true,
+        }
+    }
+
+    fn next(&mut self) -> Option<Request> {
+        if let Some(x) = self.pending.pop_front() {
+            return Some(x);
+        }
+        self.rx.try_recv().ok()
+    }
+}
+
+/// Receiving side of the request queues
+///
+/// The queues are serviced in strict priority order: a request is only taken from a queue if
+/// all of the higher priority queues are empty.
+pub(crate) struct RequestQueue {
+    lanes: Lanes<Lane>,
+}
+
+impl RequestQueue {
+    /// create the queues with the maximum number of requests each one may hold, a depth of 0
+    /// is treated as 1
+    pub(crate) fn create(
+        control: usize,
+        interactive: usize,
+        background: usize,
+    ) -> (RequestSenders, Self) {
+        let control = std::cmp::max(control, 1);
+        let interactive = std::cmp::max(interactive, 1);
+        let background = std::cmp::max(background, 1);
+        let (control_tx, control_rx) = mpsc::channel(control);
+        let (interactive_tx, interactive_rx) = mpsc::channel(interactive);
+        let (background_tx, background_rx) = mpsc::channel(background);
+        let senders = RequestSenders {
+            lanes: Lanes {
+                control: control_tx,
+                interactive: interactive_tx,
+                background: background_tx,
+            },
+        };
+        let queue = Self {
+            lanes: Lanes {
+                control: Lane::new(control_rx, control),
+                interactive: Lane::new(interactive_rx, interactive),
+                background: Lane::new(background_rx, background),
+            },
+        };
+        (senders, queue)
+    }
+
+    /// take the highest priority request that is immediately available
+    pub(crate) fn try_next(&mut self) -> Option<(Priority, Request)> {
+        for priority in Priority::ALL.iter() {
+            if let Some(x) = self.lanes.get_mut(*priority).next() {
+                return Some((*priority, x));
+            }
+        }
+        None
+    }
+
+    /// wait for the highest priority request, returns None once every queue is closed and empty
+    pub(crate) async fn next(&mut self) -> Option<(Priority, Request)> {
+        loop {
+            if let Some(x) = self.try_next() {
+                return Some(x);
+            }
+
+            let Lanes {
+                control,
+                interactive,
+                background,
+            } = &mut self.lanes;
+
+            tokio::select! {
+                x = control.rx.recv(), if !control.closed => control.receive(x),
+                x = interactive.rx.recv(), if !interactive.closed => interactive.receive(x),
+                x = background.rx.recv(), if !background.closed => background.receive(x),
+                else => return None,
+            }
+        }
+    }
+
+    /// requests waiting in a queue that may be combined with a request taken from it. At most
+    /// `limit` requests, and never more than the depth of the queue, are held outside of the
+    /// bounded queue. The others stay in the queue and continue to apply back pressure to the
+    /// senders.
+    pub(crate) fn pending(&mut self, priority: Priority, limit: usize) -> Pending<'_> {
+        let lane = self.lanes.get_mut(priority);
+        let limit = std::cmp::max(std::cmp::min(limit, lane.depth), 1);
+        Pending { lane, limit }
+    }
+}
+
+/// The requests waiting behind a request in its queue, see [`RequestQueue::pending`]
+///
+/// Requests are only taken from the queue when they are examined, a request that isn't
+/// combined is kept in the pending list of the lane and serviced before the queue.
+pub(crate) struct Pending<'a> {
+    lane: &'a mut Lane,
+    limit: usize,
+}
+
+impl<'a> Pending<'a> {
+    /// the request at a position behind the request being sent, None if the queue has fewer
+    /// requests or the position is beyond the limit
+    pub(crate) fn get(&mut self, index: usize) -> Option<&Request> {
+        while self.lane.pending.len() <= index {
+            if self.lane.pending.len() >= self.limit {
+                return None;
+            }
+            match self.lane.rx.try_recv() {
+                Ok(x) => self.lane.pending.push_back(x),
+                Err(_) => return None,
+            }
+        }
+        self.lane.pending.get(index)
+    }
+
+    pub(crate) fn remove(&mut self, index: usize) -> Option<Request> {
+        self.get(index)?;
+        self.lane.pending.remove(index)
+    }
+
+    /// put back a request that was removed but couldn't be combined
+    pub(crate) fn insert(&mut self, index: usize, request: Request) {
+        self.lane.pending.insert(index, request);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::client::message::RequestDetails;
+    use crate::client::requests::read_bits::{Promise, ReadBits};
+    use crate::types::{AddressRange, UnitId};
+    use std::time::Duration;
+
+    fn request(id: u8) -> Request {
+        let (tx, _) = tokio::sync::oneshot::channel();
+        let range = AddressRange::try_from(0, 1)
+            .unwrap()
+            .of_read_bits()
+            .unwrap();
+        Request::new(
+            UnitId::new(id),
+            Duration::from_secs(1),
+            RequestDetails::ReadCoils(ReadBits::new(range, Promise::Channel(tx))),
+        )
+    }
+
+    #[test]
+    fn services_queues_in_priority_order() {
+        let (senders, mut queue) = RequestQueue::create(1, 1, 2);
+
+        let send = |priority, id| tokio_test::block_on(senders.get(priority).send(request(id)));
+        send(Priority::Background, 1).ok();
+        send(Priority::Background, 2).ok();
+        send(Priority::Interactive, 3).ok();
+        send(Priority::Control, 4).ok();
+
+        let order: Vec<(Priority, u8)> = std::iter::from_fn(|| queue.try_next())
+            .map(|(priority, x)| (priority, x.id.value))
+            .collect();
+
+        assert_eq!(
+            order,
+            vec![
+                (Priority::Control, 4),
+                (Priority::Interactive, 3),
+                (Priority::Background, 1),
+                (Priority::Background, 2),
+            ]
+        );
+    }
+
+    #[test]
+    fn next_returns_none_once_every_queue_is_closed() {
+        let (senders, mut queue) = RequestQueue::create(1, 1, 1);
+        tokio_test::block_on(senders.get(Priority::Control).send(request(1))).ok();
+        drop(senders);
+
+        assert!(tokio_test::block_on(queue.next()).is_some());
+        assert!(tokio_test::block_on(queue.next()).is_none());
+    }
+
+    #[test]
+    fn pending_requests_are_limited_and_the_rest_stay_queued() {
+        let (senders, mut queue) = RequestQueue::create(1, 4, 1);
+        for id in 1..5 {
+            tokio_test::block_on(senders.get(Priority::Interactive).send(request(id))).ok();
+        }
+
+        let mut pending = queue.pending(Priority::Interactive, 2);
+        assert_eq!(pending.get(0).map(|x| x.id.value), Some(1));
+        assert_eq!(pending.get(1).map(|x| x.id.value), Some(2));
+        assert!(pending.get(2).is_none());
+        assert_eq!(queue.lanes.interactive.pending.len(), 2);
+
+        // the limit never exceeds the depth of the queue
+        let mut pending = queue.pending(Priority::Interactive, 100);
+        assert!(pending.get(3).is_some());
+        assert!(pending.get(4).is_none());
+
+        // requests that weren't combined are serviced first, in order
+        let order: Vec<u8> = std::iter::from_fn(|| queue.try_next())
+            .map(|(_, x)| x.id.value)
+            .collect();
+        assert_eq!(order, vec![1, 2, 3, 4]);
+    }
+}
@@ -1,4 +1,5 @@
 pub(crate) mod read_bits;
 pub(crate) mod read_registers;
+pub(crate) mod read_write_registers;
 pub(crate) mod write_multiple;
 pub(crate) mod write_single;
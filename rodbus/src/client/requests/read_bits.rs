@@ -1,3 +1,4 @@
+use crate::client::slot::SlotPromise;
 use crate::common::cursor::{ReadCursor, WriteCursor};
 use crate::common::traits::Serialize;
 use crate::error::Error;
@@ -6,6 +7,7 @@ use crate::types::{AddressRange, BitIterator, Indexed, ReadBitsRange};
 pub(crate) enum Promise {
     Channel(tokio::sync::oneshot::Sender<Result<Vec<Indexed<bool>>, Error>>),
     Callback(Box<dyn FnOnce(Result<BitIterator, Error>) + Send + Sync + 'static>),
+    Slot(SlotPromise<bool>),
 }
 
 impl Promise {
@@ -19,6 +21,7 @@ impl Promise {
                 sender.send(x.map(|y| y.collect())).ok();
             }
             Promise::Callback(callback) => callback(x),
+            Promise::Slot(slot) => slot.complete(x),
         }
     }
 }
@@ -26,11 +29,39 @@ impl Promise {
 pub(crate) struct ReadBits {
     request: ReadBitsRange,
     promise: Promise,
+    // range requested by the promise, the request is larger when other reads are merged into it
+    range: AddressRange,
+    // reads that were merged into this one and receive their part of the same response
+    merged: Vec<(AddressRange, Promise)>,
 }
 
 impl ReadBits {
     pub(crate) fn new(request: ReadBitsRange, promise: Promise) -> Self {
-        Self { request, promise }
+        Self {
+            request,
+            promise,
+            range: request.inner,
+            merged: Vec::new(),
+        }
+    }
+
+    /// merge another read into this one if the ranges overlap or are adjacent and the
+    /// combined range is still a valid request, otherwise the read is returned
+    pub(crate) fn merge(&mut self, other: Self) -> Result<(), Self> {
+        let range = match self
+            .request
+            .inner
+            .union(other.request.inner)
+            .and_then(|x| x.of_read_bits().ok())
+        {
+            Some(x) => x,
+            None => return Err(other),
+        };
+
+        self.merged.push((other.range, other.promise));
+        self.merged.extend(other.merged);
+        self.request = range;
+        Ok(())
     }
 
     pub(crate) fn serialize(&self, cursor: &mut WriteCursor) -> Result<(), Error> {
@@ -38,12 +69,24 @@ impl ReadBits {
     }
 
     pub(crate) fn failure(self, err: Error) {
-        self.promise.failure(err)
+        self.promise.failure(err);
+        for (_, promise) in self.merged {
+            promise.failure(err);
+        }
     }
 
     pub(crate) fn handle_response(self, mut cursor: ReadCursor) {
-        self.promise
-            .complete(Self::parse_bits_response(self.request.inner, &mut cursor))
+        let result = Self::parse_bits_response(self.request.inner, &mut cursor);
+        if self.merged.is_empty() {
+            return self.promise.complete(result);
+        }
+
+        // each read receives the part of the response that it asked for
+        let split = |range: AddressRange| result.map(|x| x.sub_range(range));
+        self.promise.complete(split(self.range));
+        for (range, promise) in self.merged {
+            promise.complete(split(range));
+        }
     }
 
     fn parse_bits_response<'a>(
@@ -0,0 +1,50 @@
+use crate::client::requests::read_registers::Promise;
+use crate::common::cursor::{ReadCursor, WriteCursor};
+use crate::common::traits::Serialize;
+use crate::error::Error;
+use crate::types::{ReadRegistersRange, RegisterIterator, WriteMultiple};
+
+/// Writes holding registers and then reads holding registers in a single transaction
+pub(crate) struct ReadWriteRegisters {
+    read: ReadRegistersRange,
+    write: WriteMultiple<u16>,
+    promise: Promise,
+}
+
+impl ReadWriteRegisters {
+    pub(crate) fn new(
+        read: ReadRegistersRange,
+        write: WriteMultiple<u16>,
+        promise: Promise,
+    ) -> Self {
+        Self {
+            read,
+            write,
+            promise,
+        }
+    }
+
+    pub(crate) fn serialize(&self, cursor: &mut WriteCursor) -> Result<(), Error> {
+        // the read range comes first, followed by the same fields as a write multiple request
+        self.read.inner.serialize(cursor)?;
+        self.write.serialize(cursor)
+    }
+
+    pub(crate) fn failure(self, err: Error) {
+        self.promise.failure(err)
+    }
+
+    pub(crate) fn handle_response(self, mut cursor: ReadCursor) {
+        let result = Self::parse_registers_response(self.read, &mut cursor);
+        self.promise.complete(result)
+    }
+
+    fn parse_registers_response<'a>(
+        range: ReadRegistersRange,
+        cursor: &'a mut ReadCursor,
+    ) -> Result<RegisterIterator<'a>, Error> {
+        // the response is the same as that of a read holding registers request
+        cursor.read_u8()?;
+        Ok(RegisterIterator::parse_all(range.inner, cursor)?)
+    }
+}
@@ -1,8 +1,10 @@
 use crate::client::message::Promise;
+use crate::client::requests::write_multiple::MultipleWrite;
 use crate::common::cursor::{ReadCursor, WriteCursor};
+use crate::common::traits::Serialize;
 use crate::error::details::ADUParseError;
 use crate::error::Error;
-use crate::types::{coil_from_u16, coil_to_u16, Indexed};
+use crate::types::{coil_from_u16, coil_to_u16, AddressRange, Indexed, WriteMultiple};
 
 pub(crate) trait SingleWriteOperation: Sized + PartialEq {
     fn serialize(&self, cursor: &mut WriteCursor) -> Result<(), Error>;
@@ -48,6 +50,46 @@ where
     }
 }
 
+impl<T> SingleWrite<Indexed<T>>
+where
+    Indexed<T>: SingleWriteOperation,
+{
+    pub(crate) fn index(&self) -> u16 {
+        self.request.index
+    }
+}
+
+impl<T> SingleWrite<Indexed<T>>
+where
+    Indexed<T>: SingleWriteOperation,
+    WriteMultiple<T>: Serialize,
+    T: Copy + Send + Sync + 'static,
+{
+    /// Combine writes to consecutive, increasing addresses into a single multiple write. Each
+    /// of the original promises is completed when the response arrives.
+    pub(crate) fn combine(writes: Vec<Self>) -> MultipleWrite<T> {
+        let start = writes.first().map_or(0, |x| x.request.index);
+        let values: Vec<T> = writes.iter().map(|x| x.request.value).collect();
+        let parts: Vec<(Indexed<T>, Promise<Indexed<T>>)> =
+            writes.into_iter().map(|x| (x.request, x.promise)).collect();
+
+        let request = WriteMultiple {
+            range: AddressRange {
+                start,
+                count: values.len() as u16,
+            },
+            values,
+        };
+        let promise = Promise::Callback(Box::new(move |result: Result<AddressRange, Error>| {
+            for (value, promise) in parts {
+                promise.complete(result.map(|_| value))
+            }
+        }));
+
+        MultipleWrite::new(request, promise)
+    }
+}
+
 impl SingleWriteOperation for Indexed<bool> {
     fn serialize(&self, cursor: &mut WriteCursor) -> Result<(), Error> {
         cursor.write_u16_be(self.index)?;
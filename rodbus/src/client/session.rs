@@ -1,3 +1,4 @@
+use std::sync::Arc;
 use std::time::Duration;
 
 use tokio::runtime::Runtime;
@@ -6,8 +7,10 @@ use tokio::sync::{mpsc, oneshot};
 use crate::client::message::{Promise, Request, RequestDetails};
 use crate::client::requests::read_bits::ReadBits;
 use crate::client::requests::read_registers::ReadRegisters;
+use crate::client::requests::read_write_registers::ReadWriteRegisters;
 use crate::client::requests::write_multiple::MultipleWrite;
 use crate::client::requests::write_single::SingleWrite;
+use crate::client::slot::Slot;
 use crate::error::*;
 use crate::types::{AddressRange, BitIterator, Indexed, RegisterIterator, UnitId, WriteMultiple};
 
@@ -27,6 +30,45 @@ pub struct AsyncSession {
     request_channel: mpsc::Sender<Request>,
 }
 
+/// Reusable storage for the values returned by the `read_*_into` methods of [`AsyncSession`]
+///
+/// The channel task decodes each response directly into a vector owned by the buffer, which
+/// only holds the values starting at the beginning of the range that was read. Once the vectors
+/// have grown to the size of the largest response, reads made with the buffer don't allocate.
+///
+/// [`AsyncSession`]: struct.AsyncSession.html
+pub struct ReadBuffer<T> {
+    slot: Arc<Slot<T>>,
+    values: Vec<T>,
+}
+
+impl<T> ReadBuffer<T> {
+    /// Create an empty buffer
+    pub fn new() -> Self {
+        Self {
+            slot: Arc::new(Slot::new()),
+            values: Vec::new(),
+        }
+    }
+
+    /// Values returned by the last successful read made with the buffer
+    pub fn values(&self) -> &[T] {
+        &self.values
+    }
+
+    async fn complete(&mut self, generation: u64) -> Result<(), Error> {
+        self.slot.wait(generation).await?;
+        self.slot.swap(&mut self.values);
+        Ok(())
+    }
+}
+
+impl<T> Default for ReadBuffer<T> {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
 impl AsyncSession {
     pub(crate) fn new(
         id: UnitId,
@@ -89,6 +131,46 @@ impl AsyncSession {
         rx.await?
     }
 
+    /// Read coils into a reusable buffer instead of allocating a new vector
+    pub async fn read_coils_into(
+        &mut self,
+        range: AddressRange,
+        buffer: &mut ReadBuffer<bool>,
+    ) -> Result<(), Error> {
+        self.read_bits_into(range, buffer, RequestDetails::ReadCoils)
+            .await
+    }
+
+    /// Read discrete inputs into a reusable buffer instead of allocating a new vector
+    pub async fn read_discrete_inputs_into(
+        &mut self,
+        range: AddressRange,
+        buffer: &mut ReadBuffer<bool>,
+    ) -> Result<(), Error> {
+        self.read_bits_into(range, buffer, RequestDetails::ReadDiscreteInputs)
+            .await
+    }
+
+    /// Read holding registers into a reusable buffer instead of allocating a new vector
+    pub async fn read_holding_registers_into(
+        &mut self,
+        range: AddressRange,
+        buffer: &mut ReadBuffer<u16>,
+    ) -> Result<(), Error> {
+        self.read_registers_into(range, buffer, RequestDetails::ReadHoldingRegisters)
+            .await
+    }
+
+    /// Read input registers into a reusable buffer instead of allocating a new vector
+    pub async fn read_input_registers_into(
+        &mut self,
+        range: AddressRange,
+        buffer: &mut ReadBuffer<u16>,
+    ) -> Result<(), Error> {
+        self.read_registers_into(range, buffer, RequestDetails::ReadInputRegisters)
+            .await
+    }
+
     pub async fn write_single_coil(
         &mut self,
         request: Indexed<bool>,
@@ -141,6 +223,66 @@ impl AsyncSession {
         rx.await?
     }
 
+    /// Write holding registers and then read holding registers in a single transaction
+    ///
+    /// The server applies the write before performing the read
+    pub async fn read_write_multiple_registers(
+        &mut self,
+        read: AddressRange,
+        write: WriteMultiple<u16>,
+    ) -> Result<Vec<Indexed<u16>>, Error> {
+        let (tx, rx) = oneshot::channel::<Result<Vec<Indexed<u16>>, Error>>();
+        let request = self.wrap(RequestDetails::ReadWriteMultipleRegisters(
+            ReadWriteRegisters::new(
+                read.of_read_registers()?,
+                write.of_read_write_registers()?,
+                crate::client::requests::read_registers::Promise::Channel(tx),
+            ),
+        ));
+        self.request_channel.send(request).await?;
+        rx.await?
+    }
+
+    async fn read_bits_into<W>(
+        &mut self,
+        range: AddressRange,
+        buffer: &mut ReadBuffer<bool>,
+        wrap: W,
+    ) -> Result<(), Error>
+    where
+        W: Fn(ReadBits) -> RequestDetails,
+    {
+        let range = range.of_read_bits()?;
+        let promise = Slot::begin(&buffer.slot);
+        let generation = promise.generation();
+        let request = self.wrap(wrap(ReadBits::new(
+            range,
+            crate::client::requests::read_bits::Promise::Slot(promise),
+        )));
+        self.request_channel.send(request).await?;
+        buffer.complete(generation).await
+    }
+
+    async fn read_registers_into<W>(
+        &mut self,
+        range: AddressRange,
+        buffer: &mut ReadBuffer<u16>,
+        wrap: W,
+    ) -> Result<(), Error>
+    where
+        W: Fn(ReadRegisters) -> RequestDetails,
+    {
+        let range = range.of_read_registers()?;
+        let promise = Slot::begin(&buffer.slot);
+        let generation = promise.generation();
+        let request = self.wrap(wrap(ReadRegisters::new(
+            range,
+            crate::client::requests::read_registers::Promise::Slot(promise),
+        )));
+        self.request_channel.send(request).await?;
+        buffer.complete(generation).await
+    }
+
     fn wrap(&self, details: RequestDetails) -> Request {
         Request::new(self.id, self.response_timeout, details)
     }
@@ -253,6 +395,26 @@ impl CallbackSession {
         .await;
     }
 
+    pub async fn read_write_multiple_registers<C>(
+        &mut self,
+        read: AddressRange,
+        write: WriteMultiple<u16>,
+        callback: C,
+    ) where
+        C: FnOnce(Result<RegisterIterator, Error>) + Send + Sync + 'static,
+    {
+        let promise =
+            crate::client::requests::read_registers::Promise::Callback(Box::new(callback));
+        let (read, write) = match (read.of_read_registers(), write.of_read_write_registers()) {
+            (Ok(read), Ok(write)) => (read, write),
+            (Err(err), _) | (_, Err(err)) => return promise.failure(err.into()),
+        };
+        self.send(self.inner.wrap(RequestDetails::ReadWriteMultipleRegisters(
+            ReadWriteRegisters::new(read, write, promise),
+        )))
+        .await;
+    }
+
     async fn read_bits<C, W>(&mut self, range: AddressRange, callback: C, wrap: W)
     where
         C: FnOnce(Result<BitIterator, Error>) + Send + Sync + 'static,
@@ -373,4 +535,13 @@ impl SyncSession {
     ) -> Result<AddressRange, Error> {
         runtime.block_on(self.inner.write_multiple_registers(value))
     }
+
+    pub fn read_write_multiple_registers(
+        &mut self,
+        runtime: &mut Runtime,
+        read: AddressRange,
+        write: WriteMultiple<u16>,
+    ) -> Result<Vec<Indexed<u16>>, Error> {
+        runtime.block_on(self.inner.read_write_multiple_registers(read, write))
+    }
 }
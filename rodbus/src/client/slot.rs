@@ -0,0 +1,170 @@
+use std::sync::{Arc, Mutex, MutexGuard};
+
+use tokio::sync::Notify;
+
+use crate::error::Error;
+use crate::types::CopyValues;
+
+/// Storage shared between a [`ReadBuffer`] and the channel task that lets the task decode a
+/// response directly into a vector owned by the buffer
+///
+/// Each request made with the buffer gets a new generation. A request that is abandoned, because
+/// the future making it was dropped, can't complete a later request made with the same buffer.
+///
+/// [`ReadBuffer`]: ../session/struct.ReadBuffer.html
+pub(crate) struct Slot<T> {
+    state: Mutex<SlotState<T>>,
+    notify: Notify,
+}
+
+struct SlotState<T> {
+    generation: u64,
+    values: Vec<T>,
+    result: Option<Result<(), Error>>,
+}
+
+impl<T> Slot<T> {
+    pub(crate) fn new() -> Self {
+        Self {
+            state: Mutex::new(SlotState {
+                generation: 0,
+                values: Vec::new(),
+                result: None,
+            }),
+            notify: Notify::new(),
+        }
+    }
+
+    fn lock(&self) -> MutexGuard<'_, SlotState<T>> {
+        // the state is always consistent, so a panic on another thread doesn't matter
+        match self.state.lock() {
+            Ok(x) => x,
+            Err(x) => x.into_inner(),
+        }
+    }
+
+    /// start a new request and return the promise that completes it
+    pub(crate) fn begin(slot: &Arc<Self>) -> SlotPromise<T> {
+        let mut state = slot.lock();
+        state.generation = state.generation.wrapping_add(1);
+        state.result = None;
+        SlotPromise {
+            slot: slot.clone(),
+            generation: state.generation,
+            done: false,
+        }
+    }
+
+    /// wait for the request of a generation to complete
+    pub(crate) async fn wait(&self, generation: u64) -> Result<(), Error> {
+        loop {
+            {
+                let mut state = self.lock();
+                if state.generation == generation {
+                    if let Some(x) = state.result.take() {
+                        return x;
+                    }
+                }
+            }
+            // a notification that arrives between the check and here is stored as a permit
+            self.notify.notified().await;
+        }
+    }
+
+    /// exchange the vector holding the values of the last response with another one
+    pub(crate) fn swap(&self, values: &mut Vec<T>) {
+        std::mem::swap(&mut self.lock().values, values)
+    }
+}
+
+/// Completes a request made with a [`Slot`]. A promise that is dropped without being completed
+/// fails the request with `Error::Shutdown` so that the session never waits forever.
+pub(crate) struct SlotPromise<T> {
+    slot: Arc<Slot<T>>,
+    generation: u64,
+    done: bool,
+}
+
+impl<T> SlotPromise<T> {
+    pub(crate) fn generation(&self) -> u64 {
+        self.generation
+    }
+
+    pub(crate) fn complete<I>(mut self, result: Result<I, Error>)
+    where
+        I: CopyValues<T>,
+    {
+        match &result {
+            Ok(values) => self.finish(Ok(values)),
+            Err(err) => self.finish(Err(*err)),
+        }
+    }
+
+    fn finish(&mut self, result: Result<&dyn CopyValues<T>, Error>) {
+        self.done = true;
+        {
+            let mut state = self.slot.lock();
+            if state.generation != self.generation {
+                // the request was abandoned and the buffer has been reused
+                return;
+            }
+            let result = result.map(|values| {
+                state.values.clear();
+                values.copy_values(&mut state.values);
+            });
+            state.result = Some(result);
+        }
+        self.slot.notify.notify();
+    }
+}
+
+impl<T> Drop for SlotPromise<T> {
+    fn drop(&mut self) {
+        if !self.done {
+            self.finish(Err(Error::Shutdown))
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use crate::common::cursor::ReadCursor;
+    use crate::types::{AddressRange, RegisterIterator};
+
+    fn complete(promise: SlotPromise<u16>, bytes: &[u8]) {
+        let range = AddressRange::try_from(0, (bytes.len() / 2) as u16).unwrap();
+        let mut cursor = ReadCursor::new(bytes);
+        promise.complete(RegisterIterator::parse_all(range, &mut cursor));
+    }
+
+    #[test]
+    fn abandoned_requests_do_not_complete_later_ones() {
+        let slot = Arc::new(Slot::<u16>::new());
+
+        let abandoned = Slot::begin(&slot);
+        let current = Slot::begin(&slot);
+        let generation = current.generation();
+
+        complete(abandoned, &[0x00, 0x01]);
+        complete(current, &[0x00, 0x02, 0x00, 0x03]);
+
+        assert_eq!(tokio_test::block_on(slot.wait(generation)), Ok(()));
+        let mut values = Vec::new();
+        slot.swap(&mut values);
+        assert_eq!(values, vec![2, 3]);
+    }
+
+    #[test]
+    fn dropped_promise_fails_the_request() {
+        let slot = Arc::new(Slot::<u16>::new());
+        let promise = Slot::begin(&slot);
+        let generation = promise.generation();
+        drop(promise);
+        assert_eq!(
+            tokio_test::block_on(slot.wait(generation)),
+            Err(Error::Shutdown)
+        );
+    }
+}
@@ -1,11 +1,17 @@
+use std::collections::BTreeMap;
+use std::sync::Arc;
 use std::time::Duration;
 
 use tokio::prelude::*;
-use tokio::sync::*;
 
-use crate::client::message::Request;
-use crate::common::frame::{FrameFormatter, FrameHeader, FramedReader, TxId};
+use crate::client::channel::{ChannelOptions, Priority};
+use crate::client::message::{Request, WriteRun};
+use crate::client::queue::{Pending, RequestQueue};
+use crate::client::timeout::UnitTimeouts;
+use crate::common::frame::{Frame, FrameFormatter, FrameHeader, FrameParser, FramedReader, TxId};
 use crate::error::*;
+use crate::metrics::ChannelCounters;
+use crate::rtu::frame::{RtuFormatter, RtuParser};
 use crate::tcp::frame::{MBAPFormatter, MBAPParser};
 
 /**
@@ -32,20 +38,262 @@ impl SessionError {
     }
 }
 
-pub(crate) struct ClientLoop {
-    rx: mpsc::Receiver<Request>,
-    formatter: MBAPFormatter,
-    reader: FramedReader<MBAPParser>,
+/// a request that has been written to the stream and is waiting for a response
+struct InFlight {
+    request: Request,
+    sent: tokio::time::Instant,
+    deadline: tokio::time::Instant,
+}
+
+/// requests that have been sent, keyed by transaction id
+struct InFlightRequests {
+    requests: BTreeMap<TxId, InFlight>,
+    // bytes of framing around each ADU, e.g. the MBAP header
+    overhead: usize,
+    // None if the timeout of each request is fixed
+    timeouts: Option<UnitTimeouts>,
+    // true if the framing has no transaction id, a response must then have the unit id and
+    // function code of the request in flight
+    match_replies: bool,
+    // set when bytes of a frame that wasn't matched to a request may still be arriving
+    out_of_sync: bool,
+    metrics: Arc<ChannelCounters>,
+}
+
+impl InFlightRequests {
+    fn new(overhead: usize, timeouts: Option<UnitTimeouts>, metrics: Arc<ChannelCounters>) -> Self {
+        Self {
+            requests: BTreeMap::new(),
+            overhead,
+            timeouts,
+            match_replies: false,
+            out_of_sync: false,
+            metrics,
+        }
+    }
+
+    fn admit(&mut self, request: &Request) -> bool {
+        match &mut self.timeouts {
+            Some(x) => x.admit(request.id, tokio::time::Instant::now()),
+            None => true,
+        }
+    }
+
+    fn len(&self) -> usize {
+        self.requests.len()
+    }
+
+    fn insert(&mut self, tx_id: TxId, request: Request) {
+        let sent = tokio::time::Instant::now();
+        let timeout = match &self.timeouts {
+            Some(x) => x.timeout(request.id, request.timeout),
+            None => request.timeout,
+        };
+        let deadline = sent + timeout;
+        self.requests.insert(
+            tx_id,
+            InFlight {
+                request,
+                sent,
+                deadline,
+            },
+        );
+    }
+
+    fn next_deadline(&self) -> Option<tokio::time::Instant> {
+        self.requests.values().map(|x| x.deadline).min()
+    }
+
+    fn handle_read_result(
+        &mut self,
+        result: Result<Result<Frame, Error>, tokio::time::Elapsed>,
+    ) -> Option<SessionError> {
+        match result {
+            Err(_) => {
+                self.fail_expired(tokio::time::Instant::now());
+                None
+            }
+            Ok(Err(err)) => {
+                log::warn!("error occurred making request: {}", err);
+                self.fail_all(err);
+                SessionError::from(&err)
+            }
+            Ok(Ok(frame)) => {
+                self.handle_frame(frame);
+                None
+            }
+        }
+    }
+
+    fn handle_frame(&mut self, frame: Frame) {
+        self.metrics
+            .frame_received(self.overhead + frame.payload().len());
+        match self.requests.remove(&frame.header.tx_id) {
+            Some(x) if self.match_replies && !Self::is_reply(&x.request, &frame) => {
+                // a late reply to a request that timed out, or a reply from another unit
+                self.metrics.tx_id_mismatch();
+                self.out_of_sync = true;
+                log::warn!(
+                    "received a reply from unit {} which doesn't match the outstanding request",
+                    frame.header.unit_id.value
+                );
+                self.requests.insert(frame.header.tx_id, x);
+            }
+            Some(x) => {
+                let rtt = x.sent.elapsed();
+                self.metrics.response_received(frame.payload(), rtt);
+                if let Some(timeouts) = &mut self.timeouts {
+                    timeouts.response_received(x.request.id, rtt);
+                }
+                x.request.handle_response(frame.payload())
+            }
+            None => {
+                self.metrics.tx_id_mismatch();
+                log::warn!(
+                    "received {:?} which doesn't match any outstanding request",
+                    frame.header.tx_id
+                );
+            }
+        }
+    }
+
+    fn is_reply(request: &Request, frame: &Frame) -> bool {
+        // exception replies set the high bit of the function code
+        let function = frame.payload().first().map(|x| x & 0x7F);
+        frame.header.unit_id == request.id
+            && function == Some(request.details.function().get_value())
+    }
+
+    fn fail_expired(&mut self, now: tokio::time::Instant) {
+        let expired: Vec<TxId> = self
+            .requests
+            .iter()
+            .filter(|(_, x)| x.deadline <= now)
+            .map(|(id, _)| *id)
+            .collect();
+
+        for id in expired {
+            if let Some(x) = self.requests.remove(&id) {
+                // without transaction ids, the late reply would be taken for the next one
+                self.out_of_sync |= self.match_replies;
+                self.metrics.timeout();
+                if let Some(timeouts) = &mut self.timeouts {
+                    timeouts.timed_out(x.request.id, now);
+                }
+                log::warn!("error occurred making request: {}", Error::ResponseTimeout);
+                x.request.details.fail(Error::ResponseTimeout);
+            }
+        }
+    }
+
+    fn fail_all(&mut self, err: Error) {
+        let requests = std::mem::take(&mut self.requests);
+        for (_, x) in requests {
+            x.request.details.fail(err);
+        }
+    }
+}
+
+pub(crate) struct ClientLoop<P = MBAPParser, F = MBAPFormatter>
+where
+    P: FrameParser,
+    F: FrameFormatter,
+{
+    rx: RequestQueue,
+    formatter: F,
+    reader: FramedReader<P>,
     tx_id: TxId,
+    // false if the framing has no transaction id, responses then match the single request in flight
+    tx_ids: bool,
+    max_in_flight: usize,
+    in_flight: InFlightRequests,
+    coalesce_reads: bool,
+    coalesce_writes: bool,
+    // minimum silence between a frame being received and the next request being sent
+    inter_frame_delay: Duration,
+    quiet_until: Option<tokio::time::Instant>,
 }
 
 impl ClientLoop {
-    pub(crate) fn new(rx: mpsc::Receiver<Request>) -> Self {
+    pub(crate) fn new(
+        rx: RequestQueue,
+        options: ChannelOptions,
+        metrics: Arc<ChannelCounters>,
+    ) -> Self {
+        ClientLoop::create(
+            rx,
+            MBAPParser::new(),
+            MBAPFormatter::new(options.decode),
+            crate::tcp::frame::constants::HEADER_LENGTH,
+            options,
+            metrics,
+        )
+    }
+}
+
+impl ClientLoop<RtuParser, RtuFormatter> {
+    /// RTU frames have no transaction id, so requests are made one at a time
+    pub(crate) fn rtu(
+        rx: RequestQueue,
+        options: ChannelOptions,
+        metrics: Arc<ChannelCounters>,
+    ) -> Self {
+        let mut client = ClientLoop::create(
+            rx,
+            RtuParser::new(),
+            RtuFormatter::new(options.decode),
+            crate::rtu::frame::constants::HEADER_LENGTH + crate::rtu::frame::constants::CRC_LENGTH,
+            options,
+            metrics,
+        );
+        client.tx_ids = false;
+        client.in_flight.match_replies = true;
+        client.max_in_flight = 1;
+        client.inter_frame_delay = options.inter_frame_delay;
+        client
+    }
+}
+
+impl<P, F> ClientLoop<P, F>
+where
+    P: FrameParser,
+    F: FrameFormatter,
+{
+    fn create(
+        rx: RequestQueue,
+        parser: P,
+        formatter: F,
+        overhead: usize,
+        options: ChannelOptions,
+        metrics: Arc<ChannelCounters>,
+    ) -> Self {
         Self {
             rx,
-            formatter: MBAPFormatter::new(),
-            reader: FramedReader::new(MBAPParser::new()),
+            formatter,
+            reader: FramedReader::with_capacity(
+                parser,
+                options.socket.read_buffer_size.unwrap_or(0),
+                options.decode,
+            ),
             tx_id: TxId::default(),
+            tx_ids: true,
+            max_in_flight: options.window(),
+            in_flight: InFlightRequests::new(
+                overhead,
+                options.adaptive_timeout.map(UnitTimeouts::new),
+                metrics,
+            ),
+            coalesce_reads: options.coalesce_reads,
+            coalesce_writes: options.coalesce_writes,
+            inter_frame_delay: Duration::from_secs(0),
+            quiet_until: None,
+        }
+    }
+
+    // the line must stay silent for the inter-frame delay after a frame is received
+    fn start_silence(&mut self) {
+        if self.inter_frame_delay > Duration::from_secs(0) {
+            self.quiet_until = Some(tokio::time::Instant::now() + self.inter_frame_delay);
         }
     }
 
@@ -53,89 +301,222 @@ impl ClientLoop {
     where
         T: AsyncRead + AsyncWrite + Unpin,
     {
-        while let Some(request) = self.rx.recv().await {
-            if let Some(err) = self.run_one_request(&mut io, request).await {
-                return err;
-            }
+        // bytes left over from a previous stream can't be part of a response on this one
+        self.reader.reset();
+        let result = self.run_impl(&mut io).await;
+        if let SessionError::BadFrame = result {
+            // the rest of the corrupted frame may still be arriving on the same stream
+            self.in_flight.out_of_sync |= self.in_flight.match_replies;
         }
-        SessionError::Shutdown
+        // any request that didn't receive a response can't be completed on this stream
+        let err = match result {
+            SessionError::Shutdown => Error::Shutdown,
+            _ => Error::NoConnection,
+        };
+        self.in_flight.fail_all(err);
+        result
     }
 
-    async fn run_one_request<T>(&mut self, io: &mut T, request: Request) -> Option<SessionError>
+    async fn run_impl<T>(&mut self, io: &mut T) -> SessionError
     where
         T: AsyncRead + AsyncWrite + Unpin,
     {
-        let result = self.execute_request::<T>(io, request).await;
+        // set when the request queue is closed, we stop once the in-flight requests complete
+        let mut closed = false;
 
-        if let Err(e) = result.as_ref() {
-            log::warn!("error occurred making request: {}", e);
-        }
+        loop {
+            // requests that are immediately available go out as long as the window has space
+            if self.in_flight.len() < self.max_in_flight {
+                if let Some((priority, request)) = self.rx.try_next() {
+                    let request = self.coalesce(priority, request);
+                    if let Some(err) = self.send_request(io, request).await {
+                        return err;
+                    }
+                    continue;
+                }
+            }
 
-        result.as_ref().err().and_then(|e| SessionError::from(e))
+            let deadline = match self.in_flight.next_deadline() {
+                Some(x) => x,
+                None => {
+                    // nothing in flight, just wait for the next request
+                    if closed {
+                        return SessionError::Shutdown;
+                    }
+                    match self.rx.next().await {
+                        Some((priority, request)) => {
+                            let request = self.coalesce(priority, request);
+                            if let Some(err) = self.send_request(io, request).await {
+                                return err;
+                            }
+                        }
+                        None => return SessionError::Shutdown,
+                    }
+                    continue;
+                }
+            };
+
+            if closed || self.in_flight.len() >= self.max_in_flight {
+                // the window is full, we can only process responses
+                let result = tokio::time::timeout_at(deadline, self.reader.next_frame(io)).await;
+                let err = self.in_flight.handle_read_result(result);
+                self.start_silence();
+                if let Some(err) = err {
+                    return err;
+                }
+                continue;
+            }
+
+            // the window has space, so service whichever happens first
+            tokio::select! {
+                request = self.rx.next() => {
+                    match request {
+                        Some((priority, request)) => {
+                            let request = self.coalesce(priority, request);
+                            if let Some(err) = self.send_request(io, request).await {
+                                return err;
+                            }
+                        }
+                        None => closed = true,
+                    }
+                }
+                result = tokio::time::timeout_at(deadline, self.reader.next_frame(io)) => {
+                    let err = self.in_flight.handle_read_result(result);
+                    self.start_silence();
+                    if let Some(err) = err {
+                        return err;
+                    }
+                }
+            }
+        }
     }
 
-    async fn execute_request<T>(&mut self, io: &mut T, request: Request) -> Result<(), Error>
-    where
-        T: AsyncRead + AsyncWrite + Unpin,
-    {
-        let tx_id = self.tx_id.next();
-        let bytes = self.formatter.format(
-            FrameHeader::new(request.id, tx_id),
-            request.details.function(),
-            &request.details,
-        )?;
+    /// merge the requests waiting behind the request in its queue into it, if enabled. Only
+    /// a window's worth of requests is taken from the queue to look for candidates.
+    fn coalesce(&mut self, priority: Priority, request: Request) -> Request {
+        let limit = self.max_in_flight;
+        if self.coalesce_reads && request.details.is_read() {
+            return Self::coalesce_reads(request, self.rx.pending(priority, limit));
+        }
+        if self.coalesce_writes {
+            return Self::coalesce_writes(request, self.rx.pending(priority, limit));
+        }
+        request
+    }
 
-        log::info!("-> {:?}", bytes);
+    fn coalesce_writes(request: Request, mut pending: Pending) -> Request {
+        let mut run = match WriteRun::start(request) {
+            Ok(x) => x,
+            Err(request) => return request,
+        };
 
-        io.write_all(bytes).await?;
+        // writes are applied in order, so the run ends at the first one that doesn't extend it
+        while let Some(next) = pending.remove(0) {
+            if let Err(next) = run.push(next) {
+                pending.insert(0, next);
+                break;
+            }
+        }
 
-        let deadline = tokio::time::Instant::now() + request.timeout;
+        run.finish()
+    }
 
-        // loop until we get a response with the correct tx id or we timeout
-        let response = loop {
-            let frame = match tokio::time::timeout_at(deadline, self.reader.next_frame(io)).await {
-                Err(_) => {
-                    request.details.fail(Error::ResponseTimeout);
-                    return Ok(());
+    fn coalesce_reads(mut request: Request, mut pending: Pending) -> Request {
+        // the combined range grows with each merge, so a read that was skipped may fit later
+        loop {
+            let mut merged = false;
+            let mut index = 0;
+            while let Some(next) = pending.get(index) {
+                // reads can't be moved ahead of a write, it might change the values they read
+                if !next.details.is_read() {
+                    break;
                 }
-                Ok(result) => match result {
-                    Ok(frame) => frame,
-                    Err(err) => {
-                        request.details.fail(err);
-                        return Err(err);
+                if let Some(candidate) = pending.remove(index) {
+                    match request.coalesce(candidate) {
+                        Ok(()) => merged = true,
+                        Err(candidate) => {
+                            pending.insert(index, candidate);
+                            index += 1;
+                        }
                     }
-                },
-            };
+                }
+            }
+            if !merged {
+                return request;
+            }
+        }
+    }
 
-            log::info!("<- {:?}", frame.payload());
+    async fn send_request<T>(&mut self, io: &mut T, request: Request) -> Option<SessionError>
+    where
+        T: AsyncRead + AsyncWrite + Unpin,
+    {
+        if !self.in_flight.admit(&request) {
+            request.details.fail(Error::UnitUnavailable);
+            return None;
+        }
 
-            if frame.header.tx_id != tx_id {
-                log::warn!(
-                    "received {:?} while expecting {:?}",
-                    frame.header.tx_id,
-                    tx_id
-                );
-                continue; // next iteration of loop
+        if self.in_flight.out_of_sync {
+            // discarding the bytes until the line is idle also provides the silence
+            self.in_flight.out_of_sync = false;
+            self.quiet_until = None;
+            if let Err(err) = self
+                .reader
+                .discard_until_idle(io, self.inter_frame_delay)
+                .await
+            {
+                let err: Error = err.into();
+                log::warn!("error occurred making request: {}", err);
+                request.details.fail(err);
+                return SessionError::from(&err);
             }
+        }
 
-            break frame;
+        if let Some(x) = self.quiet_until.take() {
+            tokio::time::delay_until(x).await;
+        }
+
+        let tx_id = if self.tx_ids {
+            self.tx_id.next()
+        } else {
+            TxId::default()
         };
+        let bytes = match self.formatter.format(
+            FrameHeader::new(request.id, tx_id),
+            request.details.function(),
+            &request.details,
+        ) {
+            Ok(x) => x,
+            Err(err) => {
+                log::warn!("error occurred making request: {}", err);
+                request.details.fail(err);
+                return None;
+            }
+        };
+
+        if let Err(err) = io.write_all(bytes).await {
+            let err: Error = err.into();
+            log::warn!("error occurred making request: {}", err);
+            request.details.fail(err);
+            return SessionError::from(&err);
+        }
 
-        request.handle_response(response.payload());
-        Ok(())
+        self.in_flight.metrics.request_sent(bytes.len());
+        self.in_flight.insert(tx_id, request);
+        None
     }
 
     pub(crate) async fn fail_requests_for(&mut self, duration: Duration) -> Result<(), ()> {
         let deadline = tokio::time::Instant::now() + duration;
 
         loop {
-            match tokio::time::timeout_at(deadline, self.rx.recv()).await {
+            match tokio::time::timeout_at(deadline, self.rx.next()).await {
                 // timeout occurred
                 Err(_) => return Ok(()),
                 // channel was closed
                 Ok(None) => return Err(()),
                 // fail request, do another iteration
-                Ok(Some(request)) => request.details.fail(Error::NoConnection),
+                Ok(Some((_, request))) => request.details.fail(Error::NoConnection),
             }
         }
     }
@@ -144,27 +525,61 @@ impl ClientLoop {
 #[cfg(test)]
 mod tests {
     use super::*;
+    use crate::client::channel::AdaptiveTimeout;
     use crate::client::message::RequestDetails;
+    use crate::client::queue::RequestSenders;
     use crate::client::requests::read_bits::ReadBits;
+    use crate::client::requests::read_registers::ReadRegisters;
+    use crate::client::requests::write_single::SingleWrite;
     use crate::common::function::FunctionCode;
     use crate::common::traits::Serialize;
+    use crate::decode::DecodeLevel;
     use crate::error::details::FrameParseError;
-    use crate::types::{AddressRange, Indexed, UnitId};
+    use crate::types::{AddressRange, Indexed, UnitId, WriteMultiple};
 
-    struct ClientFixture {
-        tx: tokio::sync::mpsc::Sender<Request>,
-        client: ClientLoop,
+    struct ClientFixture<P = MBAPParser, F = MBAPFormatter>
+    where
+        P: FrameParser,
+        F: FrameFormatter,
+    {
+        tx: RequestSenders,
+        client: ClientLoop<P, F>,
+        metrics: Arc<ChannelCounters>,
     }
 
     impl ClientFixture {
         fn new() -> Self {
-            let (tx, rx) = tokio::sync::mpsc::channel(10);
+            Self::with_options(ChannelOptions::default())
+        }
+
+        fn with_options(options: ChannelOptions) -> Self {
+            let (tx, rx) = RequestQueue::create(10, 10, 10);
+            let metrics = Arc::new(ChannelCounters::default());
+            Self {
+                tx,
+                client: ClientLoop::new(rx, options, metrics.clone()),
+                metrics,
+            }
+        }
+    }
+
+    impl ClientFixture<RtuParser, RtuFormatter> {
+        fn rtu(options: ChannelOptions) -> Self {
+            let (tx, rx) = RequestQueue::create(10, 10, 10);
+            let metrics = Arc::new(ChannelCounters::default());
             Self {
                 tx,
-                client: ClientLoop::new(rx),
+                client: ClientLoop::rtu(rx, options, metrics.clone()),
+                metrics,
             }
         }
+    }
 
+    impl<P, F> ClientFixture<P, F>
+    where
+        P: FrameParser,
+        F: FrameFormatter,
+    {
         fn read_coils(
             &mut self,
             range: AddressRange,
@@ -176,19 +591,76 @@ mod tests {
                 crate::client::requests::read_bits::Promise::Channel(tx),
             ));
             let request = Request::new(UnitId::new(1), timeout, details);
-            if let Err(_) = tokio_test::block_on(self.tx.send(request)) {
+            if let Err(_) = tokio_test::block_on(self.tx.get(Priority::Interactive).send(request)) {
                 panic!("can't send");
             }
             rx
         }
+
+        fn read_holding_registers(
+            &mut self,
+            range: AddressRange,
+        ) -> tokio::sync::oneshot::Receiver<Result<Vec<Indexed<u16>>, Error>> {
+            let (tx, rx) = tokio::sync::oneshot::channel();
+            let details = RequestDetails::ReadHoldingRegisters(ReadRegisters::new(
+                range.of_read_registers().unwrap(),
+                crate::client::requests::read_registers::Promise::Channel(tx),
+            ));
+            let request = Request::new(UnitId::new(1), Duration::from_secs(1), details);
+            if let Err(_) = tokio_test::block_on(self.tx.get(Priority::Interactive).send(request)) {
+                panic!("can't send");
+            }
+            rx
+        }
+
+        fn write_single_coil(
+            &mut self,
+            value: Indexed<bool>,
+        ) -> tokio::sync::oneshot::Receiver<Result<Indexed<bool>, Error>> {
+            let (tx, rx) = tokio::sync::oneshot::channel();
+            let details = RequestDetails::WriteSingleCoil(SingleWrite::new(
+                value,
+                crate::client::message::Promise::Channel(tx),
+            ));
+            let request = Request::new(UnitId::new(1), Duration::from_secs(1), details);
+            if let Err(_) = tokio_test::block_on(self.tx.get(Priority::Interactive).send(request)) {
+                panic!("can't send");
+            }
+            rx
+        }
+    }
+
+    fn coalescing() -> ChannelOptions {
+        ChannelOptions {
+            coalesce_reads: true,
+            coalesce_writes: true,
+            ..ChannelOptions::default()
+        }
     }
 
     fn get_framed_adu<T>(function: FunctionCode, payload: &T) -> Vec<u8>
     where
         T: Serialize + Sized,
     {
-        let mut fmt = MBAPFormatter::new();
-        let header = FrameHeader::new(UnitId::new(1), TxId::new(0));
+        get_framed_adu_with_tx_id(TxId::new(0), function, payload)
+    }
+
+    fn get_framed_adu_with_tx_id<T>(tx_id: TxId, function: FunctionCode, payload: &T) -> Vec<u8>
+    where
+        T: Serialize + Sized,
+    {
+        let mut fmt = MBAPFormatter::new(DecodeLevel::Nothing);
+        let header = FrameHeader::new(UnitId::new(1), tx_id);
+        let bytes = fmt.format(header, function, payload).unwrap();
+        Vec::from(bytes)
+    }
+
+    fn get_rtu_frame<T>(function: FunctionCode, payload: &T) -> Vec<u8>
+    where
+        T: Serialize + Sized,
+    {
+        let mut fmt = RtuFormatter::new(DecodeLevel::Nothing);
+        let header = FrameHeader::new(UnitId::new(1), TxId::default());
         let bytes = fmt.format(header, function, payload).unwrap();
         Vec::from(bytes)
     }
@@ -230,6 +702,45 @@ mod tests {
         assert_eq!(result, Err(Error::ResponseTimeout));
     }
 
+    #[test]
+    fn requests_fail_fast_once_a_unit_stops_responding() {
+        let mut fixture = ClientFixture::with_options(ChannelOptions {
+            adaptive_timeout: Some(AdaptiveTimeout {
+                min_timeout: Duration::from_secs(0),
+                max_timeout: Duration::from_secs(0),
+                failure_threshold: 1,
+                retry_delay: Duration::from_secs(60),
+            }),
+            ..ChannelOptions::default()
+        });
+
+        let range = AddressRange::try_from(7, 2).unwrap();
+
+        // only the first request is written
+        let io = tokio_test::io::Builder::new()
+            .write(&get_framed_adu(FunctionCode::ReadCoils, &range))
+            .wait(Duration::from_secs(5))
+            .build();
+
+        let rx1 = fixture.read_coils(range, Duration::from_secs(1));
+        let rx2 = fixture.read_coils(range, Duration::from_secs(1));
+        drop(fixture.tx);
+
+        assert_eq!(
+            tokio_test::block_on(fixture.client.run(io)),
+            SessionError::Shutdown
+        );
+        assert_eq!(
+            tokio_test::block_on(rx1).unwrap(),
+            Err(Error::ResponseTimeout)
+        );
+        assert_eq!(
+            tokio_test::block_on(rx2).unwrap(),
+            Err(Error::UnitUnavailable)
+        );
+        assert_eq!(fixture.metrics.snapshot().requests_sent, 1);
+    }
+
     #[test]
     fn framing_errors_kill_the_session() {
         let mut fixture = ClientFixture::new();
@@ -286,4 +797,353 @@ mod tests {
             vec![Indexed::new(7, true), Indexed::new(8, false)]
         );
     }
+
+    #[test]
+    fn metrics_count_responses_and_mismatched_tx_ids() {
+        let mut fixture = ClientFixture::new();
+
+        let range = AddressRange::try_from(7, 2).unwrap();
+
+        let request = get_framed_adu(FunctionCode::ReadCoils, &range);
+        let stale = get_framed_adu_with_tx_id(
+            TxId::new(42),
+            FunctionCode::ReadCoils,
+            &[false, false].as_ref(),
+        );
+        let response = get_framed_adu(FunctionCode::ReadCoils, &[true, false].as_ref());
+
+        let io = tokio_test::io::Builder::new()
+            .write(&request)
+            .read(&stale)
+            .read(&response)
+            .build();
+
+        let rx = fixture.read_coils(range, Duration::from_secs(1));
+        drop(fixture.tx);
+
+        assert_eq!(
+            tokio_test::block_on(fixture.client.run(io)),
+            SessionError::Shutdown
+        );
+        assert!(tokio_test::block_on(rx).unwrap().is_ok());
+
+        let metrics = fixture.metrics.snapshot();
+        assert_eq!(metrics.requests_sent, 1);
+        assert_eq!(metrics.responses_received, 1);
+        assert_eq!(metrics.tx_id_mismatches, 1);
+        assert_eq!(metrics.timeouts, 0);
+        assert_eq!(metrics.bytes_sent, request.len() as u64);
+        assert_eq!(
+            metrics.bytes_received,
+            (stale.len() + response.len()) as u64
+        );
+        assert_eq!(metrics.response_latency.count(), 1);
+    }
+
+    #[test]
+    fn pipelined_responses_can_arrive_out_of_order() {
+        let mut fixture = ClientFixture::with_options(ChannelOptions::new(2));
+
+        let range1 = AddressRange::try_from(7, 2).unwrap();
+        let range2 = AddressRange::try_from(10, 1).unwrap();
+
+        let request1 = get_framed_adu_with_tx_id(TxId::new(0), FunctionCode::ReadCoils, &range1);
+        let request2 = get_framed_adu_with_tx_id(TxId::new(1), FunctionCode::ReadCoils, &range2);
+        let response1 = get_framed_adu_with_tx_id(
+            TxId::new(0),
+            FunctionCode::ReadCoils,
+            &[true, false].as_ref(),
+        );
+        let response2 =
+            get_framed_adu_with_tx_id(TxId::new(1), FunctionCode::ReadCoils, &[true].as_ref());
+
+        // both requests go out before any response arrives
+        let io = tokio_test::io::Builder::new()
+            .write(&request1)
+            .write(&request2)
+            .read(&response2)
+            .read(&response1)
+            .build();
+
+        let rx1 = fixture.read_coils(range1, Duration::from_secs(1));
+        let rx2 = fixture.read_coils(range2, Duration::from_secs(1));
+        drop(fixture.tx);
+
+        assert_eq!(
+            tokio_test::block_on(fixture.client.run(io)),
+            SessionError::Shutdown
+        );
+
+        assert_eq!(
+            tokio_test::block_on(rx1).unwrap().unwrap(),
+            vec![Indexed::new(7, true), Indexed::new(8, false)]
+        );
+        assert_eq!(
+            tokio_test::block_on(rx2).unwrap().unwrap(),
+            vec![Indexed::new(10, true)]
+        );
+    }
+
+    #[test]
+    fn coalesces_overlapping_and_adjacent_reads_into_one_request() {
+        let mut fixture = ClientFixture::with_options(coalescing());
+
+        let range = |start, count| AddressRange::try_from(start, count).unwrap();
+        let values: Vec<u16> = (0..40).collect();
+
+        let request = get_framed_adu(FunctionCode::ReadHoldingRegisters, &range(0, 40));
+        let response = get_framed_adu(FunctionCode::ReadHoldingRegisters, &values.as_slice());
+
+        let io = tokio_test::io::Builder::new()
+            .write(&request)
+            .read(&response)
+            .build();
+
+        let rx1 = fixture.read_holding_registers(range(0, 10));
+        let rx2 = fixture.read_holding_registers(range(10, 10));
+        let rx3 = fixture.read_holding_registers(range(15, 25));
+        drop(fixture.tx);
+
+        assert_eq!(
+            tokio_test::block_on(fixture.client.run(io)),
+            SessionError::Shutdown
+        );
+
+        let expected = |start: u16, end: u16| -> Vec<Indexed<u16>> {
+            (start..end).map(|x| Indexed::new(x, x)).collect()
+        };
+        assert_eq!(tokio_test::block_on(rx1).unwrap().unwrap(), expected(0, 10));
+        assert_eq!(
+            tokio_test::block_on(rx2).unwrap().unwrap(),
+            expected(10, 20)
+        );
+        assert_eq!(
+            tokio_test::block_on(rx3).unwrap().unwrap(),
+            expected(15, 40)
+        );
+        assert_eq!(fixture.metrics.snapshot().requests_sent, 1);
+    }
+
+    #[test]
+    fn reads_are_not_coalesced_across_a_write() {
+        let mut fixture = ClientFixture::with_options(coalescing());
+
+        let range1 = AddressRange::try_from(0, 2).unwrap();
+        let range2 = AddressRange::try_from(2, 2).unwrap();
+        let write = Indexed::new(1, true);
+
+        let io = tokio_test::io::Builder::new()
+            .write(&get_framed_adu_with_tx_id(
+                TxId::new(0),
+                FunctionCode::ReadCoils,
+                &range1,
+            ))
+            .read(&get_framed_adu_with_tx_id(
+                TxId::new(0),
+                FunctionCode::ReadCoils,
+                &[true, false].as_ref(),
+            ))
+            .write(&get_framed_adu_with_tx_id(
+                TxId::new(1),
+                FunctionCode::WriteSingleCoil,
+                &write,
+            ))
+            .read(&get_framed_adu_with_tx_id(
+                TxId::new(1),
+                FunctionCode::WriteSingleCoil,
+                &write,
+            ))
+            .write(&get_framed_adu_with_tx_id(
+                TxId::new(2),
+                FunctionCode::ReadCoils,
+                &range2,
+            ))
+            .read(&get_framed_adu_with_tx_id(
+                TxId::new(2),
+                FunctionCode::ReadCoils,
+                &[false, true].as_ref(),
+            ))
+            .build();
+
+        let rx1 = fixture.read_coils(range1, Duration::from_secs(1));
+        let rx2 = fixture.write_single_coil(write);
+        let rx3 = fixture.read_coils(range2, Duration::from_secs(1));
+        drop(fixture.tx);
+
+        assert_eq!(
+            tokio_test::block_on(fixture.client.run(io)),
+            SessionError::Shutdown
+        );
+
+        assert!(tokio_test::block_on(rx1).unwrap().is_ok());
+        assert_eq!(tokio_test::block_on(rx2).unwrap(), Ok(write));
+        assert_eq!(
+            tokio_test::block_on(rx3).unwrap().unwrap(),
+            vec![Indexed::new(2, false), Indexed::new(3, true)]
+        );
+    }
+
+    #[test]
+    fn combines_single_writes_to_consecutive_addresses() {
+        let mut fixture = ClientFixture::with_options(coalescing());
+
+        let combined = WriteMultiple::from(1, vec![true, false, true]).unwrap();
+        let single = Indexed::new(5, true);
+
+        let io = tokio_test::io::Builder::new()
+            .write(&get_framed_adu_with_tx_id(
+                TxId::new(0),
+                FunctionCode::WriteMultipleCoils,
+                &combined,
+            ))
+            .read(&get_framed_adu_with_tx_id(
+                TxId::new(0),
+                FunctionCode::WriteMultipleCoils,
+                &combined.range,
+            ))
+            .write(&get_framed_adu_with_tx_id(
+                TxId::new(1),
+                FunctionCode::WriteSingleCoil,
+                &single,
+            ))
+            .read(&get_framed_adu_with_tx_id(
+                TxId::new(1),
+                FunctionCode::WriteSingleCoil,
+                &single,
+            ))
+            .build();
+
+        let rx1 = fixture.write_single_coil(Indexed::new(1, true));
+        let rx2 = fixture.write_single_coil(Indexed::new(2, false));
+        let rx3 = fixture.write_single_coil(Indexed::new(3, true));
+        // not consecutive, so sent on its own
+        let rx4 = fixture.write_single_coil(single);
+        drop(fixture.tx);
+
+        assert_eq!(
+            tokio_test::block_on(fixture.client.run(io)),
+            SessionError::Shutdown
+        );
+
+        assert_eq!(
+            tokio_test::block_on(rx1).unwrap(),
+            Ok(Indexed::new(1, true))
+        );
+        assert_eq!(
+            tokio_test::block_on(rx2).unwrap(),
+            Ok(Indexed::new(2, false))
+        );
+        assert_eq!(
+            tokio_test::block_on(rx3).unwrap(),
+            Ok(Indexed::new(3, true))
+        );
+        assert_eq!(tokio_test::block_on(rx4).unwrap(), Ok(single));
+    }
+
+    #[test]
+    fn rtu_requests_are_sent_one_at_a_time_without_tx_ids() {
+        let mut fixture = ClientFixture::rtu(ChannelOptions::new(4));
+
+        let first = AddressRange::try_from(0, 1).unwrap();
+        let second = AddressRange::try_from(10, 1).unwrap();
+
+        // the second request isn't written until the first response is received
+        let io = tokio_test::io::Builder::new()
+            .write(&get_rtu_frame(FunctionCode::ReadHoldingRegisters, &first))
+            .read(&[0x01, 0x03, 0x02, 0x00, 0x2A, 0x39, 0x9B])
+            .write(&get_rtu_frame(FunctionCode::ReadHoldingRegisters, &second))
+            .read(&get_rtu_frame(
+                FunctionCode::ReadHoldingRegisters,
+                &[7u16].as_ref(),
+            ))
+            .build();
+
+        let rx1 = fixture.read_holding_registers(first);
+        let rx2 = fixture.read_holding_registers(second);
+        drop(fixture.tx);
+
+        assert_eq!(
+            tokio_test::block_on(fixture.client.run(io)),
+            SessionError::Shutdown
+        );
+        assert_eq!(
+            tokio_test::block_on(rx1).unwrap(),
+            Ok(vec![Indexed::new(0, 42)])
+        );
+        assert_eq!(
+            tokio_test::block_on(rx2).unwrap(),
+            Ok(vec![Indexed::new(10, 7)])
+        );
+    }
+
+    fn with_crc(bytes: &[u8]) -> Vec<u8> {
+        let mut frame = bytes.to_vec();
+        frame.extend_from_slice(&crate::rtu::crc::crc16(bytes).to_le_bytes());
+        frame
+    }
+
+    #[test]
+    fn rtu_replies_that_do_not_match_the_request_are_ignored() {
+        let mut fixture = ClientFixture::rtu(ChannelOptions::new(4));
+        let range = AddressRange::try_from(0, 1).unwrap();
+
+        let io = tokio_test::io::Builder::new()
+            .write(&get_rtu_frame(FunctionCode::ReadHoldingRegisters, &range))
+            // a late reply to a read of coils and a reply from another unit
+            .read(&with_crc(&[0x01, 0x01, 0x01, 0x01]))
+            .read(&with_crc(&[0x02, 0x03, 0x02, 0x00, 0x07]))
+            .read(&with_crc(&[0x01, 0x03, 0x02, 0x00, 0x2A]))
+            .build();
+
+        let rx = fixture.read_holding_registers(range);
+        drop(fixture.tx);
+
+        assert_eq!(
+            tokio_test::block_on(fixture.client.run(io)),
+            SessionError::Shutdown
+        );
+        assert_eq!(
+            tokio_test::block_on(rx).unwrap(),
+            Ok(vec![Indexed::new(0, 42)])
+        );
+        assert_eq!(fixture.metrics.snapshot().tx_id_mismatches, 2);
+    }
+
+    #[test]
+    fn rtu_discards_received_bytes_until_the_line_is_idle_after_a_bad_frame() {
+        let mut fixture = ClientFixture::rtu(ChannelOptions {
+            inter_frame_delay: Duration::from_millis(10),
+            ..ChannelOptions::new(4)
+        });
+        let first = AddressRange::try_from(0, 1).unwrap();
+        let second = AddressRange::try_from(10, 1).unwrap();
+
+        let mut io = tokio_test::io::Builder::new()
+            .write(&get_rtu_frame(FunctionCode::ReadHoldingRegisters, &first))
+            // bad CRC followed by the rest of a garbled frame
+            .read(&[0x01, 0x03, 0x02, 0x00, 0x2A, 0xFF, 0xFF])
+            .read(&[0x01, 0x03])
+            .wait(Duration::from_millis(50))
+            .write(&get_rtu_frame(FunctionCode::ReadHoldingRegisters, &second))
+            .read(&with_crc(&[0x01, 0x03, 0x02, 0x00, 0x07]))
+            .build();
+
+        let rx1 = fixture.read_holding_registers(first);
+        let rx2 = fixture.read_holding_registers(second);
+        drop(fixture.tx);
+
+        assert_eq!(
+            tokio_test::block_on(fixture.client.run(&mut io)),
+            SessionError::BadFrame
+        );
+        assert_eq!(
+            tokio_test::block_on(fixture.client.run(&mut io)),
+            SessionError::Shutdown
+        );
+        assert!(tokio_test::block_on(rx1).unwrap().is_err());
+        assert_eq!(
+            tokio_test::block_on(rx2).unwrap(),
+            Ok(vec![Indexed::new(10, 7)])
+        );
+    }
 }
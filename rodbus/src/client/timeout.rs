@@ -0,0 +1,203 @@
+use std::collections::BTreeMap;
+use std::time::Duration;
+
+use tokio::time::Instant;
+
+use crate::client::channel::AdaptiveTimeout;
+use crate::types::UnitId;
+
+// smallest variance term added to the smoothed round trip time
+const GRANULARITY: Duration = Duration::from_millis(1);
+// each consecutive timeout doubles the timeout of a unit, up to this many times
+const MAX_BACKOFF: u32 = 6;
+
+/// round trip time estimate and failure history of a single unit
+#[derive(Default)]
+struct UnitState {
+    // smoothed round trip time, None until the first response
+    srtt: Option<Duration>,
+    rttvar: Duration,
+    backoff: u32,
+    consecutive_timeouts: u16,
+    // requests fail fast until this time, after which a single request probes the unit
+    open_until: Option<Instant>,
+}
+
+impl UnitState {
+    fn sample(&mut self, rtt: Duration) {
+        match self.srtt {
+            None => {
+                self.srtt = Some(rtt);
+                self.rttvar = rtt / 2;
+            }
+            Some(srtt) => {
+                let delta = if srtt > rtt { srtt - rtt } else { rtt - srtt };
+                self.rttvar = self.rttvar * 3 / 4 + delta / 4;
+                self.srtt = Some(srtt * 7 / 8 + rtt / 8);
+            }
+        }
+        self.backoff = 0;
+        self.consecutive_timeouts = 0;
+        self.open_until = None;
+    }
+}
+
+/// Derives the response timeout of each request from the round trip times measured to its
+/// unit, in the way TCP derives its retransmission timeout (RFC 6298), and stops sending
+/// requests to units that have stopped responding
+pub(crate) struct UnitTimeouts {
+    settings: AdaptiveTimeout,
+    units: BTreeMap<UnitId, UnitState>,
+}
+
+impl UnitTimeouts {
+    pub(crate) fn new(settings: AdaptiveTimeout) -> Self {
+        Self {
+            settings,
+            units: BTreeMap::new(),
+        }
+    }
+
+    /// timeout for a request to a unit, the requested timeout is used until the unit responds
+    pub(crate) fn timeout(&self, id: UnitId, requested: Duration) -> Duration {
+        let (base, backoff) = match self.units.get(&id) {
+            Some(unit) => {
+                let base = match unit.srtt {
+                    Some(srtt) => srtt + std::cmp::max(unit.rttvar * 4, GRANULARITY),
+                    None => requested,
+                };
+                (base, unit.backoff)
+            }
+            None => (requested, 0),
+        };
+
+        let timeout = base
+            .checked_mul(1 << backoff)
+            .unwrap_or(self.settings.max_timeout);
+
+        std::cmp::min(
+            std::cmp::max(timeout, self.settings.min_timeout),
+            self.settings.max_timeout,
+        )
+    }
+
+    /// returns false if requests to the unit should fail without being sent
+    pub(crate) fn admit(&mut self, id: UnitId, now: Instant) -> bool {
+        let retry_delay = self.settings.retry_delay;
+        let unit = match self.units.get_mut(&id) {
+            Some(x) => x,
+            None => return true,
+        };
+
+        match unit.open_until {
+            Some(x) if now < x => false,
+            Some(_) => {
+                // let a single request through to probe the unit
+                unit.open_until = Some(now + retry_delay);
+                true
+            }
+            None => true,
+        }
+    }
+
+    pub(crate) fn response_received(&mut self, id: UnitId, rtt: Duration) {
+        self.units.entry(id).or_default().sample(rtt);
+    }
+
+    pub(crate) fn timed_out(&mut self, id: UnitId, now: Instant) {
+        let threshold = self.settings.failure_threshold;
+        let retry_delay = self.settings.retry_delay;
+        let unit = self.units.entry(id).or_default();
+
+        unit.backoff = std::cmp::min(unit.backoff + 1, MAX_BACKOFF);
+        unit.consecutive_timeouts = unit.consecutive_timeouts.saturating_add(1);
+
+        if threshold > 0 && unit.consecutive_timeouts >= threshold {
+            if unit.open_until.is_none() {
+                log::warn!(
+                    "unit {} failed to respond {} times, failing requests for {:?}",
+                    id.value,
+                    unit.consecutive_timeouts,
+                    retry_delay
+                );
+            }
+            unit.open_until = Some(now + retry_delay);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn settings() -> AdaptiveTimeout {
+        AdaptiveTimeout {
+            min_timeout: Duration::from_millis(50),
+            max_timeout: Duration::from_secs(2),
+            failure_threshold: 2,
+            retry_delay: Duration::from_secs(5),
+        }
+    }
+
+    #[test]
+    fn derives_timeout_from_round_trip_times() {
+        let mut timeouts = UnitTimeouts::new(settings());
+        let unit = UnitId::new(1);
+
+        // clamped requested timeout until the first response
+        assert_eq!(
+            timeouts.timeout(unit, Duration::from_secs(10)),
+            Duration::from_secs(2)
+        );
+
+        // srtt of 100 ms and variance of 50 ms
+        timeouts.response_received(unit, Duration::from_millis(100));
+        assert_eq!(
+            timeouts.timeout(unit, Duration::from_secs(10)),
+            Duration::from_millis(300)
+        );
+
+        // a constant round trip time shrinks the variance towards the floor
+        for _ in 0..100 {
+            timeouts.response_received(unit, Duration::from_millis(10));
+        }
+        assert_eq!(
+            timeouts.timeout(unit, Duration::from_secs(10)),
+            Duration::from_millis(50)
+        );
+
+        // other units are unaffected
+        assert_eq!(
+            timeouts.timeout(UnitId::new(2), Duration::from_secs(1)),
+            Duration::from_secs(1)
+        );
+    }
+
+    #[test]
+    fn timeouts_back_off_and_open_the_breaker() {
+        let mut timeouts = UnitTimeouts::new(settings());
+        let unit = UnitId::new(1);
+        let now = Instant::now();
+
+        timeouts.response_received(unit, Duration::from_millis(100));
+        timeouts.timed_out(unit, now);
+        assert_eq!(
+            timeouts.timeout(unit, Duration::from_secs(10)),
+            Duration::from_millis(600)
+        );
+        assert!(timeouts.admit(unit, now));
+
+        timeouts.timed_out(unit, now);
+        assert!(!timeouts.admit(unit, now));
+        assert!(timeouts.admit(UnitId::new(2), now));
+
+        // a single probe once the delay has passed
+        let later = now + Duration::from_secs(5);
+        assert!(timeouts.admit(unit, later));
+        assert!(!timeouts.admit(unit, later));
+
+        // a response closes the breaker
+        timeouts.response_received(unit, Duration::from_millis(100));
+        assert!(timeouts.admit(unit, later));
+    }
+}
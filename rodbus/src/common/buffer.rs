@@ -30,6 +30,19 @@ impl ReadBuffer {
         self.begin == self.end
     }
 
+    /// discard every buffered byte
+    #[cfg_attr(feature = "no-panic", no_panic)]
+    pub(crate) fn clear(&mut self) {
+        self.begin = 0;
+        self.end = 0;
+    }
+
+    /// the bytes that are buffered, without consuming them
+    #[cfg_attr(feature = "no-panic", no_panic)]
+    pub(crate) fn peek(&self) -> &[u8] {
+        self.buffer.get(self.begin..self.end).unwrap_or(&[])
+    }
+
     #[cfg_attr(feature = "no-panic", no_panic)]
     pub(crate) fn read(&mut self, count: usize) -> Result<&[u8], details::InternalError> {
         if self.len() < count {
@@ -67,9 +80,10 @@ impl ReadBuffer {
 
     #[cfg_attr(feature = "no-panic", no_panic)]
     pub(crate) fn read_u16_be(&mut self) -> Result<u16, details::InternalError> {
-        let b1 = self.read_u8()? as u16;
-        let b2 = self.read_u8()? as u16;
-        Ok((b1 << 8) | b2)
+        match self.read(2)? {
+            [high, low] => Ok(u16::from_be_bytes([*high, *low])),
+            x => Err(details::InternalError::InsufficientBytesForRead(2, x.len())),
+        }
     }
 
     pub(crate) async fn read_some<T: AsyncRead + Unpin>(
@@ -83,8 +97,9 @@ impl ReadBuffer {
             self.end = 0;
         }
 
-        // if we've reached capacity, but still need more data we have to shift
-        if self.end == self.buffer.capacity() {
+        // only shift if there's no space left at the end, a partial frame is never more than
+        // a single frame so this copies at most one frame's worth of bytes
+        if self.end == self.buffer.len() {
             let length = self.len();
             self.buffer.copy_within(self.begin..self.end, 0);
             self.begin = 0;
@@ -0,0 +1,128 @@
+//! Bulk conversion between slices of values and their representation on the wire
+//!
+//! Bits are converted 8 at a time using 64-bit arithmetic, one byte per bit, and registers
+//! are converted with fixed size chunks. Both forms are simple enough for the compiler to
+//! vectorize without any platform specific code.
+
+#[cfg(feature = "no-panic")]
+use no_panic::no_panic;
+
+// multiplying 8 bytes that are each 0 or 1 moves the low bit of byte i into bit 56 + i
+const PACK_MAGIC: u64 = 0x0102_0408_1020_4080;
+// copies a byte into every byte of a word
+const BROADCAST: u64 = 0x0101_0101_0101_0101;
+// selects bit i of byte i
+const BIT_MASKS: u64 = 0x8040_2010_0804_0201;
+
+/// Pack the values into bytes, the first value of each group of 8 in the least significant bit
+///
+/// `output` must have room for one byte per 8 values, any extra bytes are left untouched.
+#[cfg_attr(feature = "no-panic", no_panic)]
+pub(crate) fn pack_bits(values: &[bool], output: &mut [u8]) {
+    for (chunk, byte) in values.chunks(8).zip(output.iter_mut()) {
+        let mut lanes = [0u8; 8];
+        for (lane, value) in lanes.iter_mut().zip(chunk) {
+            *lane = *value as u8;
+        }
+        *byte = (u64::from_le_bytes(lanes).wrapping_mul(PACK_MAGIC) >> 56) as u8;
+    }
+}
+
+/// Unpack `output.len()` bits from `bytes` starting at bit `offset`. Bits beyond the
+/// end of `bytes` are unpacked as false.
+#[cfg_attr(feature = "no-panic", no_panic)]
+pub(crate) fn unpack_bits(bytes: &[u8], offset: usize, output: &mut [bool]) {
+    let first = offset / 8;
+    let shift = offset % 8;
+    for (i, chunk) in output.chunks_mut(8).enumerate() {
+        // the 8 bits may straddle two bytes when the offset isn't a multiple of 8
+        let low = bytes.get(first + i).copied().unwrap_or(0) as u16;
+        let high = bytes.get(first + i + 1).copied().unwrap_or(0) as u16;
+        let byte = ((low | (high << 8)) >> shift) as u8;
+        let lanes = ((byte as u64).wrapping_mul(BROADCAST) & BIT_MASKS).to_le_bytes();
+        for (value, lane) in chunk.iter_mut().zip(lanes.iter()) {
+            *value = *lane != 0;
+        }
+    }
+}
+
+/// Write the registers into `output` in big-endian order
+#[cfg_attr(feature = "no-panic", no_panic)]
+pub(crate) fn write_registers(values: &[u16], output: &mut [u8]) {
+    for (value, bytes) in values.iter().zip(output.chunks_exact_mut(2)) {
+        for (byte, x) in bytes.iter_mut().zip(value.to_be_bytes().iter()) {
+            *byte = *x;
+        }
+    }
+}
+
+/// Read big-endian registers from `bytes` into `output`
+#[cfg_attr(feature = "no-panic", no_panic)]
+pub(crate) fn read_registers(bytes: &[u8], output: &mut [u16]) {
+    for (bytes, value) in bytes.chunks_exact(2).zip(output.iter_mut()) {
+        if let [high, low] = bytes {
+            *value = u16::from_be_bytes([*high, *low]);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn bits(count: usize) -> Vec<bool> {
+        // a pattern that doesn't repeat every 8 bits
+        (0..count).map(|i| (i * 7 + i / 3) % 5 < 2).collect()
+    }
+
+    fn naive_pack(values: &[bool]) -> Vec<u8> {
+        let mut bytes = vec![0u8; (values.len() + 7) / 8];
+        for (i, value) in values.iter().enumerate() {
+            if *value {
+                bytes[i / 8] |= 1 << (i % 8);
+            }
+        }
+        bytes
+    }
+
+    #[test]
+    fn packs_bits_like_the_naive_loop() {
+        for count in 0..=70 {
+            let values = bits(count);
+            let mut output = vec![0u8; (count + 7) / 8];
+            pack_bits(&values, &mut output);
+            assert_eq!(output, naive_pack(&values), "count: {}", count);
+        }
+    }
+
+    #[test]
+    fn unpacks_bits_at_every_offset() {
+        let values = bits(2000);
+        let bytes = naive_pack(&values);
+        for offset in 0..17 {
+            for count in &[0, 1, 7, 8, 9, 63, 64, 65, 2000 - offset] {
+                let mut output = vec![true; *count];
+                unpack_bits(&bytes, offset, &mut output);
+                assert_eq!(
+                    output.as_slice(),
+                    &values[offset..offset + count],
+                    "offset: {} count: {}",
+                    offset,
+                    count
+                );
+            }
+        }
+    }
+
+    #[test]
+    fn converts_registers_to_and_from_big_endian() {
+        let values: Vec<u16> = (0..125).map(|i| 0xCA00 | i).collect();
+        let mut bytes = vec![0u8; 250];
+        write_registers(&values, &mut bytes);
+        assert_eq!(&bytes[..4], &[0xCA, 0x00, 0xCA, 0x01]);
+
+        let mut output = vec![0u16; 125];
+        read_registers(&bytes, &mut output);
+        assert_eq!(output, values);
+    }
+}
@@ -53,9 +53,10 @@ impl<'a> ReadCursor<'a> {
 
     #[cfg_attr(feature = "no-panic", no_panic)]
     pub(crate) fn read_u16_be(&mut self) -> Result<u16, ADUParseError> {
-        let high = self.read_u8()?;
-        let low = self.read_u8()?;
-        Ok((high as u16) << 8 | (low as u16))
+        match self.read_bytes(2)? {
+            [high, low] => Ok(u16::from_be_bytes([*high, *low])),
+            _ => Err(ADUParseError::InsufficientBytes),
+        }
     }
 
     #[cfg_attr(feature = "no-panic", no_panic)]
@@ -130,4 +131,33 @@ impl<'a> WriteCursor<'a> {
         self.write_u8(upper)?;
         self.write_u8(lower)
     }
+
+    /// Reserve the next `count` bytes and fill them in a single pass
+    ///
+    /// Nothing is written if there isn't space for all of the bytes
+    #[cfg_attr(feature = "no-panic", no_panic)]
+    pub(crate) fn write_with<F>(
+        &mut self,
+        count: usize,
+        write: F,
+    ) -> Result<(), details::InternalError>
+    where
+        F: FnOnce(&mut [u8]),
+    {
+        let remaining = self.remaining();
+        match self
+            .dest
+            .get_mut(self.pos..)
+            .and_then(|x| x.get_mut(..count))
+        {
+            Some(x) => {
+                write(x);
+                self.pos += count;
+                Ok(())
+            }
+            None => Err(details::InternalError::InsufficientWriteSpace(
+                count, remaining,
+            )),
+        }
+    }
 }
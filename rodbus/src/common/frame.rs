@@ -3,6 +3,7 @@ use tokio::io::AsyncRead;
 use crate::common::buffer::ReadBuffer;
 use crate::common::function::FunctionCode;
 use crate::common::traits::Serialize;
+use crate::decode::{DecodeLevel, FrameDisplay};
 use crate::error::details::{ExceptionCode, InternalError};
 use crate::error::Error;
 use crate::server::response::{ErrorResponse, Response};
@@ -12,7 +13,7 @@ pub(crate) mod constants {
     pub(crate) const MAX_ADU_LENGTH: usize = 253;
 }
 
-#[derive(PartialEq, Copy, Clone, Debug)]
+#[derive(PartialEq, Eq, PartialOrd, Ord, Copy, Clone, Debug)]
 pub(crate) struct TxId {
     value: u16,
 }
@@ -56,33 +57,47 @@ impl FrameHeader {
     }
 }
 
-pub(crate) struct Frame {
+/// A complete frame that borrows its ADU directly from the read buffer
+pub(crate) struct Frame<'a> {
     pub(crate) header: FrameHeader,
-    length: usize,
-    adu: [u8; constants::MAX_ADU_LENGTH],
+    adu: &'a [u8],
 }
 
-impl Frame {
-    pub(crate) fn new(header: FrameHeader) -> Frame {
-        Frame {
-            header,
-            length: 0,
-            adu: [0; constants::MAX_ADU_LENGTH],
-        }
+impl<'a> Frame<'a> {
+    pub(crate) fn new(header: FrameHeader, adu: &'a [u8]) -> Self {
+        Frame { header, adu }
     }
 
-    pub(crate) fn set(&mut self, src: &[u8]) -> bool {
-        if src.len() > self.adu.len() {
-            return false;
-        }
+    pub(crate) fn payload(&self) -> &'a [u8] {
+        self.adu
+    }
+}
+
+/// Describes a frame whose ADU is fully contained in the read buffer
+#[derive(Copy, Clone)]
+pub(crate) struct FrameInfo {
+    pub(crate) header: FrameHeader,
+    /// number of bytes at the front of the buffer that make up the ADU
+    pub(crate) adu_length: usize,
+    /// number of bytes that follow the ADU and are discarded with it, e.g. an RTU CRC
+    pub(crate) trailer_length: usize,
+}
 
-        self.adu[0..src.len()].copy_from_slice(src);
-        self.length = src.len();
-        true
+impl FrameInfo {
+    pub(crate) fn new(header: FrameHeader, adu_length: usize) -> Self {
+        Self::with_trailer(header, adu_length, 0)
     }
 
-    pub(crate) fn payload(&self) -> &[u8] {
-        &self.adu[0..self.length]
+    pub(crate) fn with_trailer(
+        header: FrameHeader,
+        adu_length: usize,
+        trailer_length: usize,
+    ) -> Self {
+        FrameInfo {
+            header,
+            adu_length,
+            trailer_length,
+        }
     }
 }
 
@@ -98,9 +113,13 @@ pub(crate) trait FrameParser {
      *
      * Err implies the input data is invalid
      * Ok(None) implies that more data is required to complete parsing
-     * Ok(Some(..)) will contain a fully parsed frame and will advance the Cursor appropriately
+     * Ok(Some(..)) implies that the ADU described by the FrameInfo is fully buffered, the
+     * framer reads it directly from the buffer without copying it
      */
-    fn parse(&mut self, cursor: &mut ReadBuffer) -> Result<Option<Frame>, Error>;
+    fn parse(&mut self, cursor: &mut ReadBuffer) -> Result<Option<FrameInfo>, Error>;
+
+    /// Forget any partially parsed frame
+    fn reset(&mut self);
 }
 
 pub(crate) trait FrameFormatter {
@@ -164,28 +183,88 @@ where
 {
     parser: T,
     buffer: ReadBuffer,
+    decode: DecodeLevel,
 }
 
 impl<T: FrameParser> FramedReader<T> {
-    pub(crate) fn new(parser: T) -> Self {
+    /// create a reader whose buffer holds a single frame
+    #[cfg(test)]
+    pub(crate) fn new(parser: T, decode: DecodeLevel) -> Self {
         let size = parser.max_frame_size();
+        Self::with_capacity(parser, size, decode)
+    }
+
+    /// create a reader whose buffer can hold more than a single frame
+    pub(crate) fn with_capacity(parser: T, capacity: usize, decode: DecodeLevel) -> Self {
+        let size = std::cmp::max(capacity, parser.max_frame_size());
         Self {
             parser,
             buffer: ReadBuffer::new(size),
+            decode,
         }
     }
 
-    pub(crate) async fn next_frame<R>(&mut self, io: &mut R) -> Result<Frame, Error>
+    /// discard any buffered bytes, e.g. when a new connection is established
+    pub(crate) fn reset(&mut self) {
+        self.parser.reset();
+        self.buffer.clear();
+    }
+
+    /// discard the buffered bytes, and any bytes received, until nothing has been received for
+    /// the idle period, e.g. to skip the rest of a corrupted or late RTU frame
+    pub(crate) async fn discard_until_idle<R>(
+        &mut self,
+        io: &mut R,
+        idle: std::time::Duration,
+    ) -> Result<(), std::io::Error>
     where
         R: AsyncRead + Unpin,
     {
         loop {
-            match self.parser.parse(&mut self.buffer)? {
-                Some(frame) => return Ok(frame),
-                None => {
-                    self.buffer.read_some(io).await?;
+            self.reset();
+            match tokio::time::timeout(idle, self.buffer.read_some(io)).await {
+                Ok(result) => {
+                    result?;
                 }
+                // nothing was received for the idle period
+                Err(_) => return Ok(()),
+            }
+        }
+    }
+
+    /// parse a frame that is already fully buffered without reading from the stream
+    pub(crate) fn try_next_frame(&mut self) -> Result<Option<Frame>, Error> {
+        match self.parser.parse(&mut self.buffer)? {
+            Some(info) => Ok(Some(self.read_frame(info)?)),
+            None => Ok(None),
+        }
+    }
+
+    pub(crate) async fn next_frame<R>(&mut self, io: &mut R) -> Result<Frame<'_>, Error>
+    where
+        R: AsyncRead + Unpin,
+    {
+        loop {
+            if let Some(info) = self.parser.parse(&mut self.buffer)? {
+                return self.read_frame(info);
+            }
+            self.buffer.read_some(io).await?;
+        }
+    }
+
+    fn read_frame(&mut self, info: FrameInfo) -> Result<Frame, Error> {
+        let bytes = self.buffer.read(info.adu_length + info.trailer_length)?;
+        let adu = match bytes.get(..info.adu_length) {
+            Some(x) => x,
+            None => {
+                return Err(
+                    InternalError::InsufficientBytesForRead(info.adu_length, bytes.len()).into(),
+                )
             }
+        };
+        if self.decode.enabled() {
+            log::info!("<- {}", FrameDisplay::new(self.decode, info.header, adu));
         }
+        Ok(Frame::new(info.header, adu))
     }
 }
@@ -9,6 +9,7 @@ mod constants {
     pub(crate) const WRITE_SINGLE_REGISTER: u8 = 6;
     pub(crate) const WRITE_MULTIPLE_COILS: u8 = 15;
     pub(crate) const WRITE_MULTIPLE_REGISTERS: u8 = 16;
+    pub(crate) const READ_WRITE_MULTIPLE_REGISTERS: u8 = 23;
 }
 
 #[derive(Debug, Copy, Clone, PartialEq)]
@@ -22,6 +23,7 @@ pub(crate) enum FunctionCode {
     WriteSingleRegister = constants::WRITE_SINGLE_REGISTER,
     WriteMultipleCoils = constants::WRITE_MULTIPLE_COILS,
     WriteMultipleRegisters = constants::WRITE_MULTIPLE_REGISTERS,
+    ReadWriteMultipleRegisters = constants::READ_WRITE_MULTIPLE_REGISTERS,
 }
 
 impl Display for FunctionCode {
@@ -35,6 +37,9 @@ impl Display for FunctionCode {
             FunctionCode::WriteSingleRegister => f.write_str("WRITE SINGLE REGISTERS"),
             FunctionCode::WriteMultipleCoils => f.write_str("WRITE MULTIPLE COILS"),
             FunctionCode::WriteMultipleRegisters => f.write_str("WRITE MULTIPLE REGISTERS"),
+            FunctionCode::ReadWriteMultipleRegisters => {
+                f.write_str("READ/WRITE MULTIPLE REGISTERS")
+            }
         }
     }
 }
@@ -58,6 +63,9 @@ impl FunctionCode {
             constants::WRITE_SINGLE_REGISTER => Some(FunctionCode::WriteSingleRegister),
             constants::WRITE_MULTIPLE_COILS => Some(FunctionCode::WriteMultipleCoils),
             constants::WRITE_MULTIPLE_REGISTERS => Some(FunctionCode::WriteMultipleRegisters),
+            constants::READ_WRITE_MULTIPLE_REGISTERS => {
+                Some(FunctionCode::ReadWriteMultipleRegisters)
+            }
             _ => None,
         }
     }
@@ -3,6 +3,7 @@ pub(crate) mod traits;
 
 pub(crate) mod bits;
 pub(crate) mod buffer;
+pub(crate) mod bulk;
 pub(crate) mod cursor;
 pub(crate) mod frame;
 mod parse;
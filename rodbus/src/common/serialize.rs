@@ -1,10 +1,10 @@
 use std::convert::TryFrom;
 
+use crate::common::bulk;
 use crate::common::cursor::WriteCursor;
 use crate::common::traits::Serialize;
 use crate::error::details;
 use crate::error::*;
-use crate::server::response::{BitWriter, RegisterWriter};
 use crate::types::{coil_to_u16, AddressRange, Indexed, WriteMultiple};
 
 pub(crate) fn calc_bytes_for_bits(num_bits: usize) -> Result<u8, details::InternalError> {
@@ -57,72 +57,7 @@ impl Serialize for &[bool] {
         let num_bytes = calc_bytes_for_bits(self.len())?;
 
         cursor.write_u8(num_bytes)?;
-
-        for byte in self.chunks(8) {
-            let mut acc: u8 = 0;
-            for (count, bit) in byte.iter().enumerate() {
-                if *bit {
-                    acc |= 1 << count as u8;
-                }
-            }
-            cursor.write_u8(acc)?;
-        }
-
-        Ok(())
-    }
-}
-
-impl<T> Serialize for BitWriter<T>
-where
-    T: Fn(u16) -> Result<bool, details::ExceptionCode>,
-{
-    fn serialize(&self, cursor: &mut WriteCursor) -> Result<(), Error> {
-        let range = self.range.get();
-        // write the number of bytes that follow
-        let num_bytes = calc_bytes_for_bits(range.count as usize)?;
-        cursor.write_u8(num_bytes)?;
-
-        let mut acc = 0;
-        let mut num_bits: usize = 0;
-
-        // iterate over all the addresses, accumulating bits in the byte
-        for address in self.range.inner.iter() {
-            if (self.getter)(address)? {
-                // merge the bit into the byte
-                acc |= 1 << num_bits;
-            }
-            num_bits += 1;
-            if num_bits == 8 {
-                // flush the byte
-                cursor.write_u8(acc)?;
-                acc = 0;
-                num_bits = 0;
-            }
-        }
-
-        // write any partial bytes
-        if num_bits > 0 {
-            cursor.write_u8(acc)?;
-        }
-
-        Ok(())
-    }
-}
-
-impl<T> Serialize for RegisterWriter<T>
-where
-    T: Fn(u16) -> Result<u16, details::ExceptionCode>,
-{
-    fn serialize(&self, cursor: &mut WriteCursor) -> Result<(), Error> {
-        // write the number of bytes that follow
-        let num_bytes = calc_bytes_for_registers(self.range.inner.count as usize)?;
-        cursor.write_u8(num_bytes)?;
-
-        // iterate over all the addresses, accumulating the registers
-        for address in self.range.inner.iter() {
-            let value = (self.getter)(address)?;
-            cursor.write_u16_be(value)?;
-        }
+        cursor.write_with(num_bytes as usize, |bytes| bulk::pack_bits(self, bytes))?;
 
         Ok(())
     }
@@ -132,10 +67,9 @@ impl Serialize for &[u16] {
     fn serialize(&self, cursor: &mut WriteCursor) -> Result<(), Error> {
         let num_bytes = calc_bytes_for_registers(self.len())?;
         cursor.write_u8(num_bytes)?;
-
-        for value in *self {
-            cursor.write_u16_be(*value)?
-        }
+        cursor.write_with(num_bytes as usize, |bytes| {
+            bulk::write_registers(self, bytes)
+        })?;
 
         Ok(())
     }
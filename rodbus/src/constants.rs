@@ -16,6 +16,8 @@ pub mod limits {
     pub const MAX_WRITE_COILS_COUNT: u16 = 0x07B0;
     /// Maximum count allowed in a `write multiple registers` request
     pub const MAX_WRITE_REGISTERS_COUNT: u16 = 0x007B;
+    /// Maximum count of registers written by a `read/write multiple registers` request
+    pub const MAX_READ_WRITE_REGISTERS_WRITE_COUNT: u16 = 0x0079;
 }
 
 /// Modbus exception codes
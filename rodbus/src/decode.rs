@@ -0,0 +1,120 @@
+use std::fmt::{Display, Formatter};
+
+use crate::common::frame::FrameHeader;
+use crate::common::function::FunctionCode;
+
+/// Controls how much of each transmitted and received frame is decoded and logged
+///
+/// Frames are logged at the `Info` level. When the level is `Nothing`, the only cost
+/// on the hot path is a single comparison.
+#[derive(Copy, Clone, Debug, PartialEq, Eq, PartialOrd, Ord)]
+pub enum DecodeLevel {
+    /// don't log anything
+    Nothing,
+    /// log the transaction id, unit id and length of each frame
+    Header,
+    /// log the header and the function code
+    Function,
+    /// log the header, the function code and a hex dump of the ADU
+    Payload,
+}
+
+impl Default for DecodeLevel {
+    fn default() -> Self {
+        DecodeLevel::Nothing
+    }
+}
+
+impl DecodeLevel {
+    pub(crate) fn enabled(self) -> bool {
+        self != DecodeLevel::Nothing
+    }
+}
+
+/// Lazily formats a frame according to a decode level
+pub(crate) struct FrameDisplay<'a> {
+    level: DecodeLevel,
+    header: FrameHeader,
+    adu: &'a [u8],
+}
+
+impl<'a> FrameDisplay<'a> {
+    pub(crate) fn new(level: DecodeLevel, header: FrameHeader, adu: &'a [u8]) -> Self {
+        Self { level, header, adu }
+    }
+}
+
+impl<'a> Display for FrameDisplay<'a> {
+    fn fmt(&self, f: &mut Formatter<'_>) -> std::fmt::Result {
+        write!(
+            f,
+            "tx id: {} unit: {} len: {}",
+            self.header.tx_id.to_u16(),
+            self.header.unit_id.value,
+            self.adu.len()
+        )?;
+
+        if self.level < DecodeLevel::Function {
+            return Ok(());
+        }
+
+        if let Some(value) = self.adu.first() {
+            match FunctionCode::get(*value & 0x7F) {
+                Some(function) if *value & 0x80 != 0 => write!(f, " fc: {} (exception)", function)?,
+                Some(function) => write!(f, " fc: {}", function)?,
+                None => write!(f, " fc: unknown ({:#04X})", value)?,
+            }
+        }
+
+        if self.level < DecodeLevel::Payload {
+            return Ok(());
+        }
+
+        for (i, byte) in self.adu.iter().enumerate() {
+            if i % 16 == 0 {
+                f.write_str("\n   ")?;
+            }
+            write!(f, " {:02X}", byte)?;
+        }
+
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::common::frame::TxId;
+    use crate::types::UnitId;
+
+    fn format(level: DecodeLevel, adu: &[u8]) -> String {
+        let header = FrameHeader::new(UnitId::new(1), TxId::new(7));
+        format!("{}", FrameDisplay::new(level, header, adu))
+    }
+
+    #[test]
+    fn formats_increasing_amount_of_detail() {
+        let adu = &[0x03, 0x00, 0x01, 0x00, 0x02];
+        assert_eq!(format(DecodeLevel::Header, adu), "tx id: 7 unit: 1 len: 5");
+        assert_eq!(
+            format(DecodeLevel::Function, adu),
+            "tx id: 7 unit: 1 len: 5 fc: READ HOLDING REGISTERS"
+        );
+        assert_eq!(
+            format(DecodeLevel::Payload, adu),
+            "tx id: 7 unit: 1 len: 5 fc: READ HOLDING REGISTERS\n    03 00 01 00 02"
+        );
+    }
+
+    #[test]
+    fn formats_exceptions_and_unknown_functions() {
+        assert_eq!(
+            format(DecodeLevel::Function, &[0x83, 0x02]),
+            "tx id: 7 unit: 1 len: 2 fc: READ HOLDING REGISTERS (exception)"
+        );
+        assert_eq!(
+            format(DecodeLevel::Function, &[0x41]),
+            "tx id: 7 unit: 1 len: 1 fc: unknown (0x41)"
+        );
+    }
+}
@@ -13,6 +13,8 @@ pub enum Error {
     NoConnection,
     /// the task processing requests has been shutdown
     Shutdown,
+    /// the request wasn't sent because the unit has stopped responding to requests
+    UnitUnavailable,
 }
 
 impl std::error::Error for Error {}
@@ -29,6 +31,7 @@ impl std::fmt::Display for Error {
             Error::ResponseTimeout => f.write_str("response timeout"),
             Error::NoConnection => f.write_str("no connection to server"),
             Error::Shutdown => f.write_str("channel shutdown"),
+            Error::UnitUnavailable => f.write_str("unit not responding, request not sent"),
         }
     }
 }
@@ -283,6 +286,12 @@ pub mod details {
         MBAPLengthTooBig(usize, usize), // actual size and the maximum size
         /// Received TCP frame within non-Modbus protocol id
         UnknownProtocolId(u16),
+        /// Received RTU frame with a function code whose length can't be determined
+        RtuUnknownFunction(u8),
+        /// Received RTU frame with length that exceeds max allowed size
+        RtuFrameTooBig(usize, usize), // actual size and the maximum size
+        /// Received RTU frame with a CRC that doesn't match its contents
+        CrcValidationFailure(u16, u16), // received and computed CRC
     }
 
     impl std::error::Error for FrameParseError {}
@@ -301,6 +310,21 @@ pub mod details {
                 FrameParseError::UnknownProtocolId(id) => {
                     write!(f, "Received TCP frame with non-Modbus protocol id: {}", id)
                 }
+                FrameParseError::RtuUnknownFunction(function) => write!(
+                    f,
+                    "Received RTU frame with unknown function code: {:#04X}",
+                    function
+                ),
+                FrameParseError::RtuFrameTooBig(size, max) => write!(
+                    f,
+                    "Received RTU frame with length ({}) that exceeds max allowed size ({})",
+                    size, max
+                ),
+                FrameParseError::CrcValidationFailure(received, computed) => write!(
+                    f,
+                    "Received RTU frame with CRC ({:#06X}) that doesn't match the computed CRC ({:#06X})",
+                    received, computed
+                ),
             }
         }
     }
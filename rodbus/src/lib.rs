@@ -180,21 +180,32 @@ clippy::all
     bare_trait_objects
 )]
 
+#[cfg(feature = "bench")]
+#[doc(hidden)]
+/// entry points into the internal codec used by the benchmarks
+pub mod bench;
 /// client API
 pub mod client;
 /// public constant values related to the Modbus specification
 pub mod constants;
+/// types that control how frames are decoded and logged
+pub mod decode;
 /// error types associated with making requests
 pub mod error;
+/// counters and histograms maintained by channels and servers
+pub mod metrics;
 /// prelude used to include all of the API types
 pub mod prelude;
 /// server API
 pub mod server;
 /// types used to shutdown async tasks
 pub mod shutdown;
+/// settings applied to the TCP sockets of channels and servers
+pub mod socket;
 /// types used in requests and responses
 pub mod types;
 
 // internal modules
 mod common;
+mod rtu;
 mod tcp;
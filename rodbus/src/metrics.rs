@@ -0,0 +1,439 @@
+use std::sync::atomic::{AtomicBool, AtomicU64, AtomicUsize, Ordering};
+use std::time::Duration;
+
+use crate::error::details::ExceptionCode;
+
+/// Number of buckets in a [`LatencyHistogram`]
+///
+/// Bucket 0 counts samples under 1 µs and bucket `i` counts samples in `[2^(i-1), 2^i)` µs.
+/// The last bucket also counts every sample too large for the others (> ~67 seconds).
+///
+/// [`LatencyHistogram`]: struct.LatencyHistogram.html
+pub const NUM_LATENCY_BUCKETS: usize = 28;
+
+// exception codes 1 to 11 are defined by the standard, index 0 counts all the others
+const NUM_EXCEPTION_CODES: usize = 12;
+
+fn exception_index(code: ExceptionCode) -> usize {
+    match code {
+        ExceptionCode::Unknown(_) => 0,
+        x => u8::from(x) as usize,
+    }
+}
+
+fn load(value: &AtomicU64) -> u64 {
+    value.load(Ordering::Relaxed)
+}
+
+fn increment(value: &AtomicU64) {
+    value.fetch_add(1, Ordering::Relaxed);
+}
+
+fn add(value: &AtomicU64, amount: usize) {
+    value.fetch_add(amount as u64, Ordering::Relaxed);
+}
+
+/// Snapshot of a distribution of durations recorded in power of 2 microsecond buckets
+#[derive(Copy, Clone, Debug, Default, PartialEq)]
+pub struct LatencyHistogram {
+    buckets: [u64; NUM_LATENCY_BUCKETS],
+    sum_us: u64,
+}
+
+impl LatencyHistogram {
+    /// Number of samples in each bucket, paired with the (exclusive) upper bound of the bucket
+    pub fn buckets(&self) -> impl Iterator<Item = (Duration, u64)> + '_ {
+        self.buckets
+            .iter()
+            .enumerate()
+            .map(|(i, count)| (Self::upper_bound(i), *count))
+    }
+
+    /// Total number of recorded samples
+    pub fn count(&self) -> u64 {
+        self.buckets.iter().sum()
+    }
+
+    /// Average of all the recorded samples, or `None` if there aren't any
+    pub fn mean(&self) -> Option<Duration> {
+        match self.count() {
+            0 => None,
+            count => Some(Duration::from_micros(self.sum_us / count)),
+        }
+    }
+
+    /// Upper bound of the bucket that contains the requested percentile (0.0 to 100.0),
+    /// or `None` if there are no samples
+    pub fn percentile(&self, percentile: f64) -> Option<Duration> {
+        let count = self.count();
+        if count == 0 {
+            return None;
+        }
+
+        let rank = ((percentile.max(0.0).min(100.0) / 100.0) * count as f64).ceil() as u64;
+        let mut total = 0;
+        for (i, bucket) in self.buckets.iter().enumerate() {
+            total += bucket;
+            if total >= rank.max(1) {
+                return Some(Self::upper_bound(i));
+            }
+        }
+        Some(Self::upper_bound(NUM_LATENCY_BUCKETS - 1))
+    }
+
+    /// Add the samples of another histogram to this one, e.g. to combine the histograms of
+    /// several channels
+    pub fn merge(&mut self, other: &LatencyHistogram) {
+        for (dest, src) in self.buckets.iter_mut().zip(other.buckets.iter()) {
+            *dest += src;
+        }
+        self.sum_us = self.sum_us.saturating_add(other.sum_us);
+    }
+
+    /// Add a sample, e.g. to build a histogram from latencies measured outside of the library
+    pub fn record(&mut self, duration: Duration) {
+        let (us, index) = bucket(duration);
+        self.buckets[index] += 1;
+        self.sum_us = self.sum_us.saturating_add(us);
+    }
+
+    fn upper_bound(index: usize) -> Duration {
+        Duration::from_micros(1 << index)
+    }
+}
+
+// a duration in microseconds and the index of the bucket that counts it
+fn bucket(duration: Duration) -> (u64, usize) {
+    let us = std::cmp::min(duration.as_micros(), u64::MAX as u128) as u64;
+    let index = std::cmp::min((64 - us.leading_zeros()) as usize, NUM_LATENCY_BUCKETS - 1);
+    (us, index)
+}
+
+/// Lock-free accumulator backing a `LatencyHistogram`
+#[derive(Default)]
+pub(crate) struct Histogram {
+    buckets: [AtomicU64; NUM_LATENCY_BUCKETS],
+    sum_us: AtomicU64,
+}
+
+impl Histogram {
+    pub(crate) fn record(&self, duration: Duration) {
+        let (us, index) = bucket(duration);
+        increment(&self.buckets[index]);
+        self.sum_us.fetch_add(us, Ordering::Relaxed);
+    }
+
+    pub(crate) fn snapshot(&self) -> LatencyHistogram {
+        let mut buckets = [0; NUM_LATENCY_BUCKETS];
+        for (dest, src) in buckets.iter_mut().zip(self.buckets.iter()) {
+            *dest = load(src);
+        }
+        LatencyHistogram {
+            buckets,
+            sum_us: load(&self.sum_us),
+        }
+    }
+}
+
+/// Snapshot of the number of exception responses for each exception code
+#[derive(Copy, Clone, Debug, Default, PartialEq)]
+pub struct ExceptionCounts {
+    counts: [u64; NUM_EXCEPTION_CODES],
+}
+
+impl ExceptionCounts {
+    /// Number of exceptions with this code. All of the codes not defined by the
+    /// standard are counted together, so any `ExceptionCode::Unknown` returns their sum.
+    pub fn get(&self, code: ExceptionCode) -> u64 {
+        self.counts[exception_index(code)]
+    }
+
+    /// Total number of exceptions, regardless of the code
+    pub fn total(&self) -> u64 {
+        self.counts.iter().sum()
+    }
+}
+
+#[derive(Default)]
+struct ExceptionCounters {
+    counts: [AtomicU64; NUM_EXCEPTION_CODES],
+}
+
+impl ExceptionCounters {
+    fn record(&self, code: ExceptionCode) {
+        increment(&self.counts[exception_index(code)]);
+    }
+
+    fn snapshot(&self) -> ExceptionCounts {
+        let mut counts = [0; NUM_EXCEPTION_CODES];
+        for (dest, src) in counts.iter_mut().zip(self.counts.iter()) {
+            *dest = load(src);
+        }
+        ExceptionCounts { counts }
+    }
+}
+
+// the exception code of an exception response PDU, if it is one
+fn exception_code(pdu: &[u8]) -> Option<ExceptionCode> {
+    match pdu {
+        [function, code, ..] if function & 0x80 != 0 => Some(ExceptionCode::from(*code)),
+        _ => None,
+    }
+}
+
+/// Snapshot of the counters maintained by a client channel
+#[derive(Copy, Clone, Debug, Default, PartialEq)]
+pub struct ChannelMetrics {
+    /// Number of requests written to the connection
+    pub requests_sent: u64,
+    /// Number of responses that matched an outstanding request
+    pub responses_received: u64,
+    /// Number of requests that didn't receive a response before their timeout expired
+    pub timeouts: u64,
+    /// Exception responses received, by exception code
+    pub exceptions: ExceptionCounts,
+    /// Number of responses whose transaction id didn't match any outstanding request
+    pub tx_id_mismatches: u64,
+    /// Number of successful connections
+    pub connects: u64,
+    /// Number of failed connection attempts
+    pub connect_failures: u64,
+    /// Number of bytes written to the connection
+    pub bytes_sent: u64,
+    /// Number of bytes received in complete frames
+    pub bytes_received: u64,
+    /// Time between writing each request and receiving its response
+    pub response_latency: LatencyHistogram,
+}
+
+#[derive(Default)]
+pub(crate) struct ChannelCounters {
+    requests_sent: AtomicU64,
+    responses_received: AtomicU64,
+    timeouts: AtomicU64,
+    exceptions: ExceptionCounters,
+    tx_id_mismatches: AtomicU64,
+    connects: AtomicU64,
+    connect_failures: AtomicU64,
+    bytes_sent: AtomicU64,
+    bytes_received: AtomicU64,
+    response_latency: Histogram,
+    // whether the channel currently has a connection, not part of the snapshot
+    online: AtomicBool,
+}
+
+impl ChannelCounters {
+    pub(crate) fn request_sent(&self, bytes: usize) {
+        increment(&self.requests_sent);
+        add(&self.bytes_sent, bytes);
+    }
+
+    pub(crate) fn frame_received(&self, bytes: usize) {
+        add(&self.bytes_received, bytes);
+    }
+
+    pub(crate) fn response_received(&self, pdu: &[u8], latency: Duration) {
+        increment(&self.responses_received);
+        self.response_latency.record(latency);
+        if let Some(code) = exception_code(pdu) {
+            self.exceptions.record(code);
+        }
+    }
+
+    pub(crate) fn timeout(&self) {
+        increment(&self.timeouts);
+    }
+
+    pub(crate) fn tx_id_mismatch(&self) {
+        increment(&self.tx_id_mismatches);
+    }
+
+    pub(crate) fn connected(&self) {
+        increment(&self.connects);
+        self.online.store(true, Ordering::Relaxed);
+    }
+
+    pub(crate) fn disconnected(&self) {
+        self.online.store(false, Ordering::Relaxed);
+    }
+
+    pub(crate) fn is_connected(&self) -> bool {
+        self.online.load(Ordering::Relaxed)
+    }
+
+    pub(crate) fn connect_failed(&self) {
+        increment(&self.connect_failures);
+    }
+
+    pub(crate) fn snapshot(&self) -> ChannelMetrics {
+        ChannelMetrics {
+            requests_sent: load(&self.requests_sent),
+            responses_received: load(&self.responses_received),
+            timeouts: load(&self.timeouts),
+            exceptions: self.exceptions.snapshot(),
+            tx_id_mismatches: load(&self.tx_id_mismatches),
+            connects: load(&self.connects),
+            connect_failures: load(&self.connect_failures),
+            bytes_sent: load(&self.bytes_sent),
+            bytes_received: load(&self.bytes_received),
+            response_latency: self.response_latency.snapshot(),
+        }
+    }
+}
+
+/// Snapshot of the counters maintained by a server
+#[derive(Copy, Clone, Debug, Default, PartialEq)]
+pub struct ServerMetrics {
+    /// Number of sessions that are currently open
+    pub active_sessions: usize,
+    /// Number of connections accepted
+    pub sessions_accepted: u64,
+    /// Number of sessions closed to make room for a new connection
+    pub sessions_evicted: u64,
+    /// Number of requests received for a mapped unit id
+    pub requests_received: u64,
+    /// Exception responses sent, by exception code
+    pub exceptions: ExceptionCounts,
+    /// Number of bytes received in complete frames
+    pub bytes_received: u64,
+    /// Number of bytes written to the sessions
+    pub bytes_sent: u64,
+    /// Time spent waiting to acquire the lock on exclusive handlers
+    pub handler_lock_wait: LatencyHistogram,
+}
+
+#[derive(Default)]
+pub(crate) struct ServerCounters {
+    active_sessions: AtomicUsize,
+    sessions_accepted: AtomicU64,
+    sessions_evicted: AtomicU64,
+    requests_received: AtomicU64,
+    exceptions: ExceptionCounters,
+    bytes_received: AtomicU64,
+    bytes_sent: AtomicU64,
+    handler_lock_wait: Histogram,
+}
+
+impl ServerCounters {
+    pub(crate) fn session_accepted(&self) {
+        increment(&self.sessions_accepted);
+    }
+
+    pub(crate) fn session_evicted(&self) {
+        increment(&self.sessions_evicted);
+    }
+
+    pub(crate) fn set_active_sessions(&self, count: usize) {
+        self.active_sessions.store(count, Ordering::Relaxed);
+    }
+
+    pub(crate) fn frame_received(&self, bytes: usize) {
+        add(&self.bytes_received, bytes);
+    }
+
+    pub(crate) fn request_received(&self) {
+        increment(&self.requests_received);
+    }
+
+    pub(crate) fn reply_queued(&self, pdu: &[u8]) {
+        if let Some(code) = exception_code(pdu) {
+            self.exceptions.record(code);
+        }
+    }
+
+    pub(crate) fn bytes_sent(&self, bytes: usize) {
+        add(&self.bytes_sent, bytes);
+    }
+
+    pub(crate) fn lock_acquired(&self, wait: Duration) {
+        self.handler_lock_wait.record(wait);
+    }
+
+    pub(crate) fn snapshot(&self) -> ServerMetrics {
+        ServerMetrics {
+            active_sessions: self.active_sessions.load(Ordering::Relaxed),
+            sessions_accepted: load(&self.sessions_accepted),
+            sessions_evicted: load(&self.sessions_evicted),
+            requests_received: load(&self.requests_received),
+            exceptions: self.exceptions.snapshot(),
+            bytes_received: load(&self.bytes_received),
+            bytes_sent: load(&self.bytes_sent),
+            handler_lock_wait: self.handler_lock_wait.snapshot(),
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn histogram_records_samples_in_power_of_two_buckets() {
+        let histogram = Histogram::default();
+        histogram.record(Duration::from_micros(0));
+        histogram.record(Duration::from_micros(3));
+        histogram.record(Duration::from_micros(1000));
+        histogram.record(Duration::from_secs(3600));
+
+        let snapshot = histogram.snapshot();
+        let buckets: Vec<(Duration, u64)> = snapshot.buckets().filter(|(_, x)| *x > 0).collect();
+        assert_eq!(
+            buckets,
+            vec![
+                (Duration::from_micros(1), 1),
+                (Duration::from_micros(4), 1),
+                (Duration::from_micros(1024), 1),
+                (Duration::from_micros(1 << 27), 1),
+            ]
+        );
+        assert_eq!(snapshot.count(), 4);
+        assert_eq!(snapshot.percentile(50.0), Some(Duration::from_micros(4)));
+        assert_eq!(snapshot.percentile(75.0), Some(Duration::from_micros(1024)));
+        assert_eq!(
+            snapshot.percentile(100.0),
+            Some(Duration::from_micros(1 << 27))
+        );
+        assert_eq!(LatencyHistogram::default().percentile(50.0), None);
+    }
+
+    #[test]
+    fn snapshots_and_recorded_histograms_agree() {
+        let histogram = Histogram::default();
+        let mut recorded = LatencyHistogram::default();
+        for us in &[0, 3, 1000, 50_000] {
+            histogram.record(Duration::from_micros(*us));
+            recorded.record(Duration::from_micros(*us));
+        }
+        assert_eq!(recorded, histogram.snapshot());
+    }
+
+    #[test]
+    fn merged_histograms_combine_samples() {
+        let first = Histogram::default();
+        first.record(Duration::from_micros(3));
+        let second = Histogram::default();
+        second.record(Duration::from_micros(1000));
+        second.record(Duration::from_micros(1000));
+
+        let mut merged = first.snapshot();
+        merged.merge(&second.snapshot());
+        assert_eq!(merged.count(), 3);
+        assert_eq!(merged.mean(), Some(Duration::from_micros(667)));
+        assert_eq!(merged.percentile(50.0), Some(Duration::from_micros(1024)));
+    }
+
+    #[test]
+    fn counts_exceptions_by_code() {
+        let counters = ChannelCounters::default();
+        counters.response_received(&[0x03, 0x02, 0xCA, 0xFE], Duration::from_micros(10));
+        counters.response_received(&[0x83, 0x02], Duration::from_micros(10));
+        counters.response_received(&[0x81, 0x02], Duration::from_micros(10));
+        counters.response_received(&[0x81, 0x42], Duration::from_micros(10));
+
+        let exceptions = counters.snapshot().exceptions;
+        assert_eq!(exceptions.get(ExceptionCode::IllegalDataAddress), 2);
+        assert_eq!(exceptions.get(ExceptionCode::IllegalFunction), 0);
+        assert_eq!(exceptions.get(ExceptionCode::Unknown(0x42)), 1);
+        assert_eq!(exceptions.total(), 3);
+    }
+}
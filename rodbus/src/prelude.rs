@@ -1,7 +1,27 @@
-pub use crate::client::channel::{strategy, Channel, ReconnectStrategy};
-pub use crate::client::session::{AsyncSession, CallbackSession};
-pub use crate::client::{create_handle_and_task, spawn_tcp_client_task};
+pub use crate::client::channel::{
+    strategy, AdaptiveTimeout, Channel, ChannelOptions, Priority, ReconnectStrategy,
+};
+pub use crate::client::poll::{Poll, PollHandle, PollHandler, PollKind};
+pub use crate::client::pool::{ChannelPool, Distribution};
+pub use crate::client::session::{AsyncSession, CallbackSession, ReadBuffer};
+pub use crate::client::{
+    create_handle_and_task, create_handle_and_task_with_options, create_rtu_handle_and_task,
+    create_rtu_over_tcp_handle_and_task, spawn_rtu_client_task, spawn_rtu_over_tcp_client_task,
+    spawn_tcp_client_pool, spawn_tcp_client_task, spawn_tcp_client_task_with_options,
+};
+pub use crate::decode::DecodeLevel;
 pub use crate::error::*;
-pub use crate::server::handler::{RequestHandler, ServerHandlerMap};
-pub use crate::server::{create_tcp_server_task, spawn_tcp_server_task};
+pub use crate::metrics::{ChannelMetrics, ServerMetrics};
+pub use crate::server::deferred::{DeferredHandler, Reply};
+pub use crate::server::handler::{
+    RequestHandler, ServerHandlerMap, ServerHandlers, SnapshotHandler,
+};
+pub use crate::server::proxy::ProxyHandler;
+pub use crate::server::{
+    create_tcp_server_task, create_tcp_server_task_with_handlers,
+    create_tcp_server_task_with_options, spawn_tcp_server_task,
+    spawn_tcp_server_task_with_handlers, spawn_tcp_server_task_with_options, ServerHandle,
+    ServerMetricsHandle, ServerOptions,
+};
+pub use crate::socket::SocketOptions;
 pub use crate::types::*;
@@ -0,0 +1,34 @@
+use std::time::Duration;
+
+use tokio::io::{AsyncRead, AsyncWrite};
+
+use crate::client::task::{ClientLoop, SessionError};
+use crate::rtu::frame::{RtuFormatter, RtuParser};
+
+/// Run an RTU client loop over a stream that the channel can't re-establish, such as a serial
+/// port opened by the caller
+///
+/// After a corrupted frame the loop continues on the same stream. Before the next request is
+/// sent, received bytes are discarded until the line has been idle for the inter-frame delay,
+/// which is how an RTU master resynchronizes with the line. Once the stream fails, every
+/// request fails with `Error::NoConnection` until the channel is dropped.
+pub(crate) async fn run_stream<T>(mut client_loop: ClientLoop<RtuParser, RtuFormatter>, mut io: T)
+where
+    T: AsyncRead + AsyncWrite + Unpin,
+{
+    loop {
+        match client_loop.run(&mut io).await {
+            // the mpsc was closed, end the task
+            SessionError::Shutdown => return,
+            SessionError::BadFrame => log::warn!("discarding corrupted RTU frame"),
+            SessionError::IOError => break,
+        }
+    }
+
+    log::warn!("RTU stream failed, requests will fail until the channel is dropped");
+    while client_loop
+        .fail_requests_for(Duration::from_secs(60))
+        .await
+        .is_ok()
+    {}
+}
@@ -0,0 +1,260 @@
+use crate::common::buffer::ReadBuffer;
+use crate::common::cursor::WriteCursor;
+use crate::common::frame::{FrameFormatter, FrameHeader, FrameInfo, FrameParser, TxId};
+use crate::common::function::FunctionCode;
+use crate::common::traits::Serialize;
+use crate::decode::{DecodeLevel, FrameDisplay};
+use crate::error::*;
+use crate::rtu::crc::crc16;
+use crate::types::UnitId;
+
+pub(crate) mod constants {
+    // the unit identifier that precedes the ADU
+    pub(crate) const HEADER_LENGTH: usize = 1;
+    pub(crate) const CRC_LENGTH: usize = 2;
+    pub(crate) const MAX_FRAME_LENGTH: usize =
+        HEADER_LENGTH + crate::common::frame::constants::MAX_ADU_LENGTH + CRC_LENGTH;
+}
+
+/// Parses the responses received by an RTU client
+///
+/// RTU frames don't carry a length, so the length of a response is determined from its
+/// function code and, for the responses whose length varies, from its byte count.
+pub(crate) struct RtuParser;
+
+pub(crate) struct RtuFormatter {
+    decode: DecodeLevel,
+    buffer: [u8; constants::MAX_FRAME_LENGTH],
+}
+
+impl RtuFormatter {
+    pub(crate) fn new(decode: DecodeLevel) -> Self {
+        Self {
+            decode,
+            buffer: [0; constants::MAX_FRAME_LENGTH],
+        }
+    }
+}
+
+impl RtuParser {
+    pub(crate) fn new() -> Self {
+        Self
+    }
+
+    // length of the frame at the front of the buffer including the CRC, or None if more
+    // bytes are required to determine it
+    fn frame_length(bytes: &[u8]) -> Result<Option<usize>, Error> {
+        let function = match bytes.get(1) {
+            Some(x) => *x,
+            None => return Ok(None),
+        };
+
+        // unit id and function code
+        let length = if function & 0x80 != 0 {
+            // exception code
+            3
+        } else {
+            match FunctionCode::get(function) {
+                Some(FunctionCode::ReadCoils)
+                | Some(FunctionCode::ReadDiscreteInputs)
+                | Some(FunctionCode::ReadHoldingRegisters)
+                | Some(FunctionCode::ReadInputRegisters)
+                | Some(FunctionCode::ReadWriteMultipleRegisters) => match bytes.get(2) {
+                    // byte count and the bytes it describes
+                    Some(count) => 3 + *count as usize,
+                    None => return Ok(None),
+                },
+                // address and value or quantity
+                Some(FunctionCode::WriteSingleCoil)
+                | Some(FunctionCode::WriteSingleRegister)
+                | Some(FunctionCode::WriteMultipleCoils)
+                | Some(FunctionCode::WriteMultipleRegisters) => 6,
+                None => return Err(details::FrameParseError::RtuUnknownFunction(function).into()),
+            }
+        };
+
+        Ok(Some(length + constants::CRC_LENGTH))
+    }
+}
+
+impl FrameParser for RtuParser {
+    fn max_frame_size(&self) -> usize {
+        constants::MAX_FRAME_LENGTH
+    }
+
+    fn parse(&mut self, cursor: &mut ReadBuffer) -> Result<Option<FrameInfo>, Error> {
+        let length = match Self::frame_length(cursor.peek())? {
+            Some(x) => x,
+            None => return Ok(None),
+        };
+
+        if length > constants::MAX_FRAME_LENGTH {
+            return Err(details::FrameParseError::RtuFrameTooBig(
+                length,
+                constants::MAX_FRAME_LENGTH,
+            )
+            .into());
+        }
+
+        let data_length = length - constants::CRC_LENGTH;
+        let (computed, received) = {
+            let bytes = cursor.peek();
+            match (bytes.get(..data_length), bytes.get(data_length..length)) {
+                (Some(data), Some(&[low, high])) => (crc16(data), u16::from_le_bytes([low, high])),
+                _ => return Ok(None),
+            }
+        };
+
+        if received != computed {
+            return Err(details::FrameParseError::CrcValidationFailure(received, computed).into());
+        }
+
+        let unit_id = UnitId::new(cursor.read_u8()?);
+        Ok(Some(FrameInfo::with_trailer(
+            FrameHeader::new(unit_id, TxId::default()),
+            data_length - constants::HEADER_LENGTH,
+            constants::CRC_LENGTH,
+        )))
+    }
+
+    fn reset(&mut self) {}
+}
+
+impl FrameFormatter for RtuFormatter {
+    fn format_impl(&mut self, header: FrameHeader, msg: &dyn Serialize) -> Result<usize, Error> {
+        let data_length = {
+            let mut cursor = WriteCursor::new(self.buffer.as_mut());
+            cursor.write_u8(header.unit_id.value)?;
+            msg.serialize(&mut cursor)?;
+            cursor.position()
+        };
+
+        let crc = match self.buffer.get(..data_length) {
+            Some(data) => crc16(data),
+            None => return Err(details::InternalError::ADUTooBig(data_length).into()),
+        };
+
+        {
+            // the CRC is the only field transmitted low byte first
+            let mut cursor = WriteCursor::new(self.buffer.as_mut());
+            cursor.seek_from_start(data_length)?;
+            let [low, high] = crc.to_le_bytes();
+            cursor.write_u8(low)?;
+            cursor.write_u8(high)?;
+        }
+
+        if self.decode.enabled() {
+            if let Some(adu) = self.buffer.get(constants::HEADER_LENGTH..data_length) {
+                log::info!("-> {}", FrameDisplay::new(self.decode, header, adu));
+            }
+        }
+
+        Ok(data_length + constants::CRC_LENGTH)
+    }
+
+    fn get_option_impl(&self, size: usize) -> Option<&[u8]> {
+        self.buffer.get(..size)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use tokio_test::block_on;
+    use tokio_test::io::Builder;
+
+    use crate::common::frame::FramedReader;
+
+    use super::*;
+
+    //                             | unit | func | count |   register  |    crc    |
+    const READ_RESPONSE: &[u8] = &[0x01, 0x03, 0x02, 0x00, 0x2A, 0x39, 0x9B];
+
+    struct MockMessage<'a> {
+        bytes: &'a [u8],
+    }
+
+    impl<'a> Serialize for MockMessage<'a> {
+        fn serialize(&self, cursor: &mut WriteCursor) -> Result<(), Error> {
+            for x in self.bytes {
+                cursor.write_u8(*x)?;
+            }
+            Ok(())
+        }
+    }
+
+    fn parse(chunks: &[&[u8]]) -> Result<(UnitId, Vec<u8>), Error> {
+        let mut builder = Builder::new();
+        for chunk in chunks {
+            builder.read(chunk);
+        }
+        let mut io = builder.build();
+        let mut reader = FramedReader::new(RtuParser::new(), DecodeLevel::Nothing);
+        let frame = block_on(reader.next_frame(&mut io))?;
+        Ok((frame.header.unit_id, frame.payload().to_vec()))
+    }
+
+    #[test]
+    fn correctly_formats_frame() {
+        let mut formatter = RtuFormatter::new(DecodeLevel::Nothing);
+        let msg = MockMessage {
+            bytes: &[0x03, 0x00, 0x00, 0x00, 0x0A],
+        };
+        let header = FrameHeader::new(UnitId::new(1), TxId::default());
+        let size = formatter.format_impl(header, &msg).unwrap();
+        assert_eq!(
+            formatter.get_option_impl(size).unwrap(),
+            &[0x01, 0x03, 0x00, 0x00, 0x00, 0x0A, 0xC5, 0xCD]
+        );
+    }
+
+    #[test]
+    fn can_parse_frame_segmented_in_every_position() {
+        for split in 1..READ_RESPONSE.len() {
+            let (first, second) = READ_RESPONSE.split_at(split);
+            assert_eq!(
+                parse(&[first, second]).unwrap(),
+                (UnitId::new(1), vec![0x03, 0x02, 0x00, 0x2A])
+            );
+        }
+    }
+
+    #[test]
+    fn can_parse_exception_and_write_responses() {
+        let mut formatter = RtuFormatter::new(DecodeLevel::Nothing);
+        let header = FrameHeader::new(UnitId::new(7), TxId::default());
+        for adu in [
+            [0x83, 0x02].as_ref(),
+            [0x05, 0x00, 0x01, 0xFF, 0x00].as_ref(),
+        ]
+        .iter()
+        {
+            let size = formatter
+                .format_impl(header, &MockMessage { bytes: adu })
+                .unwrap();
+            let frame = formatter.get_option_impl(size).unwrap();
+            assert_eq!(parse(&[frame]).unwrap(), (UnitId::new(7), adu.to_vec()));
+        }
+    }
+
+    #[test]
+    fn errors_on_bad_crc() {
+        let mut frame = READ_RESPONSE.to_vec();
+        frame[4] = 0x2B;
+        assert_eq!(
+            parse(&[&frame]),
+            Err(Error::BadFrame(
+                details::FrameParseError::CrcValidationFailure(0x9B39, crc16(&frame[..5]))
+            ))
+        );
+    }
+
+    #[test]
+    fn errors_on_unknown_function() {
+        assert_eq!(
+            parse(&[&[0x01, 0x2B, 0x00]]),
+            Err(Error::BadFrame(
+                details::FrameParseError::RtuUnknownFunction(0x2B)
+            ))
+        );
+    }
+}
@@ -0,0 +1,3 @@
+pub(crate) mod client;
+pub(crate) mod crc;
+pub(crate) mod frame;
@@ -0,0 +1,175 @@
+use std::collections::HashMap;
+
+use crate::common::frame::FrameHeader;
+use crate::server::request::ReadRequest;
+use crate::types::UnitId;
+
+// offsets of the fields of the MBAP header that differ between requests
+const TX_ID_OFFSET: usize = 0;
+const UNIT_ID_OFFSET: usize = 6;
+
+/// Identifies the reply to a read
+#[derive(Copy, Clone, Debug, PartialEq, Eq, Hash)]
+pub(crate) struct Key {
+    unit_id: u8,
+    function: u8,
+    start: u16,
+    count: u16,
+}
+
+impl Key {
+    pub(crate) fn new(unit_id: UnitId, request: &ReadRequest) -> Self {
+        let range = request.range();
+        Self {
+            unit_id: unit_id.value,
+            function: request.get_function().get_value(),
+            start: range.start,
+            count: range.count,
+        }
+    }
+}
+
+struct Entry {
+    version: u64,
+    frame: Vec<u8>,
+}
+
+/// Formatted replies to reads, reused as long as the version of the handler is unchanged
+///
+/// Each session has its own cache, so looking up a reply never takes a lock. A capacity of 0
+/// disables the cache.
+pub(crate) struct ResponseCache {
+    capacity: usize,
+    // version of the handler table the replies were produced with
+    table_version: u64,
+    entries: HashMap<Key, Entry>,
+}
+
+impl ResponseCache {
+    pub(crate) fn new(capacity: usize) -> Self {
+        Self {
+            capacity,
+            table_version: 0,
+            entries: HashMap::new(),
+        }
+    }
+
+    pub(crate) fn is_enabled(&self) -> bool {
+        self.capacity > 0
+    }
+
+    /// discard every reply when the handler table is replaced, a unit may now be served by a
+    /// different handler with unrelated versions
+    pub(crate) fn set_table_version(&mut self, version: u64) {
+        if version != self.table_version {
+            self.table_version = version;
+            self.entries.clear();
+        }
+    }
+
+    /// the reply for the key if it was produced with the same version of the handler
+    pub(crate) fn get(&self, lookup: Option<(Key, u64)>) -> Option<&[u8]> {
+        let (key, version) = lookup?;
+        match self.entries.get(&key) {
+            Some(entry) if entry.version == version => Some(entry.frame.as_slice()),
+            _ => None,
+        }
+    }
+
+    pub(crate) fn insert(&mut self, lookup: Option<(Key, u64)>, frame: &[u8]) {
+        let (key, version) = match lookup {
+            Some(x) => x,
+            None => return,
+        };
+        // the set of polled ranges is usually small and stable, so when it's exceeded the
+        // cache simply starts over
+        if self.entries.len() >= self.capacity && !self.entries.contains_key(&key) {
+            self.entries.clear();
+        }
+        let entry = self.entries.entry(key).or_insert_with(|| Entry {
+            version,
+            frame: Vec::new(),
+        });
+        // reuse the allocation of the previous version of the reply
+        entry.version = version;
+        entry.frame.clear();
+        entry.frame.extend_from_slice(frame);
+    }
+
+    /// write the header of the request into a copy of a cached reply
+    pub(crate) fn patch(frame: &mut [u8], header: FrameHeader) {
+        if let Some(x) = frame.get_mut(TX_ID_OFFSET..TX_ID_OFFSET + 2) {
+            x.copy_from_slice(&header.tx_id.to_u16().to_be_bytes());
+        }
+        if let Some(x) = frame.get_mut(UNIT_ID_OFFSET) {
+            *x = header.unit_id.value;
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::common::frame::TxId;
+    use crate::types::AddressRange;
+
+    fn key(start: u16) -> Key {
+        let range = AddressRange::try_from(start, 2)
+            .unwrap()
+            .of_read_registers()
+            .unwrap();
+        Key::new(UnitId::new(1), &ReadRequest::ReadHoldingRegisters(range))
+    }
+
+    #[test]
+    fn replies_are_only_returned_for_the_same_version() {
+        let mut cache = ResponseCache::new(4);
+        cache.insert(Some((key(0), 1)), &[1, 2, 3]);
+
+        assert_eq!(cache.get(Some((key(0), 1))), Some([1, 2, 3].as_ref()));
+        assert_eq!(cache.get(Some((key(0), 2))), None);
+        assert_eq!(cache.get(Some((key(1), 1))), None);
+        assert_eq!(cache.get(None), None);
+
+        cache.insert(Some((key(0), 2)), &[4, 5]);
+        assert_eq!(cache.get(Some((key(0), 2))), Some([4, 5].as_ref()));
+    }
+
+    #[test]
+    fn replacing_the_table_discards_every_reply() {
+        let mut cache = ResponseCache::new(4);
+        cache.set_table_version(3);
+        cache.insert(Some((key(0), 1)), &[1, 2, 3]);
+        cache.set_table_version(3);
+        assert!(cache.get(Some((key(0), 1))).is_some());
+        cache.set_table_version(4);
+        assert!(cache.get(Some((key(0), 1))).is_none());
+    }
+
+    #[test]
+    fn starts_over_when_the_capacity_is_exceeded() {
+        let mut cache = ResponseCache::new(2);
+        cache.insert(Some((key(0), 1)), &[0]);
+        cache.insert(Some((key(1), 1)), &[1]);
+        // replacing an existing reply doesn't count against the capacity
+        cache.insert(Some((key(1), 2)), &[2]);
+        assert!(cache.get(Some((key(0), 1))).is_some());
+
+        cache.insert(Some((key(2), 1)), &[3]);
+        assert!(cache.get(Some((key(0), 1))).is_none());
+        assert!(cache.get(Some((key(2), 1))).is_some());
+    }
+
+    #[test]
+    fn patches_the_transaction_and_unit_ids() {
+        let mut frame = [0x00, 0x01, 0x00, 0x00, 0x00, 0x03, 0x01, 0x03, 0x00];
+        ResponseCache::patch(
+            &mut frame,
+            FrameHeader::new(UnitId::new(0x02), TxId::new(0xCAFE)),
+        );
+        assert_eq!(
+            frame,
+            [0xCA, 0xFE, 0x00, 0x00, 0x00, 0x03, 0x02, 0x03, 0x00]
+        );
+    }
+}
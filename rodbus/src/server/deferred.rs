@@ -0,0 +1,274 @@
+use std::marker::PhantomData;
+
+use tokio::sync::mpsc::UnboundedSender;
+
+use crate::common::frame::{FrameFormatter, FrameHeader};
+use crate::common::function::FunctionCode;
+use crate::error::details::ExceptionCode;
+use crate::error::Error;
+use crate::server::request::{ReadRequest, Request};
+use crate::tcp::frame::MBAPFormatter;
+use crate::types::{AddressRange, CopyValues, Indexed};
+
+/// Trait implemented by the user to process requests whose replies are sent later
+///
+/// Each method receives a [`Reply`] that completes the request. The reply can be sent from any
+/// thread or task at any time, e.g. once a historian, a database or another Modbus channel has
+/// answered. The session doesn't wait for it: it keeps processing the requests that follow on the
+/// connection, and each reply is written as soon as it's sent. Replies can therefore complete
+/// out of order, which Modbus TCP clients match by transaction id.
+///
+/// Handlers are shared by every session without a lock, so they must be `Sync`. They should
+/// never block, any slow operation should be spawned onto the runtime along with the reply.
+///
+/// The address ranges are validated before the handler is called. A reply to a read that
+/// contains a number of values different from the count of the range, or a reply that is
+/// dropped without being sent, results in [`ExceptionCode::ServerDeviceFailure`].
+///
+/// [`Reply`]: struct.Reply.html
+/// [`ExceptionCode::ServerDeviceFailure`]: ../../error/details/enum.ExceptionCode.html#variant.ServerDeviceFailure
+pub trait DeferredHandler: Send + Sync + 'static {
+    /// Read a range of coils
+    fn read_coils(&self, _range: AddressRange, reply: Reply<Vec<bool>>) {
+        reply.send(Err(ExceptionCode::IllegalFunction))
+    }
+
+    /// Read a range of discrete inputs
+    fn read_discrete_inputs(&self, _range: AddressRange, reply: Reply<Vec<bool>>) {
+        reply.send(Err(ExceptionCode::IllegalFunction))
+    }
+
+    /// Read a range of holding registers
+    fn read_holding_registers(&self, _range: AddressRange, reply: Reply<Vec<u16>>) {
+        reply.send(Err(ExceptionCode::IllegalFunction))
+    }
+
+    /// Read a range of input registers
+    fn read_input_registers(&self, _range: AddressRange, reply: Reply<Vec<u16>>) {
+        reply.send(Err(ExceptionCode::IllegalFunction))
+    }
+
+    /// Write a single coil value
+    fn write_single_coil(&self, _value: Indexed<bool>, reply: Reply<()>) {
+        reply.send(Err(ExceptionCode::IllegalFunction))
+    }
+
+    /// Write a single register value
+    fn write_single_register(&self, _value: Indexed<u16>, reply: Reply<()>) {
+        reply.send(Err(ExceptionCode::IllegalFunction))
+    }
+
+    /// Write multiple coils starting at the beginning of the range
+    fn write_multiple_coils(&self, _range: AddressRange, _values: Vec<bool>, reply: Reply<()>) {
+        reply.send(Err(ExceptionCode::IllegalFunction))
+    }
+
+    /// Write multiple registers starting at the beginning of the range
+    fn write_multiple_registers(&self, _range: AddressRange, _values: Vec<u16>, reply: Reply<()>) {
+        reply.send(Err(ExceptionCode::IllegalFunction))
+    }
+
+    /// Write multiple registers starting at the beginning of `write`, then read the holding
+    /// registers of `read`
+    fn read_write_multiple_registers(
+        &self,
+        _read: AddressRange,
+        _write: AddressRange,
+        _values: Vec<u16>,
+        reply: Reply<Vec<u16>>,
+    ) {
+        reply.send(Err(ExceptionCode::IllegalFunction))
+    }
+}
+
+/// what a successful reply must contain
+#[derive(Copy, Clone)]
+enum Expected {
+    Bits(usize),
+    Registers(usize),
+    // write replies echo the request
+    Coil(Indexed<bool>),
+    Register(Indexed<u16>),
+    Range(AddressRange),
+}
+
+enum ReplyData {
+    Bits(Vec<bool>),
+    Registers(Vec<u16>),
+    Done,
+}
+
+/// A reply sent by a [`DeferredHandler`] back to the session that received the request
+///
+/// [`DeferredHandler`]: trait.DeferredHandler.html
+pub(crate) struct CompletedReply {
+    header: FrameHeader,
+    function: FunctionCode,
+    expected: Expected,
+    result: Result<ReplyData, ExceptionCode>,
+}
+
+impl CompletedReply {
+    pub(crate) fn format<'a>(&self, writer: &'a mut MBAPFormatter) -> Result<&'a [u8], Error> {
+        let (header, function) = (self.header, self.function);
+        match (&self.result, self.expected) {
+            (Err(ex), _) => writer.exception(header, function, *ex),
+            (Ok(ReplyData::Bits(values)), Expected::Bits(count)) if values.len() == count => {
+                writer.format(header, function, &values.as_slice())
+            }
+            (Ok(ReplyData::Registers(values)), Expected::Registers(count))
+                if values.len() == count =>
+            {
+                writer.format(header, function, &values.as_slice())
+            }
+            (Ok(ReplyData::Done), Expected::Coil(value)) => writer.format(header, function, &value),
+            (Ok(ReplyData::Done), Expected::Register(value)) => {
+                writer.format(header, function, &value)
+            }
+            (Ok(ReplyData::Done), Expected::Range(range)) => {
+                writer.format(header, function, &range)
+            }
+            _ => {
+                log::warn!(
+                    "deferred handler replied to {:?} with the wrong number of values",
+                    function
+                );
+                writer.exception(header, function, ExceptionCode::ServerDeviceFailure)
+            }
+        }
+    }
+}
+
+/// Completes a request received by a [`DeferredHandler`]
+///
+/// A reply that is dropped without being sent completes the request with
+/// `ExceptionCode::ServerDeviceFailure`. If the session has closed in the meantime, the reply
+/// is discarded.
+///
+/// [`DeferredHandler`]: trait.DeferredHandler.html
+pub struct Reply<T> {
+    tx: UnboundedSender<CompletedReply>,
+    header: FrameHeader,
+    function: FunctionCode,
+    expected: Expected,
+    done: bool,
+    _values: PhantomData<fn(T)>,
+}
+
+impl<T> Reply<T> {
+    fn new(
+        tx: UnboundedSender<CompletedReply>,
+        header: FrameHeader,
+        function: FunctionCode,
+        expected: Expected,
+    ) -> Self {
+        Self {
+            tx,
+            header,
+            function,
+            expected,
+            done: false,
+            _values: PhantomData,
+        }
+    }
+
+    fn complete(&mut self, result: Result<ReplyData, ExceptionCode>) {
+        self.done = true;
+        let reply = CompletedReply {
+            header: self.header,
+            function: self.function,
+            expected: self.expected,
+            result,
+        };
+        // the session may have closed, there's nobody left to reply to
+        self.tx.send(reply).ok();
+    }
+}
+
+impl Reply<Vec<bool>> {
+    /// Reply with the values of the range or an exception
+    pub fn send(mut self, result: Result<Vec<bool>, ExceptionCode>) {
+        self.complete(result.map(ReplyData::Bits))
+    }
+}
+
+impl Reply<Vec<u16>> {
+    /// Reply with the values of the range or an exception
+    pub fn send(mut self, result: Result<Vec<u16>, ExceptionCode>) {
+        self.complete(result.map(ReplyData::Registers))
+    }
+}
+
+impl Reply<()> {
+    /// Reply that the write succeeded, or with an exception
+    pub fn send(mut self, result: Result<(), ExceptionCode>) {
+        self.complete(result.map(|_| ReplyData::Done))
+    }
+}
+
+impl<T> Drop for Reply<T> {
+    fn drop(&mut self) {
+        if !self.done {
+            self.complete(Err(ExceptionCode::ServerDeviceFailure))
+        }
+    }
+}
+
+/// pass a request to a deferred handler along with the reply that completes it
+pub(crate) fn dispatch(
+    request: Request,
+    header: FrameHeader,
+    handler: &dyn DeferredHandler,
+    tx: &UnboundedSender<CompletedReply>,
+) {
+    let function = request.get_function();
+    match request {
+        Request::Read(ReadRequest::ReadCoils(range)) => {
+            let count = range.inner.count as usize;
+            let reply = Reply::new(tx.clone(), header, function, Expected::Bits(count));
+            handler.read_coils(range.inner, reply)
+        }
+        Request::Read(ReadRequest::ReadDiscreteInputs(range)) => {
+            let count = range.inner.count as usize;
+            let reply = Reply::new(tx.clone(), header, function, Expected::Bits(count));
+            handler.read_discrete_inputs(range.inner, reply)
+        }
+        Request::Read(ReadRequest::ReadHoldingRegisters(range)) => {
+            let count = range.inner.count as usize;
+            let reply = Reply::new(tx.clone(), header, function, Expected::Registers(count));
+            handler.read_holding_registers(range.inner, reply)
+        }
+        Request::Read(ReadRequest::ReadInputRegisters(range)) => {
+            let count = range.inner.count as usize;
+            let reply = Reply::new(tx.clone(), header, function, Expected::Registers(count));
+            handler.read_input_registers(range.inner, reply)
+        }
+        Request::WriteSingleCoil(value) => {
+            let reply = Reply::new(tx.clone(), header, function, Expected::Coil(value));
+            handler.write_single_coil(value, reply)
+        }
+        Request::WriteSingleRegister(value) => {
+            let reply = Reply::new(tx.clone(), header, function, Expected::Register(value));
+            handler.write_single_register(value, reply)
+        }
+        Request::WriteMultipleCoils(items) => {
+            let reply = Reply::new(tx.clone(), header, function, Expected::Range(items.range));
+            let mut values = Vec::with_capacity(items.iterator.len());
+            items.iterator.copy_values(&mut values);
+            handler.write_multiple_coils(items.range, values, reply)
+        }
+        Request::WriteMultipleRegisters(items) => {
+            let reply = Reply::new(tx.clone(), header, function, Expected::Range(items.range));
+            let mut values = Vec::with_capacity(items.iterator.len());
+            items.iterator.copy_values(&mut values);
+            handler.write_multiple_registers(items.range, values, reply)
+        }
+        Request::ReadWriteMultipleRegisters(read, items) => {
+            let count = read.inner.count as usize;
+            let reply = Reply::new(tx.clone(), header, function, Expected::Registers(count));
+            let mut values = Vec::with_capacity(items.iterator.len());
+            items.iterator.copy_values(&mut values);
+            handler.read_write_multiple_registers(read.inner, items.range, values, reply)
+        }
+    }
+}
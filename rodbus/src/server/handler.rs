@@ -1,9 +1,16 @@
 use std::collections::BTreeMap;
-use std::sync::Arc;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, RwLock};
 
 use tokio::sync::Mutex;
 
+use crate::common::frame::FrameHeader;
 use crate::error::details::ExceptionCode;
+use crate::error::Error;
+use crate::server::deferred::DeferredHandler;
+use crate::server::request::{ReadRequest, Request};
+use crate::tcp::frame::constants::HEADER_LENGTH;
+use crate::tcp::frame::MBAPFormatter;
 use crate::types::*;
 
 /// Trait implemented by the user to process requests received from the client
@@ -27,6 +34,30 @@ pub trait RequestHandler: Send + 'static {
         Arc::new(Mutex::new(Box::new(self)))
     }
 
+    /// Moves a server handler implementation into a [`SnapshotHandler`] which serves
+    /// reads from an immutable snapshot instead of locking the handler
+    ///
+    /// [`SnapshotHandler`]: struct.SnapshotHandler.html
+    fn snapshot(self) -> Arc<SnapshotHandler<Self>>
+    where
+        Self: Sized + Clone,
+    {
+        Arc::new(SnapshotHandler::new(self))
+    }
+
+    /// Version of the values returned by the read methods, or `None` if replies to reads
+    /// must never be reused
+    ///
+    /// Sessions with a response cache (see [`ServerOptions::response_cache_size`]) reuse the
+    /// formatted reply to a read as long as the version is unchanged, without calling the read
+    /// methods again. Implementations that return a version must change it whenever a value
+    /// that can be read changes.
+    ///
+    /// [`ServerOptions::response_cache_size`]: ../struct.ServerOptions.html#structfield.response_cache_size
+    fn version(&self) -> Option<u64> {
+        None
+    }
+
     /// Read single coil or return an ExceptionCode
     fn read_coil(&self, _address: u16) -> Result<bool, ExceptionCode> {
         Err(ExceptionCode::IllegalFunction)
@@ -47,6 +78,63 @@ pub trait RequestHandler: Send + 'static {
         Err(ExceptionCode::IllegalFunction)
     }
 
+    /// Read a range of coils into `output` or return an ExceptionCode
+    ///
+    /// `output` always contains exactly one element per address in `range`. The default
+    /// implementation calls [`read_coil`](#method.read_coil) for each address. Implementations
+    /// backed by contiguous storage can override this to copy the entire block at once.
+    fn read_coils(&self, range: AddressRange, output: &mut [bool]) -> Result<(), ExceptionCode> {
+        for (address, value) in range.iter().zip(output.iter_mut()) {
+            *value = self.read_coil(address)?;
+        }
+        Ok(())
+    }
+
+    /// Read a range of discrete inputs into `output` or return an ExceptionCode
+    ///
+    /// `output` always contains exactly one element per address in `range`. The default
+    /// implementation calls [`read_discrete_input`](#method.read_discrete_input) for each address.
+    fn read_discrete_inputs(
+        &self,
+        range: AddressRange,
+        output: &mut [bool],
+    ) -> Result<(), ExceptionCode> {
+        for (address, value) in range.iter().zip(output.iter_mut()) {
+            *value = self.read_discrete_input(address)?;
+        }
+        Ok(())
+    }
+
+    /// Read a range of holding registers into `output` or return an ExceptionCode
+    ///
+    /// `output` always contains exactly one element per address in `range`. The default
+    /// implementation calls [`read_holding_register`](#method.read_holding_register) for each address.
+    fn read_holding_registers(
+        &self,
+        range: AddressRange,
+        output: &mut [u16],
+    ) -> Result<(), ExceptionCode> {
+        for (address, value) in range.iter().zip(output.iter_mut()) {
+            *value = self.read_holding_register(address)?;
+        }
+        Ok(())
+    }
+
+    /// Read a range of input registers into `output` or return an ExceptionCode
+    ///
+    /// `output` always contains exactly one element per address in `range`. The default
+    /// implementation calls [`read_input_register`](#method.read_input_register) for each address.
+    fn read_input_registers(
+        &self,
+        range: AddressRange,
+        output: &mut [u16],
+    ) -> Result<(), ExceptionCode> {
+        for (address, value) in range.iter().zip(output.iter_mut()) {
+            *value = self.read_input_register(address)?;
+        }
+        Ok(())
+    }
+
     /// Write a single coil value
     fn write_single_coil(&mut self, _value: Indexed<bool>) -> Result<(), ExceptionCode> {
         Err(ExceptionCode::IllegalFunction)
@@ -67,6 +155,22 @@ pub trait RequestHandler: Send + 'static {
         Err(ExceptionCode::IllegalFunction)
     }
 
+    /// Write multiple registers and then read a range of holding registers into `output`
+    ///
+    /// Both operations are performed while the session holds the handler, so no other request
+    /// can observe the registers between the write and the read. The default implementation
+    /// calls [`write_multiple_registers`](#method.write_multiple_registers) followed by
+    /// [`read_holding_registers`](#method.read_holding_registers).
+    fn read_write_multiple_registers(
+        &mut self,
+        write: WriteRegisters,
+        read: AddressRange,
+        output: &mut [u16],
+    ) -> Result<(), ExceptionCode> {
+        self.write_multiple_registers(write)?;
+        self.read_holding_registers(read, output)
+    }
+
     fn convert<T>(x: Option<&T>) -> Result<T, ExceptionCode>
     where
         T: Copy,
@@ -80,6 +184,189 @@ pub trait RequestHandler: Send + 'static {
 
 type ServerHandlerType<T> = Arc<Mutex<Box<T>>>;
 
+/// A handler that separates readers from writers
+///
+/// Read requests are served from the current snapshot, an immutable `Arc<T>`, so any number
+/// of sessions can read concurrently without waiting on each other. Write requests (and
+/// [`update`]) are serialized: the writer clones the current snapshot, modifies the clone and
+/// then publishes it atomically. Readers that already hold the previous snapshot finish
+/// with it undisturbed.
+///
+/// Since every write clones the handler, this mode is intended for read-mostly workloads. A
+/// write that is answered with an exception discards its copy, so it changes nothing and
+/// doesn't change the version.
+///
+/// Writers are serialized by a blocking mutex that is held while the handler is cloned and
+/// modified. A session waiting to write blocks its worker thread until the writes ahead of it
+/// complete, so keep the handler cheap to clone when several sessions write concurrently.
+///
+/// [`update`]: #method.update
+pub struct SnapshotHandler<T> {
+    current: RwLock<Arc<T>>,
+    // incremented every time a snapshot is published
+    version: AtomicU64,
+    writer: std::sync::Mutex<()>,
+    clone: fn(&T) -> T,
+}
+
+impl<T> SnapshotHandler<T>
+where
+    T: RequestHandler,
+{
+    /// Create a snapshot handler with an initial value
+    pub fn new(handler: T) -> Self
+    where
+        T: Clone,
+    {
+        Self {
+            current: RwLock::new(Arc::new(handler)),
+            version: AtomicU64::new(0),
+            writer: std::sync::Mutex::new(()),
+            clone: T::clone,
+        }
+    }
+
+    /// Retrieve the current snapshot
+    pub fn load(&self) -> Arc<T> {
+        // the write guard is only held to swap the Arc, so a poisoned lock still holds a valid value
+        match self.current.read() {
+            Ok(x) => x.clone(),
+            Err(err) => err.into_inner().clone(),
+        }
+    }
+
+    /// Apply a modification to a copy of the current snapshot and then publish it
+    ///
+    /// Concurrent updates are applied one at a time. Reads are never blocked by an update.
+    pub fn update<F, R>(&self, modify: F) -> R
+    where
+        F: FnOnce(&mut T) -> R,
+    {
+        match self.try_update(|x| Ok::<R, R>(modify(x))) {
+            Ok(x) | Err(x) => x,
+        }
+    }
+
+    /// Apply a modification to a copy of the current snapshot and publish it only if the
+    /// modification succeeds
+    ///
+    /// If the modification returns an error, the copy is discarded and the current snapshot
+    /// and version are unchanged.
+    pub fn try_update<F, R, E>(&self, modify: F) -> Result<R, E>
+    where
+        F: FnOnce(&mut T) -> Result<R, E>,
+    {
+        // if a previous update panicked, nothing was published so it's safe to continue
+        let _guard = match self.writer.lock() {
+            Ok(x) => x,
+            Err(err) => err.into_inner(),
+        };
+        let mut next = (self.clone)(self.load().as_ref());
+        let result = modify(&mut next)?;
+        let mut current = match self.current.write() {
+            Ok(x) => x,
+            Err(err) => err.into_inner(),
+        };
+        *current = Arc::new(next);
+        // bumped after the swap, so a reader that sees the new version also sees the new value
+        self.version.fetch_add(1, Ordering::Release);
+        Ok(result)
+    }
+}
+
+/// Object-safe view of a `SnapshotHandler` used by the sessions
+///
+/// This allows the map to hold snapshot handlers without requiring every
+/// `RequestHandler` to be `Sync`
+pub(crate) trait SharedHandler<T>: Send + Sync {
+    fn version(&self) -> u64;
+
+    fn read<'b>(
+        &self,
+        request: ReadRequest,
+        header: FrameHeader,
+        writer: &'b mut MBAPFormatter,
+    ) -> Result<&'b [u8], Error>;
+
+    fn write<'a, 'b>(
+        &self,
+        request: Request<'a>,
+        header: FrameHeader,
+        writer: &'b mut MBAPFormatter,
+    ) -> Result<&'b [u8], Error>;
+}
+
+impl<T> SharedHandler<T> for SnapshotHandler<T>
+where
+    T: RequestHandler + Sync,
+{
+    fn version(&self) -> u64 {
+        self.version.load(Ordering::Acquire)
+    }
+
+    fn read<'b>(
+        &self,
+        request: ReadRequest,
+        header: FrameHeader,
+        writer: &'b mut MBAPFormatter,
+    ) -> Result<&'b [u8], Error> {
+        request.get_reply(header, self.load().as_ref(), writer)
+    }
+
+    fn write<'a, 'b>(
+        &self,
+        request: Request<'a>,
+        header: FrameHeader,
+        writer: &'b mut MBAPFormatter,
+    ) -> Result<&'b [u8], Error> {
+        let result = self.try_update(move |x| {
+            let reply = request.get_reply(header, x, writer);
+            if is_exception(&reply) {
+                Err(reply)
+            } else {
+                Ok(reply)
+            }
+        });
+        match result {
+            Ok(x) | Err(x) => x,
+        }
+    }
+}
+
+// true if the handler answered with an exception, or the reply couldn't be produced
+fn is_exception(reply: &Result<&[u8], Error>) -> bool {
+    match reply {
+        // exception replies set the high bit of the function code
+        Ok(frame) => match frame.get(HEADER_LENGTH) {
+            Some(function) => function & 0x80 != 0,
+            None => true,
+        },
+        Err(_) => true,
+    }
+}
+
+/// How a single handler in a [`ServerHandlerMap`] is shared between sessions
+///
+/// [`ServerHandlerMap`]: struct.ServerHandlerMap.html
+pub(crate) enum HandlerEntry<T> {
+    /// every request locks the handler
+    Exclusive(ServerHandlerType<T>),
+    /// reads are served from a snapshot, writes are applied by a single writer
+    Snapshot(Arc<dyn SharedHandler<T>>),
+    /// requests are passed to the handler without a lock and replied to later
+    Deferred(Arc<dyn DeferredHandler>),
+}
+
+impl<T> Clone for HandlerEntry<T> {
+    fn clone(&self) -> Self {
+        match self {
+            HandlerEntry::Exclusive(x) => HandlerEntry::Exclusive(x.clone()),
+            HandlerEntry::Snapshot(x) => HandlerEntry::Snapshot(x.clone()),
+            HandlerEntry::Deferred(x) => HandlerEntry::Deferred(x.clone()),
+        }
+    }
+}
+
 /// A type that hides the underlying map implementation
 /// and allows lookups of a [`ServerHandler`] from a [`UnitId`]
 ///
@@ -87,7 +374,7 @@ type ServerHandlerType<T> = Arc<Mutex<Box<T>>>;
 /// [`UnitId`]: ../../types/struct.UnitId.html
 #[derive(Default)]
 pub struct ServerHandlerMap<T: RequestHandler> {
-    handlers: BTreeMap<UnitId, ServerHandlerType<T>>,
+    handlers: BTreeMap<UnitId, HandlerEntry<T>>,
 }
 
 // this couldn't be derived automatically
@@ -116,23 +403,205 @@ where
 
     /// Create a new map that contains a single value
     pub fn single(id: UnitId, handler: ServerHandlerType<T>) -> Self {
-        let mut map: BTreeMap<UnitId, ServerHandlerType<T>> = BTreeMap::new();
-        map.insert(id, handler);
+        let mut map: BTreeMap<UnitId, HandlerEntry<T>> = BTreeMap::new();
+        map.insert(id, HandlerEntry::Exclusive(handler));
         Self { handlers: map }
     }
 
     /// Retrieve a mutable reference to a [`ServerHandler`](trait.ServerHandler.html)
+    ///
+    /// Returns `None` if the unit id is not mapped or was added with `add_snapshot` or
+    /// `add_deferred`
     pub fn get(&mut self, id: UnitId) -> Option<&mut ServerHandlerType<T>> {
-        self.handlers.get_mut(&id)
+        match self.handlers.get_mut(&id) {
+            Some(HandlerEntry::Exclusive(x)) => Some(x),
+            _ => None,
+        }
     }
 
     /// Add a handler to the map
+    ///
+    /// Returns the previous handler if one of the same kind was registered for the unit id
     pub fn add(
         &mut self,
         id: UnitId,
         server: ServerHandlerType<T>,
     ) -> Option<ServerHandlerType<T>> {
-        self.handlers.insert(id, server)
+        match self.handlers.insert(id, HandlerEntry::Exclusive(server)) {
+            Some(HandlerEntry::Exclusive(x)) => Some(x),
+            _ => None,
+        }
+    }
+
+    /// Add a [`SnapshotHandler`] to the map
+    ///
+    /// The caller retains a clone of the `Arc` to update the handler while the server is running.
+    /// Returns true if a handler was already registered for the unit id and has been replaced.
+    ///
+    /// [`SnapshotHandler`]: struct.SnapshotHandler.html
+    pub fn add_snapshot(&mut self, id: UnitId, server: Arc<SnapshotHandler<T>>) -> bool
+    where
+        T: Sync,
+    {
+        self.handlers
+            .insert(id, HandlerEntry::Snapshot(server))
+            .is_some()
+    }
+
+    /// Add a [`DeferredHandler`] to the map
+    ///
+    /// Requests for the unit id are passed to the handler without taking a lock, and the
+    /// session continues with the following requests while the handler prepares its reply.
+    /// Returns true if a handler was already registered for the unit id and has been replaced.
+    ///
+    /// [`DeferredHandler`]: ../deferred/trait.DeferredHandler.html
+    pub fn add_deferred<H>(&mut self, id: UnitId, server: Arc<H>) -> bool
+    where
+        H: DeferredHandler,
+    {
+        self.handlers
+            .insert(id, HandlerEntry::Deferred(server))
+            .is_some()
+    }
+}
+
+// one entry for every possible unit id
+const NUM_UNIT_IDS: usize = 256;
+
+/// Handlers indexed directly by unit id, so that dispatching a request is a single lookup
+pub(crate) struct HandlerTable<T> {
+    entries: Vec<Option<HandlerEntry<T>>>,
+}
+
+impl<T> HandlerTable<T>
+where
+    T: RequestHandler,
+{
+    fn new(map: ServerHandlerMap<T>) -> Self {
+        let mut entries: Vec<Option<HandlerEntry<T>>> = (0..NUM_UNIT_IDS).map(|_| None).collect();
+        for (id, entry) in map.handlers {
+            if let Some(x) = entries.get_mut(id.value as usize) {
+                *x = Some(entry);
+            }
+        }
+        Self { entries }
+    }
+
+    pub(crate) fn get(&self, id: UnitId) -> Option<&HandlerEntry<T>> {
+        self.entries.get(id.value as usize).and_then(|x| x.as_ref())
+    }
+}
+
+struct SharedTable<T> {
+    // incremented every time the table is replaced
+    version: AtomicU64,
+    current: RwLock<Arc<HandlerTable<T>>>,
+}
+
+/// Handlers shared by every session of a server that can be replaced while the server runs
+///
+/// Sessions reference the same immutable table instead of copying the map. Replacing the
+/// map publishes a new table that each session picks up before its next request, so units
+/// can be added or removed without closing the TCP sessions. Requests that are already
+/// being processed complete with the handler they started with.
+pub struct ServerHandlers<T: RequestHandler> {
+    shared: Arc<SharedTable<T>>,
+}
+
+// this couldn't be derived automatically
+// due to the generic typing....
+impl<T> Clone for ServerHandlers<T>
+where
+    T: RequestHandler,
+{
+    fn clone(&self) -> Self {
+        Self {
+            shared: self.shared.clone(),
+        }
+    }
+}
+
+impl<T> ServerHandlers<T>
+where
+    T: RequestHandler,
+{
+    /// Create the shared handlers from a map
+    pub fn new(map: ServerHandlerMap<T>) -> Self {
+        Self {
+            shared: Arc::new(SharedTable {
+                version: AtomicU64::new(0),
+                current: RwLock::new(Arc::new(HandlerTable::new(map))),
+            }),
+        }
+    }
+
+    /// Atomically replace every handler with the contents of a new map
+    pub fn replace(&self, map: ServerHandlerMap<T>) {
+        let table = Arc::new(HandlerTable::new(map));
+        // the write guard is only held to swap the Arc, so a poisoned lock still holds a valid value
+        let mut current = match self.shared.current.write() {
+            Ok(x) => x,
+            Err(err) => err.into_inner(),
+        };
+        *current = table;
+        self.shared.version.fetch_add(1, Ordering::Release);
+    }
+
+    fn load(&self) -> (u64, Arc<HandlerTable<T>>) {
+        let current = match self.shared.current.read() {
+            Ok(x) => x,
+            Err(err) => err.into_inner(),
+        };
+        // replaced under the write lock, so the version matches the table
+        (self.shared.version.load(Ordering::Acquire), current.clone())
+    }
+
+    pub(crate) fn cache(&self) -> HandlerTableCache<T> {
+        let (version, table) = self.load();
+        HandlerTableCache {
+            handlers: self.clone(),
+            version,
+            table,
+        }
+    }
+}
+
+impl<T> From<ServerHandlerMap<T>> for ServerHandlers<T>
+where
+    T: RequestHandler,
+{
+    fn from(map: ServerHandlerMap<T>) -> Self {
+        Self::new(map)
+    }
+}
+
+/// A session's reference to the current handler table
+///
+/// The table is only reloaded when its version changes, so the common case costs a
+/// single atomic load.
+pub(crate) struct HandlerTableCache<T: RequestHandler> {
+    handlers: ServerHandlers<T>,
+    version: u64,
+    table: Arc<HandlerTable<T>>,
+}
+
+impl<T> HandlerTableCache<T>
+where
+    T: RequestHandler,
+{
+    /// reload the table if it was replaced and return its version
+    pub(crate) fn refresh(&mut self) -> u64 {
+        if self.handlers.shared.version.load(Ordering::Acquire) != self.version {
+            let (version, table) = self.handlers.load();
+            self.version = version;
+            self.table = table;
+        }
+        self.version
+    }
+
+    pub(crate) fn get(&mut self, id: UnitId) -> Option<&HandlerEntry<T>> {
+        self.refresh();
+        self.table.get(id)
     }
 }
 
@@ -169,6 +638,94 @@ mod tests {
         );
     }
 
+    struct SingleValueHandler;
+    impl RequestHandler for SingleValueHandler {
+        fn read_holding_register(&self, address: u16) -> Result<u16, ExceptionCode> {
+            match address {
+                0..=2 => Ok(address + 10),
+                _ => Err(ExceptionCode::IllegalDataAddress),
+            }
+        }
+    }
+
+    #[test]
+    fn default_range_reads_fall_back_to_single_reads() {
+        let handler = SingleValueHandler {};
+        let mut output = [0u16; 3];
+        assert_eq!(
+            handler.read_holding_registers(AddressRange::try_from(0, 3).unwrap(), &mut output),
+            Ok(())
+        );
+        assert_eq!(output, [10, 11, 12]);
+        assert_eq!(
+            handler.read_holding_registers(AddressRange::try_from(1, 3).unwrap(), &mut output),
+            Err(ExceptionCode::IllegalDataAddress)
+        );
+        let mut coils = [false; 1];
+        assert_eq!(
+            handler.read_coils(AddressRange::try_from(0, 1).unwrap(), &mut coils),
+            Err(ExceptionCode::IllegalFunction)
+        );
+    }
+
+    #[derive(Clone)]
+    struct RegisterHandler {
+        value: u16,
+    }
+    impl RequestHandler for RegisterHandler {
+        fn read_holding_register(&self, _address: u16) -> Result<u16, ExceptionCode> {
+            Ok(self.value)
+        }
+
+        // modifies the value even when the write fails
+        fn write_single_register(&mut self, value: Indexed<u16>) -> Result<(), ExceptionCode> {
+            self.value = value.value;
+            match value.index {
+                0 => Ok(()),
+                _ => Err(ExceptionCode::IllegalDataAddress),
+            }
+        }
+    }
+
+    #[test]
+    fn snapshot_update_publishes_a_new_value_without_modifying_old_snapshots() {
+        let handler = RegisterHandler { value: 1 }.snapshot();
+        let before = handler.load();
+        handler.update(|x| x.value = 2);
+        assert_eq!(before.read_holding_register(0), Ok(1));
+        assert_eq!(handler.load().read_holding_register(0), Ok(2));
+    }
+
+    #[test]
+    fn snapshot_writes_answered_with_an_exception_are_discarded() {
+        let handler = RegisterHandler { value: 1 }.snapshot();
+        let mut writer = MBAPFormatter::new(crate::decode::DecodeLevel::Nothing);
+        let header = FrameHeader::new(UnitId::new(1), crate::common::frame::TxId::new(0));
+        let mut write = |value| {
+            SharedHandler::<RegisterHandler>::write(
+                handler.as_ref(),
+                Request::WriteSingleRegister(value),
+                header,
+                &mut writer,
+            )
+            .map(|x| x.to_vec())
+        };
+
+        assert!(write(Indexed::new(1, 5)).is_ok());
+        assert_eq!(handler.load().read_holding_register(0), Ok(1));
+        assert_eq!(
+            SharedHandler::<RegisterHandler>::version(handler.as_ref()),
+            0
+        );
+
+        assert!(write(Indexed::new(0, 5)).is_ok());
+        assert_eq!(handler.load().read_holding_register(0), Ok(5));
+        assert_eq!(
+            SharedHandler::<RegisterHandler>::version(handler.as_ref()),
+            1
+        );
+    }
+
     #[test]
     fn server_handler_map_returns_old_handler_when_already_present() {
         let mut map = ServerHandlerMap::new();
@@ -176,4 +733,30 @@ mod tests {
         assert!(map.add(UnitId::new(2), DefaultHandler {}.wrap()).is_none());
         assert!(map.add(UnitId::new(1), DefaultHandler {}.wrap()).is_some());
     }
+
+    #[test]
+    fn exclusive_handlers_are_not_returned_for_snapshot_entries() {
+        let mut map = ServerHandlerMap::new();
+        assert!(!map.add_snapshot(UnitId::new(1), RegisterHandler { value: 0 }.snapshot()));
+        assert!(map.get(UnitId::new(1)).is_none());
+        assert!(map.add_snapshot(UnitId::new(1), RegisterHandler { value: 0 }.snapshot()));
+    }
+
+    #[test]
+    fn replacing_the_handlers_is_seen_by_existing_sessions() {
+        let handlers = ServerHandlers::new(ServerHandlerMap::single(
+            UnitId::new(1),
+            DefaultHandler {}.wrap(),
+        ));
+        let mut session = handlers.cache();
+        assert!(session.get(UnitId::new(1)).is_some());
+        assert!(session.get(UnitId::new(2)).is_none());
+
+        handlers.replace(ServerHandlerMap::single(
+            UnitId::new(0xFF),
+            DefaultHandler {}.wrap(),
+        ));
+        assert!(session.get(UnitId::new(1)).is_none());
+        assert!(session.get(UnitId::new(0xFF)).is_some());
+    }
 }
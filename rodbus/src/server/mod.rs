@@ -1,15 +1,85 @@
+use std::sync::Arc;
+
 use tokio::net::TcpListener;
 
-use crate::server::handler::{RequestHandler, ServerHandlerMap};
+use crate::decode::DecodeLevel;
+use crate::metrics::{ServerCounters, ServerMetrics};
+use crate::server::handler::{RequestHandler, ServerHandlerMap, ServerHandlers};
 use crate::shutdown::TaskHandle;
+use crate::socket::SocketOptions;
 use crate::tcp::server::ServerTask;
 
+pub(crate) mod cache;
+/// handlers that reply to requests asynchronously
+pub mod deferred;
 /// server handling
 pub mod handler;
+/// handler that forwards requests to an upstream channel
+pub mod proxy;
 pub(crate) mod request;
 pub(crate) mod response;
 pub(crate) mod task;
 
+/// Settings that control how the server processes its sessions
+#[derive(Copy, Clone, Debug, PartialEq, Default)]
+pub struct ServerOptions {
+    /// Level of detail used when logging the frames sent and received on each session
+    pub decode: DecodeLevel,
+    /// Settings applied to the socket of each accepted connection
+    pub socket: SocketOptions,
+    /// Maximum number of formatted read replies that each session keeps for reuse, 0 to
+    /// disable the cache. Replies are only reused while the version reported by the handler
+    /// is unchanged, see [`RequestHandler::version`]. The cache isn't used when `decode`
+    /// is enabled so that every reply is logged.
+    ///
+    /// [`RequestHandler::version`]: handler/trait.RequestHandler.html#method.version
+    pub response_cache_size: usize,
+}
+
+impl ServerOptions {
+    /// Create options with the specified decode level
+    pub fn new(decode: DecodeLevel) -> Self {
+        Self {
+            decode,
+            socket: SocketOptions::default(),
+            response_cache_size: 0,
+        }
+    }
+}
+
+/// Cloneable handle used to take snapshots of the counters maintained by a server task
+#[derive(Clone)]
+pub struct ServerMetricsHandle {
+    counters: Arc<ServerCounters>,
+}
+
+impl ServerMetricsHandle {
+    /// Take a snapshot of the counters
+    ///
+    /// The counters are updated with atomic operations, so the snapshot never blocks the sessions
+    pub fn get(&self) -> ServerMetrics {
+        self.counters.snapshot()
+    }
+}
+
+/// A handle to a spawned server task. The server shuts down when the handle is dropped.
+pub struct ServerHandle {
+    task: TaskHandle,
+    metrics: ServerMetricsHandle,
+}
+
+impl ServerHandle {
+    /// Take a snapshot of the counters maintained by the server
+    pub fn metrics(&self) -> ServerMetrics {
+        self.metrics.get()
+    }
+
+    /// Shutdown the server and wait for the task to complete
+    pub async fn shutdown(self) -> Result<(), tokio::task::JoinError> {
+        self.task.shutdown().await
+    }
+}
+
 /// Spawns a TCP server task onto the runtime. This method can only
 /// be called from within the runtime context. Use [`create_tcp_server_task`]
 /// and then spawn it manually if using outside the Tokio runtime.
@@ -20,15 +90,70 @@ pub(crate) mod task;
 /// * `listener` - A bound TCP listener used to accept connections
 /// * `handlers` - A map of handlers keyed by a unit id
 ///
+/// Use [`spawn_tcp_server_task_with_handlers`] to get a [`ServerHandle`] that can also take
+/// snapshots of the server's metrics.
+///
 /// [`create_tcp_server_task`]: fn.create_tcp_server_task.html
+/// [`spawn_tcp_server_task_with_handlers`]: fn.spawn_tcp_server_task_with_handlers.html
+/// [`ServerHandle`]: struct.ServerHandle.html
 pub fn spawn_tcp_server_task<T: RequestHandler>(
     max_sessions: usize,
     listener: TcpListener,
     handlers: ServerHandlerMap<T>,
 ) -> TaskHandle {
+    spawn_tcp_server_task_with_options(max_sessions, listener, handlers, ServerOptions::default())
+}
+
+/// Same as [`spawn_tcp_server_task`], but allows the caller to specify [`ServerOptions`]
+///
+/// * `max_sessions` - Maximum number of concurrent sessions
+/// * `listener` - A bound TCP listener used to accept connections
+/// * `handlers` - A map of handlers keyed by a unit id
+/// * `options` - Settings that control how sessions are processed
+///
+/// [`spawn_tcp_server_task`]: fn.spawn_tcp_server_task.html
+/// [`ServerOptions`]: struct.ServerOptions.html
+pub fn spawn_tcp_server_task_with_options<T: RequestHandler>(
+    max_sessions: usize,
+    listener: TcpListener,
+    handlers: ServerHandlerMap<T>,
+    options: ServerOptions,
+) -> TaskHandle {
+    spawn_tcp_server_task_with_handlers(
+        max_sessions,
+        listener,
+        ServerHandlers::new(handlers),
+        options,
+    )
+    .task
+}
+
+/// Same as [`spawn_tcp_server_task_with_options`], but the handlers are provided as
+/// [`ServerHandlers`] so that they can be replaced while the server is running
+///
+/// * `max_sessions` - Maximum number of concurrent sessions
+/// * `listener` - A bound TCP listener used to accept connections
+/// * `handlers` - Handlers keyed by a unit id. The caller may retain a clone to replace them.
+/// * `options` - Settings that control how sessions are processed
+///
+/// The returned [`ServerHandle`] can also be used to take snapshots of the server's metrics.
+///
+/// [`spawn_tcp_server_task_with_options`]: fn.spawn_tcp_server_task_with_options.html
+/// [`ServerHandlers`]: handler/struct.ServerHandlers.html
+/// [`ServerHandle`]: struct.ServerHandle.html
+pub fn spawn_tcp_server_task_with_handlers<T: RequestHandler>(
+    max_sessions: usize,
+    listener: TcpListener,
+    handlers: ServerHandlers<T>,
+    options: ServerOptions,
+) -> ServerHandle {
     let (tx, rx) = tokio::sync::mpsc::channel(1);
-    let handle = tokio::spawn(create_tcp_server_task(rx, max_sessions, listener, handlers));
-    TaskHandle::new(tx, handle)
+    let (metrics, task) =
+        create_tcp_server_task_with_handlers(rx, max_sessions, listener, handlers, options);
+    ServerHandle {
+        task: TaskHandle::new(tx, tokio::spawn(task)),
+        metrics,
+    }
 }
 
 /// Creates a TCP server task that can then be spawned onto the runtime manually.
@@ -49,7 +174,66 @@ pub async fn create_tcp_server_task<T: RequestHandler>(
     listener: TcpListener,
     handlers: ServerHandlerMap<T>,
 ) {
-    ServerTask::new(max_sessions, listener, handlers)
-        .run(rx)
-        .await
+    create_tcp_server_task_with_options(
+        rx,
+        max_sessions,
+        listener,
+        handlers,
+        ServerOptions::default(),
+    )
+    .await
+}
+
+/// Same as [`create_tcp_server_task`], but allows the caller to specify [`ServerOptions`]
+///
+/// * `rx` - Receiver used to shut down the server
+/// * `max_sessions` - Maximum number of concurrent sessions
+/// * `listener` - A bound TCP listener used to accept connections
+/// * `handlers` - A map of handlers keyed by a unit id
+/// * `options` - Settings that control how sessions are processed
+///
+/// [`create_tcp_server_task`]: fn.create_tcp_server_task.html
+/// [`ServerOptions`]: struct.ServerOptions.html
+pub async fn create_tcp_server_task_with_options<T: RequestHandler>(
+    rx: tokio::sync::mpsc::Receiver<()>,
+    max_sessions: usize,
+    listener: TcpListener,
+    handlers: ServerHandlerMap<T>,
+    options: ServerOptions,
+) {
+    let (_, task) = create_tcp_server_task_with_handlers(
+        rx,
+        max_sessions,
+        listener,
+        ServerHandlers::new(handlers),
+        options,
+    );
+    task.await
+}
+
+/// Same as [`create_tcp_server_task_with_options`], but the handlers are provided as
+/// [`ServerHandlers`] so that they can be replaced while the server is running
+///
+/// * `rx` - Receiver used to shut down the server
+/// * `max_sessions` - Maximum number of concurrent sessions
+/// * `listener` - A bound TCP listener used to accept connections
+/// * `handlers` - Handlers keyed by a unit id. The caller may retain a clone to replace them.
+/// * `options` - Settings that control how sessions are processed
+///
+/// Returns the task along with a handle that can be used to take snapshots of its metrics.
+///
+/// [`create_tcp_server_task_with_options`]: fn.create_tcp_server_task_with_options.html
+/// [`ServerHandlers`]: handler/struct.ServerHandlers.html
+pub fn create_tcp_server_task_with_handlers<T: RequestHandler>(
+    rx: tokio::sync::mpsc::Receiver<()>,
+    max_sessions: usize,
+    listener: TcpListener,
+    handlers: ServerHandlers<T>,
+    options: ServerOptions,
+) -> (ServerMetricsHandle, impl std::future::Future<Output = ()>) {
+    let counters = Arc::new(ServerCounters::default());
+    let mut task = ServerTask::new(max_sessions, listener, handlers, options, counters.clone());
+    (ServerMetricsHandle { counters }, async move {
+        task.run(rx).await
+    })
 }
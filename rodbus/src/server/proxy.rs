@@ -0,0 +1,421 @@
+use std::collections::HashMap;
+use std::future::Future;
+use std::sync::{Arc, Mutex};
+use std::time::Duration;
+
+use tokio::time::Instant;
+
+use crate::client::session::AsyncSession;
+use crate::error::details::ExceptionCode;
+use crate::error::Error;
+use crate::server::deferred::{DeferredHandler, Reply};
+use crate::types::{AddressRange, Indexed, WriteMultiple};
+
+/// A [`DeferredHandler`] that forwards the requests it receives to an upstream server
+///
+/// Reads that arrive while an identical read (same table and range) is waiting for its
+/// upstream response are answered by that response, so any number of identical downstream
+/// polls result in a single upstream transaction. Successful reads are also kept for the
+/// freshness window and reads of the same range within the window are answered from the cache
+/// without an upstream transaction.
+///
+/// Writes are always forwarded. Once a write completes, the cached values of the table it
+/// modified are discarded so that subsequent reads see its effect.
+///
+/// Upstream failures are reported downstream as exceptions: a response timeout as
+/// `GatewayTargetDeviceFailedToRespond`, any other failure that isn't an exception from the
+/// upstream server as `GatewayPathUnavailable`.
+///
+/// Add the handler to a [`ServerHandlerMap`] with `add_deferred`, once for each unit id that
+/// the proxy routes to an upstream channel.
+///
+/// [`DeferredHandler`]: ../deferred/trait.DeferredHandler.html
+/// [`ServerHandlerMap`]: ../handler/struct.ServerHandlerMap.html
+pub struct ProxyHandler {
+    session: AsyncSession,
+    freshness: Duration,
+    bits: SharedCache<bool>,
+    registers: SharedCache<u16>,
+}
+
+type SharedCache<T> = Arc<Mutex<Cache<T, Reply<Vec<T>>>>>;
+
+#[derive(Copy, Clone, Debug, PartialEq, Eq, Hash)]
+enum Table {
+    Coils,
+    DiscreteInputs,
+    HoldingRegisters,
+    InputRegisters,
+}
+
+#[derive(Copy, Clone, Debug, PartialEq, Eq, Hash)]
+struct Key {
+    table: Table,
+    start: u16,
+    count: u16,
+}
+
+impl Key {
+    fn new(table: Table, range: AddressRange) -> Self {
+        Self {
+            table,
+            start: range.start,
+            count: range.count,
+        }
+    }
+}
+
+enum Entry<T, W> {
+    Fresh(Instant, Vec<T>),
+    // stale is set if a write to the table completes during the read, its values aren't cached
+    Pending { waiters: Vec<W>, stale: bool },
+}
+
+enum Lookup<T, W> {
+    Hit(W, Vec<T>),
+    Joined,
+    Fetch,
+}
+
+/// Cached values and reads in progress. Generic over the waiter so that it can be tested
+/// without sessions.
+struct Cache<T, W> {
+    freshness: Duration,
+    entries: HashMap<Key, Entry<T, W>>,
+}
+
+impl<T: Clone, W> Cache<T, W> {
+    fn new(freshness: Duration) -> Self {
+        Self {
+            freshness,
+            entries: HashMap::new(),
+        }
+    }
+
+    fn lookup(&mut self, key: Key, waiter: W, now: Instant) -> Lookup<T, W> {
+        match self.entries.get_mut(&key) {
+            Some(Entry::Pending { waiters, .. }) => {
+                waiters.push(waiter);
+                return Lookup::Joined;
+            }
+            Some(Entry::Fresh(time, values)) if now.duration_since(*time) < self.freshness => {
+                return Lookup::Hit(waiter, values.clone());
+            }
+            _ => {}
+        }
+        self.entries.insert(
+            key,
+            Entry::Pending {
+                waiters: vec![waiter],
+                stale: false,
+            },
+        );
+        Lookup::Fetch
+    }
+
+    /// record the result of a read, returning the waiters that must receive it
+    fn complete(
+        &mut self,
+        key: Key,
+        result: &Result<Vec<T>, ExceptionCode>,
+        now: Instant,
+    ) -> Vec<W> {
+        let (waiters, stale) = match self.entries.remove(&key) {
+            Some(Entry::Pending { waiters, stale }) => (waiters, stale),
+            _ => (Vec::new(), true),
+        };
+        if let Ok(values) = result {
+            if !stale && self.freshness > Duration::from_secs(0) {
+                self.entries.insert(key, Entry::Fresh(now, values.clone()));
+            }
+        }
+        waiters
+    }
+
+    /// discard the values cached for a table after it has been written
+    fn invalidate(&mut self, table: Table) {
+        self.entries.retain(|key, entry| match entry {
+            Entry::Fresh(_, _) => key.table != table,
+            Entry::Pending { stale, .. } => {
+                *stale |= key.table == table;
+                true
+            }
+        });
+    }
+}
+
+fn with_cache<T, W, R>(
+    cache: &Mutex<Cache<T, W>>,
+    action: impl FnOnce(&mut Cache<T, W>) -> R,
+) -> R {
+    // the cache is never left in an inconsistent state, so a poisoned lock can still be used
+    let mut guard = match cache.lock() {
+        Ok(x) => x,
+        Err(x) => x.into_inner(),
+    };
+    action(&mut guard)
+}
+
+/// values that can be sent in a read reply
+trait Value: Clone + Send + 'static {
+    fn reply(reply: Reply<Vec<Self>>, result: Result<Vec<Self>, ExceptionCode>);
+}
+
+impl Value for bool {
+    fn reply(reply: Reply<Vec<Self>>, result: Result<Vec<Self>, ExceptionCode>) {
+        reply.send(result)
+    }
+}
+
+impl Value for u16 {
+    fn reply(reply: Reply<Vec<Self>>, result: Result<Vec<Self>, ExceptionCode>) {
+        reply.send(result)
+    }
+}
+
+impl ProxyHandler {
+    /// Create a handler that forwards requests through the session
+    ///
+    /// * `session` - Session of the upstream channel, its unit id and response timeout are
+    /// used for every forwarded request
+    /// * `freshness` - How long the values of a read are served from the cache, 0 disables
+    /// the cache, but identical reads in progress are still combined
+    pub fn new(session: AsyncSession, freshness: Duration) -> Self {
+        Self {
+            session,
+            freshness,
+            bits: Arc::new(Mutex::new(Cache::new(freshness))),
+            registers: Arc::new(Mutex::new(Cache::new(freshness))),
+        }
+    }
+
+    /// How long the values of a read are served from the cache
+    pub fn freshness(&self) -> Duration {
+        self.freshness
+    }
+
+    fn exception(err: Error) -> ExceptionCode {
+        match err {
+            Error::Exception(x) => x,
+            Error::ResponseTimeout => ExceptionCode::GatewayTargetDeviceFailedToRespond,
+            _ => ExceptionCode::GatewayPathUnavailable,
+        }
+    }
+
+    fn read<T, F, R>(&self, cache: &SharedCache<T>, key: Key, reply: Reply<Vec<T>>, fetch: F)
+    where
+        T: Value,
+        F: FnOnce(AsyncSession) -> R,
+        R: Future<Output = Result<Vec<Indexed<T>>, Error>> + Send + 'static,
+    {
+        match with_cache(cache, |x| x.lookup(key, reply, Instant::now())) {
+            Lookup::Hit(reply, values) => T::reply(reply, Ok(values)),
+            Lookup::Joined => {}
+            Lookup::Fetch => {
+                let response = fetch(self.session.clone());
+                let cache = cache.clone();
+                tokio::spawn(async move {
+                    let result = response
+                        .await
+                        .map(|x| x.into_iter().map(|x| x.value).collect::<Vec<T>>())
+                        .map_err(Self::exception);
+                    let waiters = with_cache(&cache, |x| x.complete(key, &result, Instant::now()));
+                    for waiter in waiters {
+                        T::reply(waiter, result.clone());
+                    }
+                });
+            }
+        }
+    }
+
+    fn write<T, F, R, O>(&self, cache: &SharedCache<T>, table: Table, reply: Reply<()>, forward: F)
+    where
+        T: Value,
+        F: FnOnce(AsyncSession) -> R,
+        R: Future<Output = Result<O, Error>> + Send + 'static,
+    {
+        let response = forward(self.session.clone());
+        let cache = cache.clone();
+        tokio::spawn(async move {
+            let result = response.await;
+            with_cache(&cache, |x| x.invalidate(table));
+            reply.send(result.map(|_| ()).map_err(Self::exception))
+        });
+    }
+}
+
+impl DeferredHandler for ProxyHandler {
+    fn read_coils(&self, range: AddressRange, reply: Reply<Vec<bool>>) {
+        let key = Key::new(Table::Coils, range);
+        self.read(&self.bits, key, reply, |mut session| async move {
+            session.read_coils(range).await
+        })
+    }
+
+    fn read_discrete_inputs(&self, range: AddressRange, reply: Reply<Vec<bool>>) {
+        let key = Key::new(Table::DiscreteInputs, range);
+        self.read(&self.bits, key, reply, |mut session| async move {
+            session.read_discrete_inputs(range).await
+        })
+    }
+
+    fn read_holding_registers(&self, range: AddressRange, reply: Reply<Vec<u16>>) {
+        let key = Key::new(Table::HoldingRegisters, range);
+        self.read(&self.registers, key, reply, |mut session| async move {
+            session.read_holding_registers(range).await
+        })
+    }
+
+    fn read_input_registers(&self, range: AddressRange, reply: Reply<Vec<u16>>) {
+        let key = Key::new(Table::InputRegisters, range);
+        self.read(&self.registers, key, reply, |mut session| async move {
+            session.read_input_registers(range).await
+        })
+    }
+
+    fn write_single_coil(&self, value: Indexed<bool>, reply: Reply<()>) {
+        self.write(&self.bits, Table::Coils, reply, |mut session| async move {
+            session.write_single_coil(value).await
+        })
+    }
+
+    fn write_single_register(&self, value: Indexed<u16>, reply: Reply<()>) {
+        self.write(
+            &self.registers,
+            Table::HoldingRegisters,
+            reply,
+            |mut session| async move { session.write_single_register(value).await },
+        )
+    }
+
+    fn write_multiple_coils(&self, range: AddressRange, values: Vec<bool>, reply: Reply<()>) {
+        self.write(&self.bits, Table::Coils, reply, |mut session| async move {
+            let request = WriteMultiple::from(range.start, values)?;
+            session.write_multiple_coils(request).await
+        })
+    }
+
+    fn write_multiple_registers(&self, range: AddressRange, values: Vec<u16>, reply: Reply<()>) {
+        self.write(
+            &self.registers,
+            Table::HoldingRegisters,
+            reply,
+            |mut session| async move {
+                let request = WriteMultiple::from(range.start, values)?;
+                session.write_multiple_registers(request).await
+            },
+        )
+    }
+
+    fn read_write_multiple_registers(
+        &self,
+        read: AddressRange,
+        write: AddressRange,
+        values: Vec<u16>,
+        reply: Reply<Vec<u16>>,
+    ) {
+        // the read can't be served from the cache since it must observe the write
+        let response = {
+            let mut session = self.session.clone();
+            async move {
+                let request = WriteMultiple::from(write.start, values)?;
+                session.read_write_multiple_registers(read, request).await
+            }
+        };
+        let cache = self.registers.clone();
+        tokio::spawn(async move {
+            let result = response.await;
+            with_cache(&cache, |x| x.invalidate(Table::HoldingRegisters));
+            reply.send(
+                result
+                    .map(|x| x.into_iter().map(|x| x.value).collect())
+                    .map_err(Self::exception),
+            )
+        });
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn key(table: Table) -> Key {
+        Key::new(table, AddressRange::try_from(0, 2).unwrap())
+    }
+
+    fn hit(lookup: Lookup<u16, u8>) -> Option<(u8, Vec<u16>)> {
+        match lookup {
+            Lookup::Hit(waiter, values) => Some((waiter, values)),
+            _ => None,
+        }
+    }
+
+    #[test]
+    fn identical_reads_in_progress_are_combined() {
+        let mut cache: Cache<u16, u8> = Cache::new(Duration::from_secs(0));
+        let now = Instant::now();
+        let key = key(Table::HoldingRegisters);
+
+        assert!(matches!(cache.lookup(key, 1, now), Lookup::Fetch));
+        assert!(matches!(cache.lookup(key, 2, now), Lookup::Joined));
+        assert!(matches!(
+            cache.lookup(
+                Key::new(Table::InputRegisters, AddressRange::try_from(0, 2).unwrap()),
+                3,
+                now
+            ),
+            Lookup::Fetch
+        ));
+
+        assert_eq!(cache.complete(key, &Ok(vec![1, 2]), now), vec![1, 2]);
+        // nothing is cached without a freshness window
+        assert!(matches!(cache.lookup(key, 4, now), Lookup::Fetch));
+    }
+
+    #[test]
+    fn reads_are_served_from_the_cache_within_the_window() {
+        let mut cache: Cache<u16, u8> = Cache::new(Duration::from_secs(1));
+        let now = Instant::now();
+        let key = key(Table::HoldingRegisters);
+
+        assert!(matches!(cache.lookup(key, 1, now), Lookup::Fetch));
+        cache.complete(key, &Ok(vec![1, 2]), now);
+
+        assert_eq!(hit(cache.lookup(key, 2, now)), Some((2, vec![1, 2])));
+        let later = now + Duration::from_secs(1);
+        assert!(matches!(cache.lookup(key, 3, later), Lookup::Fetch));
+    }
+
+    #[test]
+    fn failed_reads_are_not_cached() {
+        let mut cache: Cache<u16, u8> = Cache::new(Duration::from_secs(1));
+        let now = Instant::now();
+        let key = key(Table::HoldingRegisters);
+
+        cache.lookup(key, 1, now);
+        cache.complete(key, &Err(ExceptionCode::GatewayPathUnavailable), now);
+        assert!(matches!(cache.lookup(key, 2, now), Lookup::Fetch));
+    }
+
+    #[test]
+    fn writes_discard_the_values_of_their_table() {
+        let mut cache: Cache<u16, u8> = Cache::new(Duration::from_secs(1));
+        let now = Instant::now();
+        let holding = key(Table::HoldingRegisters);
+        let input = key(Table::InputRegisters);
+
+        for key in &[holding, input] {
+            cache.lookup(*key, 1, now);
+            cache.complete(*key, &Ok(vec![1, 2]), now);
+        }
+
+        cache.invalidate(Table::HoldingRegisters);
+        assert!(matches!(cache.lookup(holding, 2, now), Lookup::Fetch));
+        assert!(hit(cache.lookup(input, 3, now)).is_some());
+
+        // a read in progress during the write still completes, but isn't cached
+        cache.invalidate(Table::HoldingRegisters);
+        assert_eq!(cache.complete(holding, &Ok(vec![3, 4]), now), vec![2]);
+        assert!(matches!(cache.lookup(holding, 4, now), Lookup::Fetch));
+    }
+}
@@ -2,35 +2,121 @@ use crate::common::cursor::ReadCursor;
 use crate::common::frame::{FrameFormatter, FrameHeader};
 use crate::common::function::FunctionCode;
 use crate::common::traits::{Parse, Serialize};
+use crate::constants::limits::{
+    MAX_READ_COILS_COUNT, MAX_READ_REGISTERS_COUNT, MAX_READ_WRITE_REGISTERS_WRITE_COUNT,
+};
 use crate::error::details::ExceptionCode;
 use crate::error::Error;
 use crate::server::handler::RequestHandler;
-use crate::server::response::{BitWriter, RegisterWriter};
 use crate::tcp::frame::MBAPFormatter;
 use crate::types::*;
 
-pub(crate) enum Request<'a> {
+/// requests that only require shared access to the handler
+#[derive(Copy, Clone)]
+pub(crate) enum ReadRequest {
     ReadCoils(ReadBitsRange),
     ReadDiscreteInputs(ReadBitsRange),
     ReadHoldingRegisters(ReadRegistersRange),
     ReadInputRegisters(ReadRegistersRange),
+}
+
+pub(crate) enum Request<'a> {
+    Read(ReadRequest),
     WriteSingleCoil(Indexed<bool>),
     WriteSingleRegister(Indexed<u16>),
     WriteMultipleCoils(WriteCoils<'a>),
     WriteMultipleRegisters(WriteRegisters<'a>),
+    ReadWriteMultipleRegisters(ReadRegistersRange, WriteRegisters<'a>),
+}
+
+fn serialize_result<T>(
+    function: FunctionCode,
+    header: FrameHeader,
+    writer: &mut MBAPFormatter,
+    result: Result<T, ExceptionCode>,
+) -> Result<&[u8], Error>
+where
+    T: Serialize,
+{
+    match result {
+        Ok(data) => writer.format(header, function, &data),
+        Err(ex) => writer.exception(header, function, ex),
+    }
+}
+
+impl ReadRequest {
+    pub(crate) fn get_function(&self) -> FunctionCode {
+        match self {
+            ReadRequest::ReadCoils(_) => FunctionCode::ReadCoils,
+            ReadRequest::ReadDiscreteInputs(_) => FunctionCode::ReadDiscreteInputs,
+            ReadRequest::ReadHoldingRegisters(_) => FunctionCode::ReadHoldingRegisters,
+            ReadRequest::ReadInputRegisters(_) => FunctionCode::ReadInputRegisters,
+        }
+    }
+
+    pub(crate) fn range(&self) -> AddressRange {
+        match self {
+            ReadRequest::ReadCoils(x) => x.inner,
+            ReadRequest::ReadDiscreteInputs(x) => x.inner,
+            ReadRequest::ReadHoldingRegisters(x) => x.inner,
+            ReadRequest::ReadInputRegisters(x) => x.inner,
+        }
+    }
+
+    pub(crate) fn get_reply<'b, T>(
+        self,
+        header: FrameHeader,
+        handler: &T,
+        writer: &'b mut MBAPFormatter,
+    ) -> Result<&'b [u8], Error>
+    where
+        T: RequestHandler,
+    {
+        let function = self.get_function();
+        match self {
+            ReadRequest::ReadCoils(range) => {
+                let mut buffer = [false; MAX_READ_COILS_COUNT as usize];
+                let output = &mut buffer[..range.inner.count as usize];
+                let result = handler.read_coils(range.inner, output).map(|_| &*output);
+                serialize_result(function, header, writer, result)
+            }
+            ReadRequest::ReadDiscreteInputs(range) => {
+                let mut buffer = [false; MAX_READ_COILS_COUNT as usize];
+                let output = &mut buffer[..range.inner.count as usize];
+                let result = handler
+                    .read_discrete_inputs(range.inner, output)
+                    .map(|_| &*output);
+                serialize_result(function, header, writer, result)
+            }
+            ReadRequest::ReadHoldingRegisters(range) => {
+                let mut buffer = [0u16; MAX_READ_REGISTERS_COUNT as usize];
+                let output = &mut buffer[..range.inner.count as usize];
+                let result = handler
+                    .read_holding_registers(range.inner, output)
+                    .map(|_| &*output);
+                serialize_result(function, header, writer, result)
+            }
+            ReadRequest::ReadInputRegisters(range) => {
+                let mut buffer = [0u16; MAX_READ_REGISTERS_COUNT as usize];
+                let output = &mut buffer[..range.inner.count as usize];
+                let result = handler
+                    .read_input_registers(range.inner, output)
+                    .map(|_| &*output);
+                serialize_result(function, header, writer, result)
+            }
+        }
+    }
 }
 
 impl<'a> Request<'a> {
     pub(crate) fn get_function(&self) -> FunctionCode {
         match self {
-            Request::ReadCoils(_) => FunctionCode::ReadCoils,
-            Request::ReadDiscreteInputs(_) => FunctionCode::ReadDiscreteInputs,
-            Request::ReadHoldingRegisters(_) => FunctionCode::ReadHoldingRegisters,
-            Request::ReadInputRegisters(_) => FunctionCode::ReadInputRegisters,
+            Request::Read(request) => request.get_function(),
             Request::WriteSingleCoil(_) => FunctionCode::WriteSingleCoil,
             Request::WriteSingleRegister(_) => FunctionCode::WriteSingleRegister,
             Request::WriteMultipleCoils(_) => FunctionCode::WriteMultipleCoils,
             Request::WriteMultipleRegisters(_) => FunctionCode::WriteMultipleRegisters,
+            Request::ReadWriteMultipleRegisters(_, _) => FunctionCode::ReadWriteMultipleRegisters,
         }
     }
 
@@ -43,41 +129,9 @@ impl<'a> Request<'a> {
     where
         T: RequestHandler,
     {
-        fn serialize_result<T>(
-            function: FunctionCode,
-            header: FrameHeader,
-            writer: &mut MBAPFormatter,
-            result: Result<T, ExceptionCode>,
-        ) -> Result<&[u8], Error>
-        where
-            T: Serialize,
-        {
-            match result {
-                Ok(data) => writer.format(header, function, &data),
-                Err(ex) => writer.exception(header, function, ex),
-            }
-        }
-
         let function = self.get_function();
         match self {
-            Request::ReadCoils(range) => {
-                let bits = BitWriter::new(range, |index| handler.read_coil(index));
-                writer.format(header, function, &bits)
-            }
-            Request::ReadDiscreteInputs(range) => {
-                let bits = BitWriter::new(range, |index| handler.read_discrete_input(index));
-                writer.format(header, function, &bits)
-            }
-            Request::ReadHoldingRegisters(range) => {
-                let registers =
-                    RegisterWriter::new(range, |index| handler.read_holding_register(index));
-                writer.format(header, function, &registers)
-            }
-            Request::ReadInputRegisters(range) => {
-                let registers =
-                    RegisterWriter::new(range, |index| handler.read_input_register(index));
-                writer.format(header, function, &registers)
-            }
+            Request::Read(request) => request.get_reply(header, handler, writer),
             Request::WriteSingleCoil(request) => serialize_result(
                 function,
                 header,
@@ -102,31 +156,44 @@ impl<'a> Request<'a> {
                 writer,
                 handler.write_multiple_registers(items).map(|_| items.range),
             ),
+            Request::ReadWriteMultipleRegisters(read, write) => {
+                let mut buffer = [0u16; MAX_READ_REGISTERS_COUNT as usize];
+                let output = &mut buffer[..read.inner.count as usize];
+                let result = handler
+                    .read_write_multiple_registers(write, read.inner, output)
+                    .map(|_| &*output);
+                serialize_result(function, header, writer, result)
+            }
         }
     }
 
     pub(crate) fn parse(function: FunctionCode, cursor: &'a mut ReadCursor) -> Result<Self, Error> {
         match function {
             FunctionCode::ReadCoils => {
-                let x = Request::ReadCoils(AddressRange::parse(cursor)?.of_read_bits()?);
+                let x = Request::Read(ReadRequest::ReadCoils(
+                    AddressRange::parse(cursor)?.of_read_bits()?,
+                ));
                 cursor.expect_empty()?;
                 Ok(x)
             }
             FunctionCode::ReadDiscreteInputs => {
-                let x = Request::ReadDiscreteInputs(AddressRange::parse(cursor)?.of_read_bits()?);
+                let x = Request::Read(ReadRequest::ReadDiscreteInputs(
+                    AddressRange::parse(cursor)?.of_read_bits()?,
+                ));
                 cursor.expect_empty()?;
                 Ok(x)
             }
             FunctionCode::ReadHoldingRegisters => {
-                let x = Request::ReadHoldingRegisters(
+                let x = Request::Read(ReadRequest::ReadHoldingRegisters(
                     AddressRange::parse(cursor)?.of_read_registers()?,
-                );
+                ));
                 cursor.expect_empty()?;
                 Ok(x)
             }
             FunctionCode::ReadInputRegisters => {
-                let x =
-                    Request::ReadInputRegisters(AddressRange::parse(cursor)?.of_read_registers()?);
+                let x = Request::Read(ReadRequest::ReadInputRegisters(
+                    AddressRange::parse(cursor)?.of_read_registers()?,
+                ));
                 cursor.expect_empty()?;
                 Ok(x)
             }
@@ -158,6 +225,17 @@ impl<'a> Request<'a> {
                     RegisterIterator::parse_all(range, cursor)?,
                 )))
             }
+            FunctionCode::ReadWriteMultipleRegisters => {
+                let read = AddressRange::parse(cursor)?.of_read_registers()?;
+                let range = AddressRange::parse(cursor)?
+                    .limited_count(MAX_READ_WRITE_REGISTERS_WRITE_COUNT)?;
+                // don't care about the count, validated b/c all bytes are consumed
+                cursor.read_u8()?;
+                Ok(Request::ReadWriteMultipleRegisters(
+                    read,
+                    WriteRegisters::new(range, RegisterIterator::parse_all(range, cursor)?),
+                ))
+            }
         }
     }
 }
@@ -235,7 +313,7 @@ mod tests {
         use crate::common::cursor::ReadCursor;
 
         use super::super::*;
-        use crate::error::details::ADUParseError;
+        use crate::error::details::{ADUParseError, InvalidRange};
         use crate::types::Indexed;
 
         #[test]
@@ -290,5 +368,37 @@ mod tests {
                 vec![Indexed::new(1, 0xCAFE), Indexed::new(2, 0xBBDD)]
             )
         }
+
+        #[test]
+        fn can_parse_read_write_registers() {
+            let mut cursor = ReadCursor::new(&[
+                0x00, 0x07, 0x00, 0x03, 0x00, 0x01, 0x00, 0x01, 0x02, 0xCA, 0xFE,
+            ]);
+            let (read, write) = match Request::parse(
+                FunctionCode::ReadWriteMultipleRegisters,
+                &mut cursor,
+            )
+            .unwrap()
+            {
+                Request::ReadWriteMultipleRegisters(read, write) => (read, write),
+                _ => panic!("bad match"),
+            };
+
+            assert_eq!(read.get(), AddressRange::try_from(7, 3).unwrap());
+            assert_eq!(write.range, AddressRange::try_from(1, 1).unwrap());
+            assert_eq!(
+                write.iterator.collect::<Vec<Indexed<u16>>>(),
+                vec![Indexed::new(1, 0xCAFE)]
+            )
+        }
+
+        #[test]
+        fn fails_when_read_write_registers_writes_too_many() {
+            let mut cursor = ReadCursor::new(&[0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x7A]);
+            let err = Request::parse(FunctionCode::ReadWriteMultipleRegisters, &mut cursor)
+                .err()
+                .unwrap();
+            assert_eq!(err, InvalidRange::CountTooLargeForType(0x7A, 0x79).into());
+        }
     }
 }
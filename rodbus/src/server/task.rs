@@ -1,25 +1,60 @@
+use std::sync::Arc;
+
 use tokio::io::{AsyncRead, AsyncWrite, AsyncWriteExt};
+use tokio::sync::mpsc::{unbounded_channel, UnboundedReceiver, UnboundedSender};
 
 use crate::common::cursor::ReadCursor;
 use crate::common::frame::{Frame, FrameFormatter, FrameHeader, FramedReader};
 use crate::common::function::FunctionCode;
+use crate::decode::DecodeLevel;
 use crate::error::details::ExceptionCode;
 use crate::error::*;
-use crate::server::handler::{RequestHandler, ServerHandlerMap};
+use crate::metrics::ServerCounters;
+use crate::server::cache::{Key, ResponseCache};
+use crate::server::deferred::CompletedReply;
+use crate::server::handler::{HandlerEntry, HandlerTableCache, RequestHandler};
 use crate::server::request::Request;
 use crate::server::response::ErrorResponse;
+use crate::server::ServerOptions;
+use crate::tcp::frame::constants::HEADER_LENGTH;
 use crate::tcp::frame::{MBAPFormatter, MBAPParser};
 
+// large enough to hold several pipelined requests
+const READ_BUFFER_SIZE: usize = 4 * crate::tcp::frame::constants::MAX_FRAME_LENGTH;
+// the session stops reading requests while this many replies are deferred
+const MAX_DEFERRED_REPLIES: usize = 16;
+
 pub(crate) struct SessionTask<T, U>
 where
     T: RequestHandler,
     U: AsyncRead + AsyncWrite + Unpin,
 {
     io: U,
-    handlers: ServerHandlerMap<T>,
     shutdown: tokio::sync::mpsc::Receiver<()>,
     reader: FramedReader<MBAPParser>,
+    replies: ReplyQueue<T>,
+    deferred: UnboundedReceiver<CompletedReply>,
+}
+
+/// Processes requests and accumulates the replies until they are flushed
+///
+/// This is kept separate from the reader so that frames can be processed while
+/// they still borrow the read buffer
+struct ReplyQueue<T>
+where
+    T: RequestHandler,
+{
+    handlers: HandlerTableCache<T>,
     writer: MBAPFormatter,
+    // replies that are waiting to be written to the socket
+    output: Vec<u8>,
+    // given to deferred handlers to send their replies back to the session
+    deferred: UnboundedSender<CompletedReply>,
+    // requests passed to a deferred handler that haven't been replied to
+    outstanding: usize,
+    // formatted replies to reads that are reused until the handler changes
+    cache: ResponseCache,
+    metrics: Arc<ServerCounters>,
 }
 
 impl<T, U> SessionTask<T, U>
@@ -29,25 +64,44 @@ where
 {
     pub(crate) fn new(
         io: U,
-        handlers: ServerHandlerMap<T>,
+        handlers: HandlerTableCache<T>,
         shutdown: tokio::sync::mpsc::Receiver<()>,
+        options: ServerOptions,
+        metrics: Arc<ServerCounters>,
     ) -> Self {
+        let (tx, rx) = unbounded_channel();
+        let decode = options.decode;
+        let capacity = options.socket.read_buffer_size.unwrap_or(READ_BUFFER_SIZE);
+        // cached replies bypass the formatter, which is what logs them
+        let cache_size = if decode == DecodeLevel::Nothing {
+            options.response_cache_size
+        } else {
+            0
+        };
         Self {
             io,
-            handlers,
             shutdown,
-            reader: FramedReader::new(MBAPParser::new()),
-            writer: MBAPFormatter::new(),
+            reader: FramedReader::with_capacity(MBAPParser::new(), capacity, decode),
+            replies: ReplyQueue {
+                handlers,
+                writer: MBAPFormatter::new(decode),
+                output: Vec::new(),
+                deferred: tx,
+                outstanding: 0,
+                cache: ResponseCache::new(cache_size),
+                metrics,
+            },
+            deferred: rx,
         }
     }
 
-    async fn reply_with_error(
-        &mut self,
-        header: FrameHeader,
-        err: ErrorResponse,
-    ) -> Result<(), Error> {
-        let bytes = self.writer.error(header, err)?;
-        self.io.write_all(bytes).await?;
+    async fn flush(&mut self) -> Result<(), Error> {
+        let output = &mut self.replies.output;
+        if !output.is_empty() {
+            self.io.write_all(output.as_slice()).await?;
+            self.replies.metrics.bytes_sent(output.len());
+            output.clear();
+        }
         Ok(())
     }
 
@@ -58,19 +112,95 @@ where
     }
 
     async fn run_one(&mut self) -> Result<(), Error> {
+        let accepting = self.replies.outstanding < MAX_DEFERRED_REPLIES;
         tokio::select! {
-            frame = self.reader.next_frame(&mut self.io) => {
-               self.reply_to_request(frame?).await
+            frame = self.reader.next_frame(&mut self.io), if accepting => {
+               self.replies.reply_to_request(frame?).await?;
+            }
+            // the session holds a sender, so this never returns None
+            reply = self.deferred.recv() => {
+                if let Some(reply) = reply {
+                    self.replies.reply_deferred(reply)?;
+                }
             }
             _ = self.shutdown.recv() => {
-               Err(crate::error::Error::Shutdown)
+               return Err(Error::Shutdown);
             }
         }
+
+        // process any requests the client pipelined behind the first one, and any deferred
+        // replies that are ready, so that all of the replies go out in a single write
+        let result = self.reply_to_buffered_requests().await;
+        self.flush().await?;
+        result
     }
 
-    async fn reply_to_request(&mut self, frame: Frame) -> Result<(), Error> {
+    async fn reply_to_buffered_requests(&mut self) -> Result<(), Error> {
+        while self.replies.outstanding < MAX_DEFERRED_REPLIES {
+            match self.reader.try_next_frame()? {
+                Some(frame) => self.replies.reply_to_request(frame).await?,
+                None => break,
+            }
+        }
+        while let Ok(reply) = self.deferred.try_recv() {
+            self.replies.reply_deferred(reply)?;
+        }
+        Ok(())
+    }
+}
+
+impl<T> ReplyQueue<T>
+where
+    T: RequestHandler,
+{
+    fn queue(output: &mut Vec<u8>, metrics: &ServerCounters, reply: &[u8]) {
+        metrics.reply_queued(reply.get(HEADER_LENGTH..).unwrap_or(&[]));
+        output.extend_from_slice(reply);
+    }
+
+    /// queue a copy of a cached reply with the ids of the request, returns false if there was
+    /// no reply for the current version
+    fn queue_cached(
+        cache: &ResponseCache,
+        output: &mut Vec<u8>,
+        metrics: &ServerCounters,
+        lookup: Option<(Key, u64)>,
+        header: FrameHeader,
+    ) -> bool {
+        match cache.get(lookup) {
+            Some(reply) => {
+                let start = output.len();
+                Self::queue(output, metrics, reply);
+                if let Some(x) = output.get_mut(start..) {
+                    ResponseCache::patch(x, header);
+                }
+                true
+            }
+            None => false,
+        }
+    }
+
+    fn reply_with_error(&mut self, header: FrameHeader, err: ErrorResponse) -> Result<(), Error> {
+        let bytes = self.writer.error(header, err)?;
+        Self::queue(&mut self.output, &self.metrics, bytes);
+        Ok(())
+    }
+
+    fn reply_deferred(&mut self, reply: CompletedReply) -> Result<(), Error> {
+        self.outstanding = self.outstanding.saturating_sub(1);
+        let bytes = reply.format(&mut self.writer)?;
+        Self::queue(&mut self.output, &self.metrics, bytes);
+        Ok(())
+    }
+
+    async fn reply_to_request(&mut self, frame: Frame<'_>) -> Result<(), Error> {
+        self.metrics
+            .frame_received(HEADER_LENGTH + frame.payload().len());
         let mut cursor = ReadCursor::new(frame.payload());
 
+        // replies cached for the previous table may have come from other handlers
+        self.cache.set_table_version(self.handlers.refresh());
+
         // if no addresses match, then don't respond
         let handler = match self.handlers.get(frame.header.unit_id) {
             None => {
@@ -83,6 +213,8 @@ where
             Some(handler) => handler,
         };
 
+        self.metrics.request_received();
+
         let function = match cursor.read_u8() {
             Err(_) => {
                 log::warn!("received an empty frame");
@@ -93,8 +225,7 @@ where
                 None => {
                     log::warn!("received unknown function code: {}", value);
                     return self
-                        .reply_with_error(frame.header, ErrorResponse::unknown_function(value))
-                        .await;
+                        .reply_with_error(frame.header, ErrorResponse::unknown_function(value));
                 }
             },
         };
@@ -108,19 +239,292 @@ where
                     function,
                     ExceptionCode::IllegalDataValue,
                 )?;
-                self.io.write_all(reply).await?;
+                Self::queue(&mut self.output, &self.metrics, reply);
                 return Ok(());
             }
         };
 
+        let key = match request {
+            Request::Read(x) if self.cache.is_enabled() => Some(Key::new(frame.header.unit_id, &x)),
+            _ => None,
+        };
+
         // get the reply data (or exception reply)
-        let reply_frame: &[u8] = {
-            let mut lock = handler.lock().await;
-            request.get_reply(frame.header, lock.as_mut(), &mut self.writer)?
+        let writer = &mut self.writer;
+        let reply_frame: &[u8] = match handler {
+            HandlerEntry::Exclusive(handler) => {
+                let start = std::time::Instant::now();
+                let mut lock = handler.lock().await;
+                self.metrics.lock_acquired(start.elapsed());
+                // the version is read under the lock so that it matches the values
+                let lookup = key.and_then(|k| lock.version().map(|v| (k, v)));
+                if Self::queue_cached(
+                    &self.cache,
+                    &mut self.output,
+                    &self.metrics,
+                    lookup,
+                    frame.header,
+                ) {
+                    return Ok(());
+                }
+                let reply = request.get_reply(frame.header, lock.as_mut(), writer)?;
+                self.cache.insert(lookup, reply);
+                reply
+            }
+            HandlerEntry::Snapshot(handler) => match request {
+                // reads never wait on other sessions or the writer
+                Request::Read(request) => {
+                    // loaded before the snapshot, so a reply is never newer than its version
+                    let lookup = key.map(|k| (k, handler.version()));
+                    if Self::queue_cached(
+                        &self.cache,
+                        &mut self.output,
+                        &self.metrics,
+                        lookup,
+                        frame.header,
+                    ) {
+                        return Ok(());
+                    }
+                    let reply = handler.read(request, frame.header, writer)?;
+                    self.cache.insert(lookup, reply);
+                    reply
+                }
+                _ => handler.write(request, frame.header, writer)?,
+            },
+            HandlerEntry::Deferred(handler) => {
+                // the reply is queued when the handler sends it
+                self.outstanding += 1;
+                crate::server::deferred::dispatch(
+                    request,
+                    frame.header,
+                    handler.as_ref(),
+                    &self.deferred,
+                );
+                return Ok(());
+            }
         };
 
-        // reply with the bytes
-        self.io.write_all(reply_frame).await?;
+        // queue the reply, it's written when the batch is flushed
+        Self::queue(&mut self.output, &self.metrics, reply_frame);
         Ok(())
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::common::frame::TxId;
+    use crate::common::traits::Serialize;
+    use crate::server::deferred::{DeferredHandler, Reply};
+    use crate::server::handler::{ServerHandlerMap, ServerHandlers};
+    use crate::types::{AddressRange, Indexed, UnitId};
+
+    struct Handler;
+    impl RequestHandler for Handler {
+        fn read_holding_register(&self, address: u16) -> Result<u16, ExceptionCode> {
+            Ok(address)
+        }
+    }
+
+    fn frame<T>(tx_id: u16, function: FunctionCode, msg: &T) -> Vec<u8>
+    where
+        T: Serialize,
+    {
+        let header = FrameHeader::new(UnitId::new(1), TxId::new(tx_id));
+        Vec::from(
+            MBAPFormatter::new(DecodeLevel::Nothing)
+                .format(header, function, msg)
+                .unwrap(),
+        )
+    }
+
+    #[test]
+    fn replies_to_all_pipelined_requests() {
+        let mut requests = frame(
+            0,
+            FunctionCode::ReadHoldingRegisters,
+            &AddressRange::try_from(1, 2).unwrap(),
+        );
+        requests.extend(frame(
+            1,
+            FunctionCode::ReadHoldingRegisters,
+            &AddressRange::try_from(5, 1).unwrap(),
+        ));
+
+        let mut replies = frame(0, FunctionCode::ReadHoldingRegisters, &[1u16, 2].as_ref());
+        replies.extend(frame(
+            1,
+            FunctionCode::ReadHoldingRegisters,
+            &[5u16].as_ref(),
+        ));
+
+        let io = tokio_test::io::Builder::new()
+            .read(&requests)
+            .write(&replies)
+            .build();
+
+        let (_tx, rx) = tokio::sync::mpsc::channel(1);
+        let metrics = Arc::new(ServerCounters::default());
+        let mut session = SessionTask::new(
+            io,
+            ServerHandlers::new(ServerHandlerMap::single(UnitId::new(1), Handler {}.wrap()))
+                .cache(),
+            rx,
+            ServerOptions::default(),
+            metrics.clone(),
+        );
+
+        // both replies are written before the session tries to read again
+        tokio_test::block_on(session.run_one()).unwrap();
+
+        let metrics = metrics.snapshot();
+        assert_eq!(metrics.requests_received, 2);
+        assert_eq!(metrics.bytes_received, requests.len() as u64);
+        assert_eq!(metrics.bytes_sent, replies.len() as u64);
+        assert_eq!(metrics.handler_lock_wait.count(), 2);
+    }
+
+    struct VersionedHandler {
+        value: u16,
+        version: u64,
+        reads: Arc<std::sync::atomic::AtomicUsize>,
+    }
+
+    impl RequestHandler for VersionedHandler {
+        fn version(&self) -> Option<u64> {
+            Some(self.version)
+        }
+
+        fn read_holding_register(&self, _address: u16) -> Result<u16, ExceptionCode> {
+            self.reads
+                .fetch_add(1, std::sync::atomic::Ordering::Relaxed);
+            Ok(self.value)
+        }
+
+        fn write_single_register(&mut self, value: Indexed<u16>) -> Result<(), ExceptionCode> {
+            self.value = value.value;
+            self.version += 1;
+            Ok(())
+        }
+    }
+
+    #[test]
+    fn reuses_cached_replies_until_the_version_changes() {
+        let range = AddressRange::try_from(0, 1).unwrap();
+        let write = Indexed::new(0, 7u16);
+
+        let mut requests = frame(0, FunctionCode::ReadHoldingRegisters, &range);
+        requests.extend(frame(1, FunctionCode::ReadHoldingRegisters, &range));
+        requests.extend(frame(2, FunctionCode::WriteSingleRegister, &write));
+        requests.extend(frame(3, FunctionCode::ReadHoldingRegisters, &range));
+
+        // the cached reply is sent with the transaction id of the second request
+        let mut replies = frame(0, FunctionCode::ReadHoldingRegisters, &[0u16].as_ref());
+        replies.extend(frame(
+            1,
+            FunctionCode::ReadHoldingRegisters,
+            &[0u16].as_ref(),
+        ));
+        replies.extend(frame(2, FunctionCode::WriteSingleRegister, &write));
+        replies.extend(frame(
+            3,
+            FunctionCode::ReadHoldingRegisters,
+            &[7u16].as_ref(),
+        ));
+
+        let io = tokio_test::io::Builder::new()
+            .read(&requests)
+            .write(&replies)
+            .build();
+
+        let reads = Arc::new(std::sync::atomic::AtomicUsize::new(0));
+        let handler = VersionedHandler {
+            value: 0,
+            version: 0,
+            reads: reads.clone(),
+        };
+        let options = ServerOptions {
+            response_cache_size: 4,
+            ..ServerOptions::default()
+        };
+
+        let (_tx, rx) = tokio::sync::mpsc::channel(1);
+        let mut session = SessionTask::new(
+            io,
+            ServerHandlers::new(ServerHandlerMap::single(UnitId::new(1), handler.wrap())).cache(),
+            rx,
+            options,
+            Arc::new(ServerCounters::default()),
+        );
+
+        tokio_test::block_on(session.run_one()).unwrap();
+        assert_eq!(reads.load(std::sync::atomic::Ordering::Relaxed), 2);
+    }
+
+    struct SlowHandler {
+        // replies to reads of address 1 are held until the test sends them
+        held: std::sync::Mutex<Vec<Reply<Vec<u16>>>>,
+    }
+
+    impl DeferredHandler for SlowHandler {
+        fn read_holding_registers(&self, range: AddressRange, reply: Reply<Vec<u16>>) {
+            if range.start == 1 {
+                self.held.lock().unwrap().push(reply);
+            } else {
+                reply.send(Ok(range.iter().collect()));
+            }
+        }
+    }
+
+    #[test]
+    fn deferred_replies_can_complete_out_of_order() {
+        let mut requests = frame(
+            0,
+            FunctionCode::ReadHoldingRegisters,
+            &AddressRange::try_from(1, 2).unwrap(),
+        );
+        requests.extend(frame(
+            1,
+            FunctionCode::ReadHoldingRegisters,
+            &AddressRange::try_from(5, 1).unwrap(),
+        ));
+
+        let io = tokio_test::io::Builder::new()
+            .read(&requests)
+            .write(&frame(
+                1,
+                FunctionCode::ReadHoldingRegisters,
+                &[5u16].as_ref(),
+            ))
+            .write(&frame(
+                0,
+                FunctionCode::ReadHoldingRegisters,
+                &[7u16, 8].as_ref(),
+            ))
+            .build();
+
+        let handler = Arc::new(SlowHandler {
+            held: std::sync::Mutex::new(Vec::new()),
+        });
+        let mut map = ServerHandlerMap::<Handler>::new();
+        map.add_deferred(UnitId::new(1), handler.clone());
+
+        let (_tx, rx) = tokio::sync::mpsc::channel(1);
+        let mut session = SessionTask::new(
+            io,
+            ServerHandlers::new(map).cache(),
+            rx,
+            ServerOptions::default(),
+            Arc::new(ServerCounters::default()),
+        );
+
+        // the first request doesn't delay the reply to the second one
+        tokio_test::block_on(session.run_one()).unwrap();
+        assert_eq!(session.replies.outstanding, 1);
+
+        let held = handler.held.lock().unwrap().pop().unwrap();
+        held.send(Ok(vec![7, 8]));
+        tokio_test::block_on(session.run_one()).unwrap();
+        assert_eq!(session.replies.outstanding, 0);
+    }
+}
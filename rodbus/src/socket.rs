@@ -0,0 +1,61 @@
+use std::time::Duration;
+
+use tokio::net::TcpStream;
+
+/// Settings applied to each TCP connection made by a channel or accepted by a server
+///
+/// The defaults leave the socket as the operating system created it. Settings that the
+/// operating system rejects are logged, the connection is used anyway.
+#[derive(Copy, Clone, Debug, PartialEq, Default)]
+pub struct SocketOptions {
+    /// Disable Nagle's algorithm (`TCP_NODELAY`) so that each frame is sent as soon as it's
+    /// written instead of being delayed until the previous segment has been acknowledged
+    pub no_delay: bool,
+    /// Size of the kernel receive buffer (`SO_RCVBUF`) in bytes, `None` for the system default
+    pub recv_buffer_size: Option<usize>,
+    /// Size of the kernel send buffer (`SO_SNDBUF`) in bytes, `None` for the system default
+    pub send_buffer_size: Option<usize>,
+    /// Enable TCP keepalive (`SO_KEEPALIVE`) with the specified idle time before the first
+    /// probe, so that a dead peer is detected on an idle connection. `None` leaves keepalive
+    /// disabled.
+    pub keep_alive: Option<Duration>,
+    /// Capacity of the buffer that frames are read into in bytes, `None` for the default of
+    /// the channel or server. A capacity smaller than the largest frame is increased to hold
+    /// it, a larger one lets pipelined frames be read with fewer system calls.
+    pub read_buffer_size: Option<usize>,
+}
+
+impl SocketOptions {
+    /// Settings for links where latency matters more than the number of segments: Nagle's
+    /// algorithm is disabled and a keepalive probe is sent after 10 seconds of silence
+    pub fn low_latency() -> Self {
+        Self {
+            no_delay: true,
+            keep_alive: Some(Duration::from_secs(10)),
+            ..Self::default()
+        }
+    }
+
+    pub(crate) fn apply(&self, stream: &TcpStream) {
+        if self.no_delay {
+            if let Err(err) = stream.set_nodelay(true) {
+                log::warn!("unable to set TCP_NODELAY: {}", err);
+            }
+        }
+        if let Some(size) = self.recv_buffer_size {
+            if let Err(err) = stream.set_recv_buffer_size(size) {
+                log::warn!("unable to set SO_RCVBUF to {}: {}", size, err);
+            }
+        }
+        if let Some(size) = self.send_buffer_size {
+            if let Err(err) = stream.set_send_buffer_size(size) {
+                log::warn!("unable to set SO_SNDBUF to {}: {}", size, err);
+            }
+        }
+        if let Some(time) = self.keep_alive {
+            if let Err(err) = stream.set_keepalive(Some(time)) {
+                log::warn!("unable to enable SO_KEEPALIVE: {}", err);
+            }
+        }
+    }
+}
@@ -1,27 +1,44 @@
 use std::net::SocketAddr;
-
-use tokio::sync::mpsc::Receiver;
+use std::sync::Arc;
 
 use crate::client::channel::ReconnectStrategy;
-use crate::client::message::Request;
 use crate::client::task::{ClientLoop, SessionError};
+use crate::common::frame::{FrameFormatter, FrameParser};
+use crate::metrics::ChannelCounters;
+use crate::socket::SocketOptions;
 
-pub(crate) struct TcpChannelTask {
+/// Maintains a TCP connection for a client loop, the framing used on the connection is
+/// determined by the loop (MBAP or RTU over TCP)
+pub(crate) struct TcpChannelTask<P, F>
+where
+    P: FrameParser,
+    F: FrameFormatter,
+{
     addr: SocketAddr,
     connect_retry: Box<dyn ReconnectStrategy + Send>,
-    client_loop: ClientLoop,
+    client_loop: ClientLoop<P, F>,
+    socket: SocketOptions,
+    metrics: Arc<ChannelCounters>,
 }
 
-impl TcpChannelTask {
+impl<P, F> TcpChannelTask<P, F>
+where
+    P: FrameParser,
+    F: FrameFormatter,
+{
     pub(crate) fn new(
         addr: SocketAddr,
-        rx: Receiver<Request>,
+        client_loop: ClientLoop<P, F>,
         connect_retry: Box<dyn ReconnectStrategy + Send>,
+        socket: SocketOptions,
+        metrics: Arc<ChannelCounters>,
     ) -> Self {
         Self {
             addr,
             connect_retry,
-            client_loop: ClientLoop::new(rx),
+            client_loop,
+            socket,
+            metrics,
         }
     }
 
@@ -30,6 +47,7 @@ impl TcpChannelTask {
         loop {
             match tokio::net::TcpStream::connect(self.addr).await {
                 Err(e) => {
+                    self.metrics.connect_failed();
                     log::warn!("error connecting: {}", e);
                     let delay = self.connect_retry.next_delay();
                     if self.client_loop.fail_requests_for(delay).await.is_err() {
@@ -38,8 +56,12 @@ impl TcpChannelTask {
                     }
                 }
                 Ok(stream) => {
+                    self.metrics.connected();
                     log::info!("connected to: {}", self.addr);
-                    match self.client_loop.run(stream).await {
+                    self.socket.apply(&stream);
+                    let result = self.client_loop.run(stream).await;
+                    self.metrics.disconnected();
+                    match result {
                         // the mpsc was closed, end the task
                         SessionError::Shutdown => return,
                         // re-establish the connection
@@ -2,8 +2,9 @@ use std::convert::TryFrom;
 
 use crate::common::buffer::ReadBuffer;
 use crate::common::cursor::WriteCursor;
-use crate::common::frame::{Frame, FrameFormatter, FrameHeader, FrameParser, TxId};
+use crate::common::frame::{FrameFormatter, FrameHeader, FrameInfo, FrameParser, TxId};
 use crate::common::traits::Serialize;
+use crate::decode::{DecodeLevel, FrameDisplay};
 use crate::error::*;
 use crate::types::UnitId;
 
@@ -33,12 +34,14 @@ pub(crate) struct MBAPParser {
 }
 
 pub(crate) struct MBAPFormatter {
+    decode: DecodeLevel,
     buffer: [u8; constants::MAX_FRAME_LENGTH],
 }
 
 impl MBAPFormatter {
-    pub(crate) fn new() -> Self {
+    pub(crate) fn new(decode: DecodeLevel) -> Self {
         Self {
+            decode,
             buffer: [0; constants::MAX_FRAME_LENGTH],
         }
     }
@@ -80,12 +83,6 @@ impl MBAPParser {
             unit_id,
         })
     }
-
-    fn parse_body(header: &MBAPHeader, cursor: &mut ReadBuffer) -> Result<Frame, Error> {
-        let mut frame = Frame::new(FrameHeader::new(header.unit_id, header.tx_id));
-        frame.set(cursor.read(header.adu_length)?);
-        Ok(frame)
-    }
 }
 
 impl FrameParser for MBAPParser {
@@ -93,16 +90,18 @@ impl FrameParser for MBAPParser {
         constants::MAX_FRAME_LENGTH
     }
 
-    fn parse(&mut self, cursor: &mut ReadBuffer) -> Result<Option<Frame>, Error> {
+    fn parse(&mut self, cursor: &mut ReadBuffer) -> Result<Option<FrameInfo>, Error> {
         match self.state {
             ParseState::Header(header) => {
                 if cursor.len() < header.adu_length {
                     return Ok(None);
                 }
 
-                let ret = Self::parse_body(&header, cursor)?;
                 self.state = ParseState::Begin;
-                Ok(Some(ret))
+                Ok(Some(FrameInfo::new(
+                    FrameHeader::new(header.unit_id, header.tx_id),
+                    header.adu_length,
+                )))
             }
             ParseState::Begin => {
                 if cursor.len() < constants::HEADER_LENGTH {
@@ -114,6 +113,10 @@ impl FrameParser for MBAPParser {
             }
         }
     }
+
+    fn reset(&mut self) {
+        self.state = ParseState::Begin;
+    }
 }
 
 impl FrameFormatter for MBAPFormatter {
@@ -141,6 +144,12 @@ impl FrameFormatter for MBAPFormatter {
 
         let total_length = constants::HEADER_LENGTH + adu_length;
 
+        if self.decode.enabled() {
+            if let Some(adu) = self.buffer.get(constants::HEADER_LENGTH..total_length) {
+                log::info!("-> {}", FrameDisplay::new(self.decode, header, adu));
+            }
+        }
+
         Ok(total_length)
     }
 
@@ -154,7 +163,7 @@ mod tests {
     use tokio_test::block_on;
     use tokio_test::io::Builder;
 
-    use crate::common::frame::FramedReader;
+    use crate::common::frame::{Frame, FramedReader};
     use crate::error::*;
 
     use super::*;
@@ -184,7 +193,7 @@ mod tests {
     fn test_segmented_parse(split_at: usize) {
         let (f1, f2) = SIMPLE_FRAME.split_at(split_at);
         let mut io = Builder::new().read(f1).read(f2).build();
-        let mut reader = FramedReader::new(MBAPParser::new());
+        let mut reader = FramedReader::new(MBAPParser::new(), DecodeLevel::Nothing);
         let frame = block_on(reader.next_frame(&mut io)).unwrap();
 
         assert_equals_simple_frame(&frame);
@@ -192,13 +201,13 @@ mod tests {
 
     fn test_error(input: &[u8]) -> Error {
         let mut io = Builder::new().read(input).build();
-        let mut reader = FramedReader::new(MBAPParser::new());
+        let mut reader = FramedReader::new(MBAPParser::new(), DecodeLevel::Nothing);
         block_on(reader.next_frame(&mut io)).err().unwrap()
     }
 
     #[test]
     fn correctly_formats_frame() {
-        let mut formatter = MBAPFormatter::new();
+        let mut formatter = MBAPFormatter::new(DecodeLevel::Nothing);
         let msg = MockMessage { a: 0x03, b: 0x04 };
         let header = FrameHeader::new(UnitId::new(42), TxId::new(7));
         let size = formatter.format_impl(header, &msg).unwrap();
@@ -210,7 +219,7 @@ mod tests {
     #[test]
     fn can_parse_frame_from_stream() {
         let mut io = Builder::new().read(SIMPLE_FRAME).build();
-        let mut reader = FramedReader::new(MBAPParser::new());
+        let mut reader = FramedReader::new(MBAPParser::new(), DecodeLevel::Nothing);
         let frame = block_on(reader.next_frame(&mut io)).unwrap();
 
         assert_equals_simple_frame(&frame);
@@ -223,7 +232,7 @@ mod tests {
         let payload = &[0xCC; 253];
 
         let mut io = Builder::new().read(header).read(payload).build();
-        let mut reader = FramedReader::new(MBAPParser::new());
+        let mut reader = FramedReader::new(MBAPParser::new(), DecodeLevel::Nothing);
         let frame = block_on(reader.next_frame(&mut io)).unwrap();
 
         assert_eq!(frame.payload(), payload.as_ref());
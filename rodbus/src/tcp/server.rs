@@ -1,63 +1,116 @@
 use std::collections::BTreeMap;
-use std::sync::Arc;
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex, MutexGuard};
 
 use std::net::SocketAddr;
 use tokio::net::TcpListener;
-use tokio::sync::Mutex;
 
-use crate::server::handler::{RequestHandler, ServerHandlerMap};
+use crate::metrics::ServerCounters;
+use crate::server::handler::{RequestHandler, ServerHandlers};
+use crate::server::ServerOptions;
 
+// number of independently locked shards in the session tracker
+const TRACKER_SHARDS: usize = 8;
+
+type Sessions = BTreeMap<u64, tokio::sync::mpsc::Sender<()>>;
+
+/// Keeps the shutdown sender of every active session and evicts the oldest session when the
+/// maximum is exceeded
+///
+/// Sessions are spread across shards by id so that sessions shutting down on worker threads
+/// don't contend with the accept loop for a single lock. The number of sessions is kept in an
+/// atomic so checking the limit never takes a lock.
 struct SessionTracker {
     max: usize,
-    id: u64,
-    sessions: BTreeMap<u64, tokio::sync::mpsc::Sender<()>>,
+    next_id: AtomicU64,
+    count: AtomicUsize,
+    shards: Vec<Mutex<Sessions>>,
+    metrics: Arc<ServerCounters>,
 }
 
-type SessionTrackerWrapper = Arc<Mutex<Box<SessionTracker>>>;
-
 impl SessionTracker {
-    fn new(max: usize) -> SessionTracker {
+    fn new(max: usize, metrics: Arc<ServerCounters>) -> SessionTracker {
         Self {
             max,
-            id: 0,
-            sessions: BTreeMap::new(),
+            next_id: AtomicU64::new(0),
+            count: AtomicUsize::new(0),
+            shards: (0..TRACKER_SHARDS)
+                .map(|_| Mutex::new(BTreeMap::new()))
+                .collect(),
+            metrics,
+        }
+    }
+
+    fn lock(shard: &Mutex<Sessions>) -> MutexGuard<'_, Sessions> {
+        // the map is always consistent, so a panic on another thread doesn't matter
+        match shard.lock() {
+            Ok(x) => x,
+            Err(x) => x.into_inner(),
         }
     }
 
-    fn get_next_id(&mut self) -> u64 {
-        let ret = self.id;
-        self.id += 1;
-        ret
+    fn shard(&self, id: u64) -> &Mutex<Sessions> {
+        &self.shards[(id % TRACKER_SHARDS as u64) as usize]
     }
 
-    pub(crate) fn wrapped(max: usize) -> SessionTrackerWrapper {
-        Arc::new(Mutex::new(Box::new(Self::new(max))))
+    fn next_id(&self) -> u64 {
+        self.next_id.fetch_add(1, Ordering::Relaxed)
     }
 
-    pub(crate) fn add(&mut self, sender: tokio::sync::mpsc::Sender<()>) -> u64 {
-        // TODO - this is so ugly. there's a nightly API on BTreeMap that has a remove_first
-        if !self.sessions.is_empty() && self.sessions.len() >= self.max {
-            let id = *self.sessions.keys().next().unwrap();
-            log::warn!("exceeded max connections, closing oldest session: {}", id);
-            // when the record drops, and there are no more senders,
-            // the other end will stop the task
-            self.sessions.remove(&id).unwrap();
+    fn add(&self, id: u64, sender: tokio::sync::mpsc::Sender<()>) {
+        Self::lock(self.shard(id)).insert(id, sender);
+        self.count.fetch_add(1, Ordering::AcqRel);
+        self.metrics.session_accepted();
+        self.evict(id);
+        self.metrics
+            .set_active_sessions(self.count.load(Ordering::Acquire));
+    }
+
+    // close the oldest sessions, other than the one just added, while there are too many
+    fn evict(&self, added: u64) {
+        while self.count.load(Ordering::Acquire) > self.max {
+            let oldest = self
+                .shards
+                .iter()
+                .filter_map(|shard| Self::lock(shard).keys().find(|id| **id != added).copied())
+                .min();
+
+            let id = match oldest {
+                Some(x) => x,
+                None => return,
+            };
+
+            // the session may have shut down on its own since the shards were checked
+            if self.remove_session(id) {
+                log::warn!("exceeded max connections, closing oldest session: {}", id);
+                self.metrics.session_evicted();
+            }
         }
+    }
 
-        let id = self.get_next_id();
-        self.sessions.insert(id, sender);
-        id
+    // when the sender drops, and there are no more senders, the other end will stop the task
+    fn remove_session(&self, id: u64) -> bool {
+        let removed = Self::lock(self.shard(id)).remove(&id).is_some();
+        if removed {
+            self.count.fetch_sub(1, Ordering::AcqRel);
+        }
+        removed
     }
 
-    pub(crate) fn remove(&mut self, id: u64) {
-        self.sessions.remove(&id);
+    fn remove(&self, id: u64) {
+        if self.remove_session(id) {
+            self.metrics
+                .set_active_sessions(self.count.load(Ordering::Acquire));
+        }
     }
 }
 
 pub(crate) struct ServerTask<T: RequestHandler> {
     listener: TcpListener,
-    handlers: ServerHandlerMap<T>,
-    tracker: SessionTrackerWrapper,
+    handlers: ServerHandlers<T>,
+    tracker: Arc<SessionTracker>,
+    options: ServerOptions,
+    metrics: Arc<ServerCounters>,
 }
 
 impl<T> ServerTask<T>
@@ -67,12 +120,16 @@ where
     pub(crate) fn new(
         max_sessions: usize,
         listener: TcpListener,
-        handlers: ServerHandlerMap<T>,
+        handlers: ServerHandlers<T>,
+        options: ServerOptions,
+        metrics: Arc<ServerCounters>,
     ) -> Self {
         Self {
             listener,
             handlers,
-            tracker: SessionTracker::wrapped(max_sessions),
+            tracker: Arc::new(SessionTracker::new(max_sessions, metrics.clone())),
+            options,
+            metrics,
         }
     }
 
@@ -90,7 +147,7 @@ where
                             return;
                         }
                         Ok((socket, addr)) => {
-                            self.handle(socket, addr).await
+                            self.handle(socket, addr)
                         }
                    }
                }
@@ -98,22 +155,61 @@ where
         }
     }
 
-    async fn handle(&self, socket: tokio::net::TcpStream, addr: SocketAddr) {
-        let handlers = self.handlers.clone();
+    // the accept loop only assigns an id and spawns the session, configuring the socket and the
+    // bookkeeping are done by the session task so that they run on whichever worker thread
+    // picks up the task, which keeps the loop short enough that a single acceptor is enough
+    fn handle(&self, socket: tokio::net::TcpStream, addr: SocketAddr) {
+        let handlers = self.handlers.cache();
         let tracker = self.tracker.clone();
-        let (tx, rx) = tokio::sync::mpsc::channel(1);
-
-        let id = self.tracker.lock().await.add(tx);
-
-        log::info!("accepted connection {} from: {}", id, addr);
+        let options = self.options;
+        let metrics = self.metrics.clone();
+        let id = tracker.next_id();
 
         tokio::spawn(async move {
-            crate::server::task::SessionTask::new(socket, handlers, rx)
+            options.socket.apply(&socket);
+            log::info!("accepted connection {} from: {}", id, addr);
+            let (tx, rx) = tokio::sync::mpsc::channel(1);
+            tracker.add(id, tx);
+            crate::server::task::SessionTask::new(socket, handlers, rx, options, metrics)
                 .run()
                 .await
                 .ok();
             log::info!("shutdown session: {}", id);
-            tracker.lock().await.remove(id);
+            tracker.remove(id);
         });
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn add(tracker: &SessionTracker) -> (u64, tokio::sync::mpsc::Receiver<()>) {
+        let (tx, rx) = tokio::sync::mpsc::channel(1);
+        let id = tracker.next_id();
+        tracker.add(id, tx);
+        (id, rx)
+    }
+
+    #[test]
+    fn evicts_the_oldest_session_across_shards() {
+        let metrics = Arc::new(ServerCounters::default());
+        let tracker = SessionTracker::new(2, metrics.clone());
+
+        let (first, mut first_rx) = add(&tracker);
+        let (_, mut second_rx) = add(&tracker);
+        let (_, mut third_rx) = add(&tracker);
+
+        // the sender of the oldest session was dropped, which shuts it down
+        assert_eq!(tokio_test::block_on(first_rx.recv()), None);
+        assert!(second_rx.try_recv().is_err());
+        assert!(third_rx.try_recv().is_err());
+
+        // a session that was evicted isn't counted twice when its task shuts down
+        tracker.remove(first);
+        let snapshot = metrics.snapshot();
+        assert_eq!(snapshot.sessions_accepted, 3);
+        assert_eq!(snapshot.sessions_evicted, 1);
+        assert_eq!(snapshot.active_sessions, 2);
+    }
+}
@@ -64,6 +64,8 @@ pub struct Indexed<T> {
 pub struct BitIterator<'a> {
     bytes: &'a [u8],
     range: AddressRange,
+    // position of the first bit of the range within the bytes
+    offset: u16,
     pos: u16,
 }
 
@@ -85,9 +87,20 @@ impl<'a> BitIterator<'a> {
         Ok(Self {
             bytes,
             range,
+            offset: 0,
             pos: 0,
         })
     }
+
+    /// iterate over a sub-range of the values, which must be contained in the range of this iterator
+    pub(crate) fn sub_range(&self, range: AddressRange) -> Self {
+        Self {
+            bytes: self.bytes,
+            range,
+            offset: self.offset + range.start.saturating_sub(self.range.start),
+            pos: 0,
+        }
+    }
 }
 
 impl<'a> RegisterIterator<'a> {
@@ -103,6 +116,121 @@ impl<'a> RegisterIterator<'a> {
             pos: 0,
         })
     }
+
+    /// iterate over a sub-range of the values, which must be contained in the range of this iterator
+    pub(crate) fn sub_range(&self, range: AddressRange) -> Self {
+        let skip = 2 * (range.start.saturating_sub(self.range.start) as usize);
+        Self {
+            bytes: self.bytes.get(skip..).unwrap_or(&[]),
+            range,
+            pos: 0,
+        }
+    }
+}
+
+/// Iterators that can copy their remaining values into a vector in a single pass,
+/// which is much faster than collecting them one value at a time
+pub(crate) trait CopyValues<T> {
+    /// append the values that haven't been iterated to `output`
+    fn copy_values(&self, output: &mut Vec<T>);
+}
+
+impl<'a> CopyValues<bool> for BitIterator<'a> {
+    fn copy_values(&self, output: &mut Vec<bool>) {
+        let start = output.len();
+        output.resize(start + self.len(), false);
+        if let Some(dest) = output.get_mut(start..) {
+            crate::common::bulk::unpack_bits(self.bytes, (self.offset + self.pos) as usize, dest);
+        }
+    }
+}
+
+impl<'a> CopyValues<u16> for RegisterIterator<'a> {
+    fn copy_values(&self, output: &mut Vec<u16>) {
+        let start = output.len();
+        output.resize(start + self.len(), 0);
+        let bytes = self.bytes.get(2 * (self.pos as usize)..).unwrap_or(&[]);
+        if let Some(dest) = output.get_mut(start..) {
+            crate::common::bulk::read_registers(bytes, dest);
+        }
+    }
+}
+
+/// Iterators over values as they are encoded in a response, so that responses can be
+/// compared without decoding every value
+pub(crate) trait RawValues<T>: Iterator<Item = Indexed<T>> + Copy {
+    /// the bytes that encode the values that haven't been iterated
+    fn raw(&self) -> &[u8];
+    /// iterate over the values that haven't been iterated and are encoded, at least in part,
+    /// by a range of the bytes returned by `raw`
+    fn raw_sub_range(&self, bytes: std::ops::Range<usize>) -> Option<Self>;
+}
+
+impl<'a> RawValues<bool> for BitIterator<'a> {
+    fn raw(&self) -> &[u8] {
+        let first = (self.offset + self.pos) as usize;
+        let end = (first + self.len() + 7) / 8;
+        self.bytes.get(first / 8..end).unwrap_or(&[])
+    }
+
+    fn raw_sub_range(&self, bytes: std::ops::Range<usize>) -> Option<Self> {
+        // position of the first value within the first byte
+        let shift = ((self.offset + self.pos) % 8) as usize;
+        let start = (8 * bytes.start).saturating_sub(shift);
+        let end = std::cmp::min((8 * bytes.end).saturating_sub(shift), self.len());
+        let count = end.checked_sub(start)? as u16;
+        let range =
+            AddressRange::try_from(self.range.start + self.pos + start as u16, count).ok()?;
+        Some(self.sub_range(range))
+    }
+}
+
+impl<'a> RawValues<u16> for RegisterIterator<'a> {
+    fn raw(&self) -> &[u8] {
+        let start = 2 * self.pos as usize;
+        self.bytes.get(start..start + 2 * self.len()).unwrap_or(&[])
+    }
+
+    fn raw_sub_range(&self, bytes: std::ops::Range<usize>) -> Option<Self> {
+        let start = bytes.start / 2;
+        let end = std::cmp::min((bytes.end + 1) / 2, self.len());
+        let count = end.checked_sub(start)? as u16;
+        let range =
+            AddressRange::try_from(self.range.start + self.pos + start as u16, count).ok()?;
+        Some(self.sub_range(range))
+    }
+}
+
+impl<'a> BitIterator<'a> {
+    /// Copy as many of the values that haven't been iterated as fit into `output` and
+    /// advance the iterator past them, returning the number of values copied
+    ///
+    /// The bits are unpacked in bulk, which is much faster than calling `next` for each value
+    pub fn copy_to(&mut self, output: &mut [bool]) -> usize {
+        let count = std::cmp::min(self.len(), output.len());
+        if let Some(dest) = output.get_mut(..count) {
+            crate::common::bulk::unpack_bits(self.bytes, (self.offset + self.pos) as usize, dest);
+        }
+        self.pos += count as u16;
+        count
+    }
+}
+
+impl<'a> RegisterIterator<'a> {
+    /// Copy as many of the values that haven't been iterated as fit into `output` and
+    /// advance the iterator past them, returning the number of values copied
+    ///
+    /// The registers are converted in bulk, which is much faster than calling `next` for
+    /// each value
+    pub fn copy_to(&mut self, output: &mut [u16]) -> usize {
+        let count = std::cmp::min(self.len(), output.len());
+        let bytes = self.bytes.get(2 * (self.pos as usize)..).unwrap_or(&[]);
+        if let Some(dest) = output.get_mut(..count) {
+            crate::common::bulk::read_registers(bytes, dest);
+        }
+        self.pos += count as u16;
+        count
+    }
 }
 
 impl<'a> Iterator for BitIterator<'a> {
@@ -113,8 +241,8 @@ impl<'a> Iterator for BitIterator<'a> {
         if self.pos == self.range.count {
             return None;
         }
-        let byte = self.pos / 8;
-        let bit = (self.pos % 8) as u8;
+        let byte = (self.offset + self.pos) / 8;
+        let bit = ((self.offset + self.pos) % 8) as u8;
 
         match self.bytes.get(byte as usize) {
             Some(value) => {
@@ -164,6 +292,10 @@ impl<'a> Iterator for RegisterIterator<'a> {
     }
 }
 
+impl<'a> ExactSizeIterator for BitIterator<'a> {}
+
+impl<'a> ExactSizeIterator for RegisterIterator<'a> {}
+
 #[derive(Copy, Clone)]
 pub struct WriteCoils<'a> {
     pub range: AddressRange,
@@ -221,6 +353,15 @@ impl<T> WriteMultiple<T> {
     }
 }
 
+impl WriteMultiple<u16> {
+    /// validate that the registers fit in a read/write multiple registers request
+    pub(crate) fn of_read_write_registers(self) -> Result<Self, InvalidRange> {
+        self.range
+            .limited_count(crate::constants::limits::MAX_READ_WRITE_REGISTERS_WRITE_COUNT)?;
+        Ok(self)
+    }
+}
+
 pub(crate) fn coil_from_u16(value: u16) -> Result<bool, ADUParseError> {
     match value {
         crate::constants::coil::ON => Ok(true),
@@ -264,6 +405,17 @@ impl AddressRange {
         AddressIterator::new(self.start, self.count)
     }
 
+    /// the smallest range containing both ranges, if they overlap or are adjacent
+    pub(crate) fn union(self, other: AddressRange) -> Option<AddressRange> {
+        let end = |x: AddressRange| x.start as u32 + x.count as u32;
+        if self.start as u32 > end(other) || other.start as u32 > end(self) {
+            return None;
+        }
+        let start = std::cmp::min(self.start, other.start);
+        let count = std::cmp::max(end(self), end(other)) - start as u32;
+        u16::try_from(count).ok().map(|count| Self { start, count })
+    }
+
     pub(crate) fn of_read_bits(self) -> Result<ReadBitsRange, InvalidRange> {
         Ok(ReadBitsRange {
             inner: self.limited_count(crate::constants::limits::MAX_READ_COILS_COUNT)?,
@@ -276,7 +428,7 @@ impl AddressRange {
         })
     }
 
-    fn limited_count(self, limit: u16) -> Result<Self, InvalidRange> {
+    pub(crate) fn limited_count(self, limit: u16) -> Result<Self, InvalidRange> {
         if self.count > limit {
             return Err(InvalidRange::CountTooLargeForType(self.count, limit));
         }
@@ -390,4 +542,66 @@ mod tests {
             vec![Indexed::new(1, 0xFFFF), Indexed::new(2, 0x01CC)]
         );
     }
+
+    #[test]
+    fn union_of_overlapping_and_adjacent_ranges() {
+        let range = |start, count| AddressRange::try_from(start, count).unwrap();
+        assert_eq!(range(0, 10).union(range(10, 10)), Some(range(0, 20)));
+        assert_eq!(range(15, 25).union(range(0, 20)), Some(range(0, 40)));
+        assert_eq!(range(0, 10).union(range(11, 10)), None);
+        assert_eq!(range(0, 0xFFFF).union(range(0xFFFF, 1)), None);
+    }
+
+    #[test]
+    fn sub_range_of_bits_is_not_byte_aligned() {
+        let mut cursor = ReadCursor::new(&[0b1010_0000, 0b0000_0001]);
+        let iterator =
+            BitIterator::parse_all(AddressRange::try_from(10, 9).unwrap(), &mut cursor).unwrap();
+
+        let values: Vec<Indexed<bool>> = iterator
+            .sub_range(AddressRange::try_from(15, 4).unwrap())
+            .collect();
+        assert_eq!(
+            values,
+            vec![
+                Indexed::new(15, true),
+                Indexed::new(16, false),
+                Indexed::new(17, true),
+                Indexed::new(18, true)
+            ]
+        );
+    }
+
+    #[test]
+    fn copies_the_remaining_bits_into_a_buffer() {
+        let mut cursor = ReadCursor::new(&[0b1100_1010, 0b0000_0001]);
+        let mut iterator =
+            BitIterator::parse_all(AddressRange::try_from(0, 9).unwrap(), &mut cursor).unwrap();
+        iterator.next();
+
+        let mut buffer = [false; 4];
+        assert_eq!(iterator.copy_to(&mut buffer), 4);
+        assert_eq!(buffer, [true, false, true, false]);
+
+        let mut buffer = [false; 8];
+        assert_eq!(iterator.copy_to(&mut buffer), 4);
+        assert_eq!(buffer[..4], [false, true, true, true]);
+        assert_eq!(iterator.copy_to(&mut buffer), 0);
+        assert!(iterator.next().is_none());
+    }
+
+    #[test]
+    fn copies_the_remaining_registers_into_a_buffer() {
+        let mut cursor = ReadCursor::new(&[0x00, 0x01, 0xCA, 0xFE, 0x12, 0x34]);
+        let mut iterator =
+            RegisterIterator::parse_all(AddressRange::try_from(7, 3).unwrap(), &mut cursor)
+                .unwrap();
+        assert_eq!(iterator.next(), Some(Indexed::new(7, 0x0001)));
+
+        let mut buffer = [0; 1];
+        assert_eq!(iterator.copy_to(&mut buffer), 1);
+        assert_eq!(buffer, [0xCAFE]);
+        assert_eq!(iterator.next(), Some(Indexed::new(9, 0x1234)));
+        assert_eq!(iterator.copy_to(&mut buffer), 0);
+    }
 }
@@ -3,6 +3,7 @@ extern crate rodbus;
 use rodbus::prelude::*;
 use std::net::SocketAddr;
 use std::str::FromStr;
+use std::sync::Arc;
 
 use tokio::net::TcpListener;
 use tokio::runtime::Runtime;
@@ -208,6 +209,35 @@ async fn test_requests_and_responses() {
             Indexed::new(2, 0x0506)
         ]
     );
+
+    // the same buffer can be reused across reads
+    let mut buffer = ReadBuffer::new();
+    session
+        .read_holding_registers_into(AddressRange::try_from(0, 3).unwrap(), &mut buffer)
+        .await
+        .unwrap();
+    assert_eq!(buffer.values(), &[0x0102, 0x0304, 0x0506]);
+    session
+        .read_holding_registers_into(AddressRange::try_from(1, 2).unwrap(), &mut buffer)
+        .await
+        .unwrap();
+    assert_eq!(buffer.values(), &[0x0304, 0x0506]);
+
+    // write and read back in a single transaction
+    assert_eq!(
+        session
+            .read_write_multiple_registers(
+                AddressRange::try_from(0, 3).unwrap(),
+                WriteMultiple::from(1, vec![0xCAFE]).unwrap()
+            )
+            .await
+            .unwrap(),
+        vec![
+            Indexed::new(0, 0x0102),
+            Indexed::new(1, 0xCAFE),
+            Indexed::new(2, 0x0506)
+        ]
+    );
 }
 
 #[test]
@@ -215,3 +245,115 @@ fn can_read_and_write_values() {
     let mut rt = Runtime::new().unwrap();
     rt.block_on(test_requests_and_responses())
 }
+
+async fn test_pooled_requests() {
+    let handler = Handler::new().wrap();
+    let addr = SocketAddr::from_str("127.0.0.1:40001").unwrap();
+
+    let _server = spawn_tcp_server_task(
+        3,
+        TcpListener::bind(addr).await.unwrap(),
+        ServerHandlerMap::single(UnitId::new(1), handler.clone()),
+    );
+
+    {
+        let mut guard = handler.lock().await;
+        guard.holding_registers[0] = 0xCAFE;
+    }
+
+    let pool = spawn_tcp_client_pool(
+        addr,
+        3,
+        10,
+        strategy::default,
+        ChannelOptions {
+            socket: SocketOptions::low_latency(),
+            ..ChannelOptions::default()
+        },
+        Distribution::LeastOutstanding,
+    );
+    let session = pool.create_session(UnitId::new(0x01), Duration::from_secs(1));
+
+    let reads: Vec<_> = (0..30)
+        .map(|_| {
+            let mut session = session.clone();
+            tokio::spawn(async move {
+                session
+                    .read_holding_registers(AddressRange::try_from(0, 1).unwrap())
+                    .await
+            })
+        })
+        .collect();
+
+    for read in reads {
+        let values = read.await.unwrap().unwrap();
+        assert_eq!(values, vec![Indexed::new(0, 0xCAFE)]);
+    }
+
+    let responses: u64 = pool.metrics().iter().map(|x| x.responses_received).sum();
+    assert_eq!(responses, 30);
+}
+
+#[test]
+fn can_spread_requests_across_a_pool() {
+    let mut rt = Runtime::new().unwrap();
+    rt.block_on(test_pooled_requests())
+}
+
+async fn test_proxied_requests() {
+    let handler = Handler::new().wrap();
+    let upstream_addr = SocketAddr::from_str("127.0.0.1:40002").unwrap();
+    let proxy_addr = SocketAddr::from_str("127.0.0.1:40003").unwrap();
+
+    let _upstream = spawn_tcp_server_task(
+        1,
+        TcpListener::bind(upstream_addr).await.unwrap(),
+        ServerHandlerMap::single(UnitId::new(1), handler.clone()),
+    );
+
+    {
+        let mut guard = handler.lock().await;
+        guard.holding_registers[0] = 0xCAFE;
+    }
+
+    let upstream = spawn_tcp_client_task(upstream_addr, 10, strategy::default());
+    let mut map = ServerHandlerMap::<Handler>::new();
+    map.add_deferred(
+        UnitId::new(7),
+        Arc::new(ProxyHandler::new(
+            upstream.create_session(UnitId::new(1), Duration::from_secs(1)),
+            Duration::from_secs(60),
+        )),
+    );
+    let _proxy = spawn_tcp_server_task(1, TcpListener::bind(proxy_addr).await.unwrap(), map);
+
+    let mut session = spawn_tcp_client_task(proxy_addr, 10, strategy::default())
+        .create_session(UnitId::new(7), Duration::from_secs(1));
+    let range = AddressRange::try_from(0, 1).unwrap();
+
+    // the second read is served from the cache
+    for _ in 0..2 {
+        assert_eq!(
+            session.read_holding_registers(range).await.unwrap(),
+            vec![Indexed::new(0, 0xCAFE)]
+        );
+    }
+    assert_eq!(upstream.metrics().requests_sent, 1);
+
+    // writes are forwarded and discard the cached values
+    session
+        .write_single_register(Indexed::new(0, 0xBEEF))
+        .await
+        .unwrap();
+    assert_eq!(
+        session.read_holding_registers(range).await.unwrap(),
+        vec![Indexed::new(0, 0xBEEF)]
+    );
+    assert_eq!(upstream.metrics().requests_sent, 3);
+}
+
+#[test]
+fn can_proxy_requests_through_a_cache() {
+    let mut rt = Runtime::new().unwrap();
+    rt.block_on(test_proxied_requests())
+}